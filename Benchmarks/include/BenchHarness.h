@@ -0,0 +1,598 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <random>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+	#include <linux/perf_event.h>
+	#include <sys/ioctl.h>
+	#include <sys/syscall.h>
+	#include <unistd.h>
+#endif
+
+namespace bench {
+
+using Clock = std::chrono::steady_clock;
+
+//-----------------------------------------------------------------------------
+inline uint64_t elapsedNs(Clock::time_point start, Clock::time_point end) {
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+}
+
+//-----------------------------------------------------------------------------
+// Keeps the compiler from dropping a computation whose result is otherwise unused
+template<class T>
+inline void doNotOptimize(const T& value) {
+	#if defined(_MSC_VER)
+		static volatile T sink;
+		sink = value;
+	#else
+		__asm__ volatile("" : : "r,m"(value) : "memory");
+	#endif
+}
+
+//-----------------------------------------------------------------------------
+class Stopwatch {
+public:
+	Stopwatch()
+		: start_(Clock::now())
+	{}
+
+	uint64_t elapsedNs() const {
+		return bench::elapsedNs(start_, Clock::now());
+	}
+
+private:
+	Clock::time_point start_;
+};
+
+//-----------------------------------------------------------------------------
+// Hardware cache and branch miss counters of the calling thread via perf_event_open.
+// Unavailable outside Linux and when the kernel refuses (perf_event_paranoid, containers),
+// the results then report no counters instead of failing.
+class PerfCounters {
+public:
+	PerfCounters() {
+		#if defined(__linux__)
+			leader_ = open(PERF_COUNT_HW_CACHE_MISSES, -1);
+			if (leader_ < 0)
+				return;
+			member_ = open(PERF_COUNT_HW_BRANCH_MISSES, leader_);
+			if (member_ < 0) {
+				close(leader_);
+				leader_ = -1;
+			}
+		#endif
+	}
+
+	~PerfCounters() {
+		#if defined(__linux__)
+			if (member_ >= 0)
+				close(member_);
+			if (leader_ >= 0)
+				close(leader_);
+		#endif
+	}
+
+	PerfCounters(const PerfCounters&) = delete;
+	PerfCounters& operator=(const PerfCounters&) = delete;
+
+	bool available() const {
+		return leader_ >= 0;
+	}
+
+	void start() {
+		#if defined(__linux__)
+			if (!available())
+				return;
+			ioctl(leader_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+			ioctl(leader_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+		#endif
+	}
+
+	// Adds the counts since start() to cacheMisses and branchMisses
+	void stop(uint64_t& cacheMisses, uint64_t& branchMisses) {
+		#if defined(__linux__)
+			if (!available())
+				return;
+			ioctl(leader_, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+			// PERF_FORMAT_GROUP layout: nr, then one value per event in the order they were opened
+			uint64_t values[3] = {};
+			if (read(leader_, values, sizeof(values)) == static_cast<ssize_t>(sizeof(values)) && values[0] == 2) {
+				cacheMisses += values[1];
+				branchMisses += values[2];
+			}
+		#else
+			(void)cacheMisses;
+			(void)branchMisses;
+		#endif
+	}
+
+private:
+	int leader_{ -1 };
+	int member_{ -1 };
+
+	#if defined(__linux__)
+		static int open(uint64_t config, int groupFd) {
+			perf_event_attr attr;
+			memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.config = config;
+			attr.disabled = groupFd < 0 ? 1 : 0;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			attr.read_format = PERF_FORMAT_GROUP;
+			return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, groupFd, 0));
+		}
+	#endif
+};
+
+//-----------------------------------------------------------------------------
+struct Options {
+	uint32_t warmup{ 1 };
+	uint32_t repetitions{ 5 };
+	// Upper bound of individually timed ops per case, larger cases time every n-th op
+	uint32_t latencySamples{ 1u << 20 };
+	bool perf{ false };
+	bool quick{ false };
+	bool matrix{ true };
+	bool extras{ true };
+	std::string filter;
+	std::string jsonPath;
+	std::string csvPath;
+
+	// Returns false and prints the usage on unknown arguments
+	bool parse(int argc, char** argv) {
+		for (int i = 1; i < argc; ++i) {
+			const std::string arg = argv[i];
+			const bool hasValue = i + 1 < argc;
+			if (arg == "--warmup" && hasValue) {
+				warmup = static_cast<uint32_t>(std::stoul(argv[++i]));
+			} else if (arg == "--reps" && hasValue) {
+				repetitions = std::max(1u, static_cast<uint32_t>(std::stoul(argv[++i])));
+			} else if (arg == "--latency-samples" && hasValue) {
+				latencySamples = static_cast<uint32_t>(std::stoul(argv[++i]));
+			} else if (arg == "--filter" && hasValue) {
+				filter = argv[++i];
+			} else if (arg == "--json" && hasValue) {
+				jsonPath = argv[++i];
+			} else if (arg == "--csv" && hasValue) {
+				csvPath = argv[++i];
+			} else if (arg == "--perf") {
+				perf = true;
+			} else if (arg == "--quick") {
+				quick = true;
+			} else if (arg == "--no-matrix") {
+				matrix = false;
+			} else if (arg == "--no-extras") {
+				extras = false;
+			} else {
+				printf(
+					"Usage: %s [options]\n"
+					"  --warmup N            untimed runs before measuring (default 1)\n"
+					"  --reps N              timed repetitions, ns/op is their median (default 5)\n"
+					"  --latency-samples N   max individually timed ops per case, 0 disables (default 1048576)\n"
+					"  --filter TEXT         only run cases whose name contains TEXT\n"
+					"  --perf                read cache and branch miss counters (Linux)\n"
+					"  --quick               small sizes only\n"
+					"  --no-matrix           skip the policy x workload matrix\n"
+					"  --no-extras           skip the feature specific benchmarks\n"
+					"  --json PATH           write results as JSON, - for stdout\n"
+					"  --csv PATH            write results as CSV, - for stdout\n",
+					argv[0]);
+				return false;
+			}
+		}
+		return true;
+	}
+};
+
+//-----------------------------------------------------------------------------
+struct Result {
+	std::string suite;			// "matrix" or "extra"
+	std::string container;
+	std::string workload;
+	std::string distribution;	// Empty where it does not apply
+	uint64_t size{ 0 };			// Table slots for the matrix, element count otherwise
+	uint64_t elements{ 0 };
+	double loadFactor{ 0 };		// Configured max load factor, 0 where it does not apply
+	double fill{ 0 };			// count / capacity of the prefilled table, 0 if unknown
+	uint64_t ops{ 0 };
+	uint32_t repetitions{ 0 };
+	double nsPerOp{ 0 };		// Median over the repetitions
+	double nsPerOpMin{ 0 };
+	// Per op latency percentiles in ns, negative if not sampled
+	double p50{ -1 };
+	double p90{ -1 };
+	double p99{ -1 };
+	double p999{ -1 };
+	double max{ -1 };
+	// Per op, negative if the counters were not read
+	double cacheMissesPerOp{ -1 };
+	double branchMissesPerOp{ -1 };
+	// From the ProbeStats of the probing benchmarks, negative elsewhere
+	double meanProbeLength{ -1 };
+	double maxClusterLength{ -1 };
+	// Memory of the container the case ran on divided by its elements, negative if not measured
+	double bytesPerElement{ -1 };
+	// Median ns/op of std::unordered_set in the same case divided by this one, 0 if there is none
+	double speedupVsStd{ 0 };
+	uint64_t checksum{ 0 };
+
+	std::string name() const {
+		std::string result = suite + "/" + container + "/" + workload;
+		if (!distribution.empty())
+			result += "/" + distribution;
+		result += "/" + std::to_string(size);
+		if (loadFactor > 0) {
+			char lf[16];
+			snprintf(lf, sizeof(lf), "/lf%.2f", loadFactor);
+			result += lf;
+		}
+		return result;
+	}
+};
+
+//-----------------------------------------------------------------------------
+// Nearest rank percentile of sorted values
+inline double percentile(const std::vector<double>& sorted, double p) {
+	if (sorted.empty())
+		return -1;
+	return sorted[std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()))];
+}
+
+//-----------------------------------------------------------------------------
+// Typical cost of one Clock::now() pair, subtracted from individually timed ops
+inline double timerOverheadNs() {
+	static const double overhead = []() {
+		std::vector<double> samples;
+		for (int i = 0; i < 1001; ++i) {
+			const auto start = Clock::now();
+			const auto end = Clock::now();
+			samples.push_back(static_cast<double>(elapsedNs(start, end)));
+		}
+		std::sort(samples.begin(), samples.end());
+		return samples[samples.size() / 2];
+	}();
+	return overhead;
+}
+
+//-----------------------------------------------------------------------------
+// Runs warmup and timed repetitions of ops calls to op(state, i) on a fresh state from
+// setup() each, followed by one pass which times a sample of the ops one by one.
+// op returns a value which is summed into the checksum so the work cannot be elided.
+template<class TSetup, class TOp>
+void measure(const Options& options, Result& result, uint64_t ops, TSetup&& setup, TOp&& op) {
+	result.ops = ops;
+	result.repetitions = options.repetitions;
+	if (ops == 0)
+		return;
+
+	for (uint32_t w = 0; w < options.warmup; ++w) {
+		auto state = setup();
+		uint64_t checksum = 0;
+		for (uint64_t i = 0; i < ops; ++i) {
+			checksum += op(state, i);
+		}
+		doNotOptimize(checksum);
+	}
+
+	PerfCounters counters;
+	const bool readCounters = options.perf && counters.available();
+	uint64_t cacheMisses = 0;
+	uint64_t branchMisses = 0;
+
+	std::vector<double> nsPerOp;
+	for (uint32_t r = 0; r < options.repetitions; ++r) {
+		auto state = setup();
+		uint64_t checksum = 0;
+		if (readCounters)
+			counters.start();
+		const auto start = Clock::now();
+		for (uint64_t i = 0; i < ops; ++i) {
+			checksum += op(state, i);
+		}
+		const auto end = Clock::now();
+		if (readCounters)
+			counters.stop(cacheMisses, branchMisses);
+		nsPerOp.push_back(static_cast<double>(elapsedNs(start, end)) / ops);
+		result.checksum = checksum;
+	}
+
+	std::sort(nsPerOp.begin(), nsPerOp.end());
+	result.nsPerOp = nsPerOp[nsPerOp.size() / 2];
+	result.nsPerOpMin = nsPerOp.front();
+	if (readCounters) {
+		const double totalOps = static_cast<double>(ops) * options.repetitions;
+		result.cacheMissesPerOp = cacheMisses / totalOps;
+		result.branchMissesPerOp = branchMisses / totalOps;
+	}
+
+	if (options.latencySamples == 0)
+		return;
+
+	// All ops run so the state evolves as in the timed passes, only every stride-th is timed
+	const uint64_t stride = (ops + options.latencySamples - 1) / options.latencySamples;
+	const double overhead = timerOverheadNs();
+	std::vector<double> latencies;
+	latencies.reserve(static_cast<size_t>(ops / stride + 1));
+	auto state = setup();
+	uint64_t checksum = 0;
+	for (uint64_t i = 0; i < ops; ++i) {
+		if (i % stride != 0) {
+			checksum += op(state, i);
+			continue;
+		}
+		const auto start = Clock::now();
+		checksum += op(state, i);
+		const auto end = Clock::now();
+		latencies.push_back(std::max(0.0, static_cast<double>(elapsedNs(start, end)) - overhead));
+	}
+	doNotOptimize(checksum);
+
+	std::sort(latencies.begin(), latencies.end());
+	result.p50 = percentile(latencies, 0.5);
+	result.p90 = percentile(latencies, 0.9);
+	result.p99 = percentile(latencies, 0.99);
+	result.p999 = percentile(latencies, 0.999);
+	result.max = latencies.back();
+}
+
+//-----------------------------------------------------------------------------
+// Collects results, prints each as it arrives and writes the JSON and CSV files at the end
+class Reporter {
+public:
+	explicit Reporter(const Options& options)
+		: options_(options)
+	{}
+
+	const Options& options() const {
+		return options_;
+	}
+
+	bool enabled(const std::string& name) const {
+		return options_.filter.empty() || name.find(options_.filter) != std::string::npos;
+	}
+
+	// For one shot measurements outside of measure(), e.g. multi threaded runs
+	void addTiming(Result result, uint64_t ops, uint64_t ns) {
+		result.ops = ops;
+		result.repetitions = 1;
+		result.nsPerOp = ops == 0 ? 0 : static_cast<double>(ns) / ops;
+		result.nsPerOpMin = result.nsPerOp;
+		add(std::move(result));
+	}
+
+	void add(Result result) {
+		if (result.suite == "matrix" && result.container == STD_CONTAINER)
+			fillSpeedups(result);
+		else if (result.suite == "matrix")
+			result.speedupVsStd = speedupAgainst(result, findStd(result));
+
+		if (!printedHeader_) {
+			printf("%-72s %10s %10s %9s %9s %9s %9s\n", "case", "ns/op", "min", "p50", "p99", "p99.9", "max");
+			printedHeader_ = true;
+		}
+		printf("%-72s %10.2f %10.2f", result.name().c_str(), result.nsPerOp, result.nsPerOpMin);
+		for (const double latency : { result.p50, result.p99, result.p999, result.max }) {
+			if (latency < 0)
+				printf(" %9s", "-");
+			else
+				printf(" %9.0f", latency);
+		}
+		if (result.cacheMissesPerOp >= 0)
+			printf("  cache-miss/op %.3f branch-miss/op %.3f", result.cacheMissesPerOp, result.branchMissesPerOp);
+		if (result.meanProbeLength >= 0)
+			printf("  probe %.2f max-cluster %.0f", result.meanProbeLength, result.maxClusterLength);
+		if (result.bytesPerElement >= 0)
+			printf("  bytes/elem %.1f", result.bytesPerElement);
+		printf("\n");
+		fflush(stdout);
+
+		results_.push_back(std::move(result));
+	}
+
+	// Name of the baseline container the matrix compares against
+	static constexpr const char* STD_CONTAINER = "std::unordered_set";
+
+	void write(const std::string& simdLevel) const {
+		if (!options_.jsonPath.empty())
+			writeFile(options_.jsonPath, [&](FILE* file) { writeJson(file, simdLevel); });
+		if (!options_.csvPath.empty())
+			writeFile(options_.csvPath, [&](FILE* file) { writeCsv(file); });
+	}
+
+private:
+	const Options& options_;
+	std::vector<Result> results_;
+	bool printedHeader_{ false };
+
+	static bool sameCase(const Result& a, const Result& b) {
+		return a.workload == b.workload && a.distribution == b.distribution && a.size == b.size && a.loadFactor == b.loadFactor;
+	}
+
+	static double speedupAgainst(const Result& result, const Result* baseline) {
+		if (baseline == nullptr || result.nsPerOp <= 0)
+			return 0;
+		return baseline->nsPerOp / result.nsPerOp;
+	}
+
+	const Result* findStd(const Result& result) const {
+		for (const auto& other : results_) {
+			if (other.suite == "matrix" && other.container == STD_CONTAINER && sameCase(other, result))
+				return &other;
+		}
+		return nullptr;
+	}
+
+	// The baseline may run after the containers it is compared to
+	void fillSpeedups(Result& baseline) {
+		baseline.speedupVsStd = 1;
+		for (auto& other : results_) {
+			if (other.suite == "matrix" && sameCase(other, baseline))
+				other.speedupVsStd = speedupAgainst(other, &baseline);
+		}
+	}
+
+	template<class TWrite>
+	static void writeFile(const std::string& path, TWrite&& write) {
+		if (path == "-") {
+			write(stdout);
+			return;
+		}
+		FILE* file = fopen(path.c_str(), "w");
+		if (file == nullptr) {
+			fprintf(stderr, "Cannot open %s for writing\n", path.c_str());
+			return;
+		}
+		write(file);
+		fclose(file);
+	}
+
+	static std::string escape(const std::string& text) {
+		std::string result;
+		for (const char c : text) {
+			if (c == '"' || c == '\\')
+				result += '\\';
+			result += c;
+		}
+		return result;
+	}
+
+	// Negative values mean "not measured" and become null
+	static void writeJsonNumber(FILE* file, const char* key, double value, bool last = false) {
+		if (value < 0)
+			fprintf(file, "\"%s\": null%s", key, last ? "" : ", ");
+		else
+			fprintf(file, "\"%s\": %.6g%s", key, value, last ? "" : ", ");
+	}
+
+	void writeJson(FILE* file, const std::string& simdLevel) const {
+		char timestamp[32];
+		const time_t now = time(nullptr);
+		strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+		fprintf(file, "{\n");
+		fprintf(file, "  \"context\": {\"timestamp\": \"%s\", \"simdLevel\": \"%s\", \"optimized\": %s, \"warmup\": %u, \"repetitions\": %u},\n",
+			timestamp, simdLevel.c_str(),
+			#if defined(NDEBUG)
+				"true",
+			#else
+				"false",
+			#endif
+			options_.warmup, options_.repetitions);
+		fprintf(file, "  \"results\": [\n");
+		for (size_t i = 0; i < results_.size(); ++i) {
+			const Result& r = results_[i];
+			fprintf(file, "    {\"name\": \"%s\", \"suite\": \"%s\", \"container\": \"%s\", \"workload\": \"%s\", \"distribution\": \"%s\", ",
+				escape(r.name()).c_str(), r.suite.c_str(), escape(r.container).c_str(), r.workload.c_str(), r.distribution.c_str());
+			fprintf(file, "\"size\": %llu, \"elements\": %llu, \"ops\": %llu, \"repetitions\": %u, \"checksum\": %llu, ",
+				static_cast<unsigned long long>(r.size), static_cast<unsigned long long>(r.elements),
+				static_cast<unsigned long long>(r.ops), r.repetitions, static_cast<unsigned long long>(r.checksum));
+			writeJsonNumber(file, "loadFactor", r.loadFactor);
+			writeJsonNumber(file, "fill", r.fill);
+			writeJsonNumber(file, "nsPerOp", r.nsPerOp);
+			writeJsonNumber(file, "nsPerOpMin", r.nsPerOpMin);
+			writeJsonNumber(file, "p50", r.p50);
+			writeJsonNumber(file, "p90", r.p90);
+			writeJsonNumber(file, "p99", r.p99);
+			writeJsonNumber(file, "p999", r.p999);
+			writeJsonNumber(file, "max", r.max);
+			writeJsonNumber(file, "cacheMissesPerOp", r.cacheMissesPerOp);
+			writeJsonNumber(file, "branchMissesPerOp", r.branchMissesPerOp);
+			writeJsonNumber(file, "meanProbeLength", r.meanProbeLength);
+			writeJsonNumber(file, "maxClusterLength", r.maxClusterLength);
+			writeJsonNumber(file, "bytesPerElement", r.bytesPerElement);
+			writeJsonNumber(file, "speedupVsStd", r.speedupVsStd > 0 ? r.speedupVsStd : -1, true);
+			fprintf(file, "}%s\n", i + 1 < results_.size() ? "," : "");
+		}
+		fprintf(file, "  ]\n}\n");
+	}
+
+	// Negative values mean "not measured" and become empty fields
+	static void writeCsvNumber(FILE* file, double value) {
+		if (value < 0)
+			fprintf(file, ",");
+		else
+			fprintf(file, ",%.6g", value);
+	}
+
+	void writeCsv(FILE* file) const {
+		fprintf(file, "name,suite,container,workload,distribution,size,elements,loadFactor,fill,ops,repetitions,"
+			"nsPerOp,nsPerOpMin,p50,p90,p99,p999,max,cacheMissesPerOp,branchMissesPerOp,meanProbeLength,maxClusterLength,bytesPerElement,speedupVsStd,checksum\n");
+		for (const Result& r : results_) {
+			fprintf(file, "\"%s\",%s,\"%s\",%s,%s,%llu,%llu", r.name().c_str(), r.suite.c_str(), r.container.c_str(),
+				r.workload.c_str(), r.distribution.c_str(),
+				static_cast<unsigned long long>(r.size), static_cast<unsigned long long>(r.elements));
+			writeCsvNumber(file, r.loadFactor);
+			writeCsvNumber(file, r.fill);
+			fprintf(file, ",%llu,%u", static_cast<unsigned long long>(r.ops), r.repetitions);
+			writeCsvNumber(file, r.nsPerOp);
+			writeCsvNumber(file, r.nsPerOpMin);
+			writeCsvNumber(file, r.p50);
+			writeCsvNumber(file, r.p90);
+			writeCsvNumber(file, r.p99);
+			writeCsvNumber(file, r.p999);
+			writeCsvNumber(file, r.max);
+			writeCsvNumber(file, r.cacheMissesPerOp);
+			writeCsvNumber(file, r.branchMissesPerOp);
+			writeCsvNumber(file, r.meanProbeLength);
+			writeCsvNumber(file, r.maxClusterLength);
+			writeCsvNumber(file, r.bytesPerElement);
+			writeCsvNumber(file, r.speedupVsStd > 0 ? r.speedupVsStd : -1);
+			fprintf(file, ",%llu\n", static_cast<unsigned long long>(r.checksum));
+		}
+	}
+};
+
+//-----------------------------------------------------------------------------
+// YCSB style zipfian generator (Gray et al., "Quickly generating billion-record synthetic
+// databases") over [0, n). Rank 0 is the most popular. Setup is O(n), each draw O(1).
+class ZipfianDistribution {
+public:
+	explicit ZipfianDistribution(uint64_t n, double theta = 0.99)
+		: n_(n)
+		, theta_(theta)
+	{
+		zetaN_ = 0;
+		for (uint64_t i = 1; i <= n; ++i) {
+			zetaN_ += 1.0 / std::pow(static_cast<double>(i), theta);
+		}
+		const double zeta2 = 1.0 + 1.0 / std::pow(2.0, theta);
+		alpha_ = 1.0 / (1.0 - theta);
+		eta_ = (1.0 - std::pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / zetaN_);
+		halfPowTheta_ = 1.0 + std::pow(0.5, theta);
+	}
+
+	template<class TEngine>
+	uint64_t operator()(TEngine& engine) {
+		const double u = std::generate_canonical<double, 53>(engine);
+		const double uz = u * zetaN_;
+		if (uz < 1.0)
+			return 0;
+		if (uz < halfPowTheta_)
+			return std::min<uint64_t>(1, n_ - 1);
+		const uint64_t rank = static_cast<uint64_t>(n_ * std::pow(eta_ * u - eta_ + 1.0, alpha_));
+		return std::min(rank, n_ - 1);
+	}
+
+private:
+	uint64_t n_;
+	double theta_;
+	double zetaN_;
+	double alpha_;
+	double eta_;
+	double halfPowTheta_;
+};
+
+} // namespace bench
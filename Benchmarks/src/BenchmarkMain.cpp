@@ -1,219 +1,1520 @@
+#include "LinearProbingHashMap.h"
 #include "LinearProbingHashSet.h"
+#include "HashSet.h"
+#include "IntHashSet.h"
+#include "ConcurrentLPHashSet.h"
+#include "LockFreeReadLPHashSet.h"
+#include "BlockedBloomFilter.h"
 
-#include <iostream>
-#include <chrono>
-#include <array>
+#include "BenchHarness.h"
+
+#include <cstdio>
+#include <unordered_map>
 #include <unordered_set>
 #include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <bitset>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <type_traits>
 
-class Stopwatch {
-public:
-	Stopwatch() {
-		m_Start = std::chrono::system_clock::now();
+using bench::Reporter;
+using bench::Result;
+
+enum class SetType {
+	Std,
+	Hs
+};
+
+//-----------------------------------------------------------------------------
+// std::unordered_set has no contains() and erases with erase() in C++17
+template<SetType Type, class SetT, class TKey>
+bool setContains(const SetT& set, const TKey& key) {
+	if constexpr (Type == SetType::Std) {
+		return set.find(key) != set.end();
+	} else {
+		return set.contains(key);
 	}
+}
 
-	void stop(uint32_t count) {
-		auto end = std::chrono::system_clock::now();
-		auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(end - m_Start);
-		std::cout << "\tBenchamrking of " << count << " elements finished in " << elapsed.count() << " microseconds" << std::endl;
+template<SetType Type, class SetT, class TKey>
+void setRemove(SetT& set, const TKey& key) {
+	if constexpr (Type == SetType::Std) {
+		set.erase(key);
+	} else {
+		set.remove(key);
 	}
+}
 
-private:
-	std::chrono::system_clock::time_point m_Start;
+template<class SetT, class = void>
+struct HasReserve : std::false_type {};
+
+template<class SetT>
+struct HasReserve<SetT, std::void_t<decltype(std::declval<SetT&>().reserve(size_t()))>> : std::true_type {};
+
+//-----------------------------------------------------------------------------
+// Reports the per op numbers of a result whose single op processes items elements,
+// e.g. a full iteration pass or building a whole set
+void scalePerItem(Result& result, double items) {
+	if (items <= 0)
+		return;
+	for (double* value : { &result.nsPerOp, &result.nsPerOpMin, &result.p50, &result.p90, &result.p99, &result.p999, &result.max,
+		&result.cacheMissesPerOp, &result.branchMissesPerOp }) {
+		if (*value >= 0)
+			*value /= items;
+	}
+}
+
+Result makeResult(const char* suite, const std::string& container, const std::string& workload, uint64_t size) {
+	Result result;
+	result.suite = suite;
+	result.container = container;
+	result.workload = workload;
+	result.size = size;
+	result.elements = size;
+	return result;
+}
+
+const char* simdLevelName(hs::SimdLevel level) {
+	switch (level) {
+		case hs::SimdLevel::SSE2: return "SSE2";
+		case hs::SimdLevel::AVX2: return "AVX2";
+		case hs::SimdLevel::AVX512: return "AVX512";
+		default: return "None";
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Workload matrix
+//-----------------------------------------------------------------------------
+enum class Distribution {
+	Sequential,	// Keys 0..n-1, visited in order
+	Uniform,	// Random distinct keys, visited uniformly at random
+	Zipfian		// Random distinct keys, visited with zipfian popularity
 };
 
-enum class SetType {
-	Std,
-	Hs
+const char* distributionName(Distribution distribution) {
+	switch (distribution) {
+		case Distribution::Sequential: return "sequential";
+		case Distribution::Uniform: return "uniform";
+		default: return "zipfian";
+	}
+}
+
+// Bijective mix of 32 bit integers (lowbias32), distinct inputs give distinct random looking keys
+uint32_t mixKey(uint32_t x) {
+	x ^= x >> 16;
+	x *= 0x7feb352d;
+	x ^= x >> 15;
+	x *= 0x846ca68b;
+	x ^= x >> 16;
+	return x;
+}
+
+struct MatrixCase {
+	Distribution distribution;
+	uint64_t slots;			// Power of two table size the elements are sized for
+	double loadFactor;
+	uint64_t elements;		// loadFactor * slots
 };
 
-template<class SetT>
-void benchInsertIntSet(uint32_t count) {
-	std::cout << "--- Insert" << std::endl;
-	Stopwatch sw{};
+// Keys of one case, generated outside of the timed loops and shared by all containers
+struct MatrixKeys {
+	std::vector<uint32_t> present;
+	std::vector<uint32_t> absent;	// Never inserted, absent[i] replaces present[i] during churn
+	std::vector<uint32_t> inserts;	// Indices into present in insert order, zipfian repeats hot keys
+	std::vector<uint32_t> lookups;	// Indices into present / absent, one per lookup or churn op
 
-	SetT set;
-	for (uint32_t i = 0; i < count; ++i) {
-		set.insert(i);
+	MatrixKeys(const MatrixCase& c, uint64_t lookupCount) {
+		const uint32_t n = static_cast<uint32_t>(c.elements);
+		present.resize(n);
+		absent.resize(n);
+		inserts.resize(n);
+		lookups.resize(lookupCount);
+
+		const bool sequential = c.distribution == Distribution::Sequential;
+		for (uint32_t i = 0; i < n; ++i) {
+			present[i] = sequential ? i : mixKey(i);
+			absent[i] = sequential ? n + i : mixKey(n + i);
+			inserts[i] = i;
+		}
+
+		std::default_random_engine engine(n);
+		if (c.distribution == Distribution::Sequential) {
+			for (uint64_t i = 0; i < lookupCount; ++i) {
+				lookups[i] = static_cast<uint32_t>(i % n);
+			}
+		} else if (c.distribution == Distribution::Uniform) {
+			std::uniform_int_distribution<uint32_t> dist(0, n - 1);
+			for (auto& index : lookups) {
+				index = dist(engine);
+			}
+		} else {
+			bench::ZipfianDistribution dist(n);
+			for (auto& index : lookups) {
+				index = static_cast<uint32_t>(dist(engine));
+			}
+			for (auto& index : inserts) {
+				index = static_cast<uint32_t>(dist(engine));
+			}
+		}
+	}
+};
+
+template<class SetT, SetType Type>
+std::unique_ptr<SetT> makeMatrixSet(double loadFactor, uint64_t reserveCount) {
+	auto set = std::make_unique<SetT>();
+	if constexpr (Type == SetType::Std) {
+		set->max_load_factor(static_cast<float>(loadFactor));
+	} else {
+		set->setMaxLoadFactor(static_cast<float>(loadFactor));
 	}
+	if (reserveCount != 0)
+		set->reserve(reserveCount);
+	return set;
+}
 
-	sw.stop(count);
+template<class SetT, SetType Type>
+size_t elementCount(const SetT& set) {
+	if constexpr (Type == SetType::Std) {
+		return set.size();
+	} else {
+		return set.count();
+	}
 }
 
 template<class SetT, SetType Type>
-void benchContainsInserted(uint32_t count) {
-	std::cout << "--- Contains Inserted" << std::endl;
-	
-	SetT set;
-	for (uint32_t i = 0; i < count; ++i) {
-		set.insert(i);
+double fillOf(const SetT& set) {
+	if constexpr (Type == SetType::Std) {
+		return set.load_factor();
+	} else {
+		return static_cast<double>(set.count()) / set.capacity();
 	}
-	
-	std::default_random_engine el(count);
-	std::uniform_int_distribution<> dist(0, count - 1);
+}
 
-	Stopwatch sw{};
+// Bytes of the container per stored element. The hs sets report their arrays, std::unordered_set
+// is estimated as its bucket array plus one node per element holding the next pointer, the key
+// and the cached hash, rounded up to 16 byte malloc chunks.
+template<class SetT, SetType Type>
+double bytesPerElement(const SetT& set) {
+	const size_t count = elementCount<SetT, Type>(set);
+	if (count == 0)
+		return -1;
+	if constexpr (Type == SetType::Std) {
+		const size_t node = (sizeof(void*) + sizeof(typename SetT::value_type) + sizeof(size_t) + 15) / 16 * 16;
+		return static_cast<double>(set.bucket_count() * sizeof(void*) + count * node) / count;
+	} else {
+		return static_cast<double>(set.sizeInBytes()) / count;
+	}
+}
 
-	for (uint32_t i = 0; i < count; ++i) {
-		if constexpr (Type == SetType::Std) {
-			if (set.find(dist(el)) == set.end())
-				std::cout << "Fail" << std::endl;
-		} else {
-			if (!set.contains(dist(el)))
-				std::cout << "Fail" << std::endl;
+// Runs insert, hit, miss, churn and iteration of one case on one container.
+// Iteration times full passes and reports ns per visited element.
+template<class SetT, SetType Type>
+void benchMatrix(Reporter& reporter, const char* container, const MatrixCase& c, const MatrixKeys& keys) {
+	auto makeCaseResult = [&](const char* workload) {
+		Result result = makeResult("matrix", container, workload, c.slots);
+		result.distribution = distributionName(c.distribution);
+		result.elements = c.elements;
+		result.loadFactor = c.loadFactor;
+		return result;
+	};
+	auto grow = [&]() {
+		auto set = makeMatrixSet<SetT, Type>(c.loadFactor, 0);
+		for (const auto index : keys.inserts) {
+			set->insert(keys.present[index]);
+		}
+		return set;
+	};
+	const char* workloads[] = { "insert", "hit", "miss", "churn", "iteration" };
+	if (std::none_of(std::begin(workloads), std::end(workloads), [&](const char* w) { return reporter.enabled(makeCaseResult(w).name()); }))
+		return;
+
+	auto prefill = [&]() {
+		auto set = makeMatrixSet<SetT, Type>(c.loadFactor, c.elements);
+		for (const auto key : keys.present) {
+			set->insert(key);
 		}
+		return set;
+	};
+	const auto prefilled = prefill();
+	const double fill = fillOf<SetT, Type>(*prefilled);
+	const double prefilledBytes = bytesPerElement<SetT, Type>(*prefilled);
+	const auto& options = reporter.options();
+
+	Result insert = makeCaseResult("insert");
+	if (reporter.enabled(insert.name())) {
+		insert.fill = fill;
+		bench::measure(options, insert, c.elements,
+			[&]() { return makeMatrixSet<SetT, Type>(c.loadFactor, 0); },
+			[&](std::unique_ptr<SetT>& set, uint64_t i) -> uint64_t {
+				set->insert(keys.present[keys.inserts[i]]);
+				return 0;
+			});
+		// Inserts start from an empty set, so they end up in the capacity the set grew to
+		insert.bytesPerElement = bytesPerElement<SetT, Type>(*grow());
+		reporter.add(std::move(insert));
+	}
+
+	Result hit = makeCaseResult("hit");
+	if (reporter.enabled(hit.name())) {
+		hit.fill = fill;
+		hit.bytesPerElement = prefilledBytes;
+		bench::measure(options, hit, keys.lookups.size(),
+			[&]() { return prefilled.get(); },
+			[&](const SetT* set, uint64_t i) -> uint64_t {
+				return setContains<Type>(*set, keys.present[keys.lookups[i]]);
+			});
+		if (hit.checksum != hit.ops)
+			fprintf(stderr, "Fail: %s found %llu of %llu\n", hit.name().c_str(),
+				static_cast<unsigned long long>(hit.checksum), static_cast<unsigned long long>(hit.ops));
+		reporter.add(std::move(hit));
+	}
+
+	Result miss = makeCaseResult("miss");
+	if (reporter.enabled(miss.name())) {
+		miss.fill = fill;
+		miss.bytesPerElement = prefilledBytes;
+		bench::measure(options, miss, keys.lookups.size(),
+			[&]() { return prefilled.get(); },
+			[&](const SetT* set, uint64_t i) -> uint64_t {
+				return setContains<Type>(*set, keys.absent[keys.lookups[i]]);
+			});
+		if (miss.checksum != 0)
+			fprintf(stderr, "Fail: %s found absent keys\n", miss.name().c_str());
+		reporter.add(std::move(miss));
 	}
 
-	sw.stop(count);
+	// Each op replaces a present key by an absent one, the element count stays the same
+	// while tombstones accumulate
+	Result churn = makeCaseResult("churn");
+	if (reporter.enabled(churn.name())) {
+		struct ChurnState {
+			std::unique_ptr<SetT> set;
+			std::vector<uint32_t> present;
+			std::vector<uint32_t> absent;
+		};
+		churn.fill = fill;
+		churn.bytesPerElement = prefilledBytes;
+		bench::measure(options, churn, c.elements,
+			[&]() { return ChurnState{ prefill(), keys.present, keys.absent }; },
+			[&](ChurnState& state, uint64_t i) -> uint64_t {
+				const uint32_t index = keys.lookups[i];
+				setRemove<Type>(*state.set, state.present[index]);
+				state.set->insert(state.absent[index]);
+				std::swap(state.present[index], state.absent[index]);
+				return 0;
+			});
+		reporter.add(std::move(churn));
+	}
+
+	Result iteration = makeCaseResult("iteration");
+	if (reporter.enabled(iteration.name())) {
+		iteration.fill = fill;
+		iteration.bytesPerElement = prefilledBytes;
+		const uint64_t passes = std::max<uint64_t>(1, (1u << 20) / std::max<uint64_t>(1, c.elements));
+		bench::measure(options, iteration, passes,
+			[&]() { return prefilled.get(); },
+			[&](const SetT* set, uint64_t) -> uint64_t {
+				uint64_t sum = 0;
+				for (const uint32_t key : *set) {
+					sum += key;
+				}
+				return sum;
+			});
+		scalePerItem(iteration, static_cast<double>(elementCount<SetT, Type>(*prefilled)));
+		reporter.add(std::move(iteration));
+	}
+}
+
+// LPHashSet<Auto> with capacities in StepPercent steps instead of powers of two
+template<class TKey, unsigned StepPercent = 125>
+using FastRangeSet = hs::LPHashSet<TKey, hs::LPHashSetPolicy::Auto, hs::Hasher<TKey>, std::equal_to<>, hs::AlignedAllocator, false, hs::NoStats, hs::FastRangeGrowth<StepPercent>>;
 
-	#if defined(TESTING)
-		if constexpr (Type != SetType::Std)
-			std::cout << "Elements per query: " << 1.0f * set.ElementsTested / set.QueryCount << std::endl;
+// Every LPHashSet policy the CPU can run and std::unordered_set over sizes x load factors x distributions
+void runMatrix(Reporter& reporter) {
+	using std::unordered_set;
+
+	std::vector<uint64_t> slotCounts = { 1u << 10 };
+	#if defined (NDEBUG)
+		if (!reporter.options().quick)
+			slotCounts = { 1u << 10, 1u << 14, 1u << 17, 1u << 20, 1u << 23 };
+		else
+			slotCounts = { 1u << 10, 1u << 16 };
 	#endif
+	// The hs sets clamp the max load factor to 0.85
+	const double loadFactors[] = { 0.5, 0.7, 0.85 };
+	const Distribution distributions[] = { Distribution::Sequential, Distribution::Uniform, Distribution::Zipfian };
+
+	constexpr uint64_t MIN_LOOKUPS = 1u << 18;
+
+	for (const auto slots : slotCounts) {
+		for (const auto loadFactor : loadFactors) {
+			for (const auto distribution : distributions) {
+				MatrixCase c;
+				c.distribution = distribution;
+				c.slots = slots;
+				c.loadFactor = loadFactor;
+				c.elements = static_cast<uint64_t>(loadFactor * slots);
+				const MatrixKeys keys(c, std::max(c.elements, MIN_LOOKUPS));
+
+				using namespace hs;
+				benchMatrix<unordered_set<uint32_t, DefaultHash>, SetType::Std>(reporter, Reporter::STD_CONTAINER, c, keys);
+				benchMatrix<LPHashSet<uint32_t, LPHashSetPolicy::Simple>, SetType::Hs>(reporter, "LPHashSet<Simple>", c, keys);
+				benchMatrix<LPHashSet<uint32_t, LPHashSetPolicy::SSE>, SetType::Hs>(reporter, "LPHashSet<SSE>", c, keys);
+				if (g_SimdLevel >= SimdLevel::AVX2)
+					benchMatrix<LPHashSet<uint32_t, LPHashSetPolicy::AVX>, SetType::Hs>(reporter, "LPHashSet<AVX>", c, keys);
+				if (g_SimdLevel >= SimdLevel::AVX512)
+					benchMatrix<LPHashSet<uint32_t, LPHashSetPolicy::AVX512>, SetType::Hs>(reporter, "LPHashSet<AVX512>", c, keys);
+				benchMatrix<LPHashSet<uint32_t, LPHashSetPolicy::Auto>, SetType::Hs>(reporter, "LPHashSet<Auto>", c, keys);
+				benchMatrix<LPHashSet<uint32_t, LPHashSetPolicy::Grouped>, SetType::Hs>(reporter, "LPHashSet<Grouped>", c, keys);
+				benchMatrix<FastRangeSet<uint32_t>, SetType::Hs>(reporter, "LPHashSet<Auto, fast range>", c, keys);
+			}
+		}
+	}
 }
 
+//-----------------------------------------------------------------------------
+// Feature specific benchmarks
+//-----------------------------------------------------------------------------
+// Insert, reserved insert, hits, misses and a random mix for containers outside the matrix
 template<class SetT, SetType Type>
-void benchContainsNotInserted(uint32_t count) {
-	std::cout << "--- Contains Not Inserted" << std::endl;
+void benchBasic(Reporter& reporter, const std::string& container, uint32_t count) {
+	const auto& options = reporter.options();
+
+	Result insert = makeResult("extra", container, "insert", count);
+	if (reporter.enabled(insert.name())) {
+		bench::measure(options, insert, count,
+			[]() { return std::make_unique<SetT>(); },
+			[](std::unique_ptr<SetT>& set, uint64_t i) -> uint64_t {
+				set->insert(static_cast<uint32_t>(i));
+				return 0;
+			});
+		reporter.add(std::move(insert));
+	}
+
+	if constexpr (HasReserve<SetT>::value) {
+		Result reserved = makeResult("extra", container, "insert-reserved", count);
+		if (reporter.enabled(reserved.name())) {
+			bench::measure(options, reserved, count,
+				[count]() {
+					auto set = std::make_unique<SetT>();
+					set->reserve(count);
+					return set;
+				},
+				[](std::unique_ptr<SetT>& set, uint64_t i) -> uint64_t {
+					set->insert(static_cast<uint32_t>(i));
+					return 0;
+				});
+			reporter.add(std::move(reserved));
+		}
+	}
+
+	// Keys are generated up front so only the lookups are timed
+	std::default_random_engine el(count);
+	std::uniform_int_distribution<uint32_t> dist(0, count - 1);
+	std::vector<uint32_t> keys(count);
+	for (auto& key : keys) {
+		key = dist(el);
+	}
 
+	Result hit = makeResult("extra", container, "hit", count);
+	Result miss = makeResult("extra", container, "miss", count);
+	if (reporter.enabled(hit.name()) || reporter.enabled(miss.name())) {
+		SetT set;
+		for (uint32_t i = 0; i < count; ++i) {
+			set.insert(i);
+		}
+
+		if (reporter.enabled(hit.name())) {
+			bench::measure(options, hit, count,
+				[&]() { return &set; },
+				[&](const SetT* s, uint64_t i) -> uint64_t { return setContains<Type>(*s, keys[i]); });
+			if (hit.checksum != count)
+				fprintf(stderr, "Fail: %s\n", hit.name().c_str());
+			reporter.add(std::move(hit));
+		}
+		if (reporter.enabled(miss.name())) {
+			bench::measure(options, miss, count,
+				[&]() { return &set; },
+				[&](const SetT* s, uint64_t i) -> uint64_t { return setContains<Type>(*s, count + keys[i]); });
+			if (miss.checksum != 0)
+				fprintf(stderr, "Fail: %s\n", miss.name().c_str());
+			reporter.add(std::move(miss));
+		}
+	}
+
+	// A quarter each of inserts, removes, insert + remove pairs and lookups
+	Result random = makeResult("extra", container, "random-usage", count);
+	if (reporter.enabled(random.name())) {
+		std::vector<uint32_t> lookupKeys(count);
+		for (auto& key : lookupKeys) {
+			key = dist(el);
+		}
+		bench::measure(options, random, count,
+			[]() { return std::make_unique<SetT>(); },
+			[&](std::unique_ptr<SetT>& set, uint64_t i) -> uint64_t {
+				const uint32_t num = keys[i];
+				const uint32_t op = num % 4;
+				if (op == 0) {
+					set->insert(num);
+				} else if (op == 1) {
+					setRemove<Type>(*set, num);
+				} else if (op == 2) {
+					set->insert(num);
+					setRemove<Type>(*set, num);
+				} else {
+					return setContains<Type>(*set, lookupKeys[i]);
+				}
+				return 0;
+			});
+		reporter.add(std::move(random));
+	}
+}
+
+// Sums all elements with a range-for, and with forEach for hs sets. A sparse pass removes
+// 90% of the elements first so the scan has to skip mostly empty slots. Reported per element.
+template<class SetT, SetType Type>
+void benchIterate(Reporter& reporter, const std::string& container, uint32_t count) {
 	SetT set;
 	for (uint32_t i = 0; i < count; ++i) {
 		set.insert(i);
 	}
 
-	std::default_random_engine el(count);
-	std::uniform_int_distribution<uint32_t> dist(count, 2 * count - 1);
+	const uint64_t passes = std::max<uint64_t>(1, (1u << 20) / count);
+	auto iterate = [&](const char* density) {
+		Result loop = makeResult("extra", container, std::string("iterate-") + density, count);
+		if (reporter.enabled(loop.name())) {
+			bench::measure(reporter.options(), loop, passes,
+				[&]() { return &set; },
+				[](const SetT* s, uint64_t) -> uint64_t {
+					uint64_t sum = 0;
+					for (const uint32_t key : *s) {
+						sum += key;
+					}
+					return sum;
+				});
+			scalePerItem(loop, static_cast<double>(elementCount<SetT, Type>(set)));
+			reporter.add(std::move(loop));
+		}
 
-	Stopwatch sw{};
+		if constexpr (Type != SetType::Std) {
+			Result forEach = makeResult("extra", container, std::string("forEach-") + density, count);
+			if (reporter.enabled(forEach.name())) {
+				bench::measure(reporter.options(), forEach, passes,
+					[&]() { return &set; },
+					[](const SetT* s, uint64_t) -> uint64_t {
+						uint64_t sum = 0;
+						s->forEach([&](uint32_t key) { sum += key; });
+						return sum;
+					});
+				scalePerItem(forEach, static_cast<double>(elementCount<SetT, Type>(set)));
+				reporter.add(std::move(forEach));
+			}
+		}
+	};
 
+	iterate("dense");
 	for (uint32_t i = 0; i < count; ++i) {
+		if (i % 10 != 0)
+			setRemove<Type>(set, i);
+	}
+	iterate("sparse");
+}
+
+// Keys are views into one buffer, like tokens of a parsed request. Longer than the
+// small string buffer so the stored std::string keys live on the heap.
+struct StringKeys {
+	std::string buffer_;
+	std::vector<std::string_view> keys_;
+
+	StringKeys(uint32_t count, uint32_t offset) {
+		std::vector<size_t> offsets;
+		for (uint32_t i = 0; i < count; ++i) {
+			offsets.push_back(buffer_.size());
+			buffer_ += "session/0000000000/" + std::to_string(offset + i);
+		}
+		offsets.push_back(buffer_.size());
+		for (uint32_t i = 0; i < count; ++i) {
+			keys_.emplace_back(buffer_.data() + offsets[i], offsets[i + 1] - offsets[i]);
+		}
+	}
+};
+
+template<class SetT, SetType Type>
+void benchStringKeys(Reporter& reporter, const std::string& container, uint32_t count) {
+	const StringKeys inserted(count, 0);
+	const StringKeys notInserted(count, count);
+	const auto& options = reporter.options();
+
+	Result insert = makeResult("extra", container, "string-insert", count);
+	if (reporter.enabled(insert.name())) {
+		bench::measure(options, insert, count,
+			[]() { return std::make_unique<SetT>(); },
+			[&](std::unique_ptr<SetT>& set, uint64_t i) -> uint64_t {
+				set->insert(std::string(inserted.keys_[i]));
+				return 0;
+			});
+		reporter.add(std::move(insert));
+	}
+
+	SetT set;
+	for (const auto key : inserted.keys_) {
+		set.insert(std::string(key));
+	}
+
+	// hs sets look the views up directly, std::unordered_set needs a temporary std::string (C++17)
+	auto lookup = [&](std::string_view key) {
 		if constexpr (Type == SetType::Std) {
-			if (set.find(dist(el)) != set.end())
-				std::cout << "Fail" << std::endl;
+			return set.find(std::string(key)) != set.end();
 		} else {
-			if (set.contains(dist(el)))
-				std::cout << "Fail" << std::endl;
+			return set.contains(key);
 		}
+	};
+
+	std::default_random_engine el(count);
+	std::uniform_int_distribution<uint32_t> dist(0, count - 1);
+	std::vector<uint32_t> indices(count);
+	for (auto& index : indices) {
+		index = dist(el);
 	}
 
-	sw.stop(count);
+	Result hit = makeResult("extra", container, "string-hit", count);
+	if (reporter.enabled(hit.name())) {
+		bench::measure(options, hit, count,
+			[]() { return 0; },
+			[&](int, uint64_t i) -> uint64_t { return lookup(inserted.keys_[indices[i]]); });
+		if (hit.checksum != count)
+			fprintf(stderr, "Fail: %s\n", hit.name().c_str());
+		reporter.add(std::move(hit));
+	}
+
+	Result miss = makeResult("extra", container, "string-miss", count);
+	if (reporter.enabled(miss.name())) {
+		bench::measure(options, miss, count,
+			[]() { return 0; },
+			[&](int, uint64_t i) -> uint64_t { return lookup(notInserted.keys_[indices[i]]); });
+		if (miss.checksum != 0)
+			fprintf(stderr, "Fail: %s\n", miss.name().c_str());
+		reporter.add(std::move(miss));
+	}
 }
 
-template<class SetT, SetType Type>
-void benchRandomUsage(uint32_t count) {
-	std::cout << "--- Random Usage" << std::endl;
+// Heavy keys: inserting strings by copy, by move and with tryEmplace on a stream where every key
+// comes twice, so half of the inserts find the key present.
+template<class SetT>
+void benchHeavyInsert(Reporter& reporter, const std::string& container, uint32_t count) {
+	const StringKeys keys(count, 0);
+	std::vector<std::string> strings(keys.keys_.begin(), keys.keys_.end());
+	const auto& options = reporter.options();
+
+	Result copy = makeResult("extra", container, "string-insert-copy", count);
+	if (reporter.enabled(copy.name())) {
+		bench::measure(options, copy, count,
+			[]() { return std::make_unique<SetT>(); },
+			[&](std::unique_ptr<SetT>& set, uint64_t i) -> uint64_t {
+				set->insert(strings[i]);
+				return 0;
+			});
+		reporter.add(std::move(copy));
+	}
+
+	struct MoveState {
+		std::unique_ptr<SetT> set_;
+		std::vector<std::string> strings_;
+	};
+	Result move = makeResult("extra", container, "string-insert-move", count);
+	if (reporter.enabled(move.name())) {
+		bench::measure(options, move, count,
+			[&]() { return MoveState{ std::make_unique<SetT>(), strings }; },
+			[&](MoveState& state, uint64_t i) -> uint64_t {
+				state.set_->insert(std::move(state.strings_[i]));
+				return 0;
+			});
+		reporter.add(std::move(move));
+	}
+
+	Result temporary = makeResult("extra", container, "string-insert-dup-temporary", count);
+	if (reporter.enabled(temporary.name())) {
+		bench::measure(options, temporary, 2 * static_cast<uint64_t>(count),
+			[]() { return std::make_unique<SetT>(); },
+			[&](std::unique_ptr<SetT>& set, uint64_t i) -> uint64_t {
+				set->insert(std::string(keys.keys_[i >> 1]));
+				return 0;
+			});
+		reporter.add(std::move(temporary));
+	}
+
+	Result emplace = makeResult("extra", container, "string-insert-dup-try-emplace", count);
+	if (reporter.enabled(emplace.name())) {
+		bench::measure(options, emplace, 2 * static_cast<uint64_t>(count),
+			[]() { return std::make_unique<SetT>(); },
+			[&](std::unique_ptr<SetT>& set, uint64_t i) -> uint64_t {
+				return set->tryEmplace(keys.keys_[i >> 1]);
+			});
+		if (emplace.checksum != count)
+			fprintf(stderr, "Fail: %s\n", emplace.name().c_str());
+		reporter.add(std::move(emplace));
+	}
+}
+
+// Key owning a heap block through a plain pointer, like a small vector which spilled to the heap.
+// The Relocatable variant lets rehashes memcpy it instead of move constructing and destroying.
+template<bool Relocatable>
+struct BoxedKey {
+	static constexpr size_t SIZE = 4;
+	uint64_t* values_;
+
+	explicit BoxedKey(uint64_t value)
+		: values_(new uint64_t[SIZE]{ value, value + 1, value + 2, value + 3 })
+	{}
+	BoxedKey(BoxedKey&& other) noexcept
+		: values_(other.values_)
+	{
+		other.values_ = nullptr;
+	}
+	BoxedKey& operator=(BoxedKey&& other) noexcept {
+		std::swap(values_, other.values_);
+		return *this;
+	}
+	~BoxedKey() {
+		delete[] values_;
+	}
+	bool operator==(const BoxedKey& other) const {
+		return values_[0] == other.values_[0];
+	}
+};
+
+struct BoxedKeyHasher {
+	template<bool Relocatable>
+	hs::Hash_t operator()(const BoxedKey<Relocatable>& key) const {
+		return hs::Hasher<uint64_t>()(key.values_[0]);
+	}
+};
+
+namespace hs {
+template<>
+struct IsTriviallyRelocatable<BoxedKey<true>> : std::true_type {};
+}
+
+// Growing from an empty set, every rehash relocates all elements
+template<bool Relocatable>
+void benchRelocation(Reporter& reporter, uint32_t count) {
+	using SetT = hs::LPHashSet<BoxedKey<Relocatable>, hs::LPHashSetPolicy::Auto, BoxedKeyHasher>;
+	Result result = makeResult("extra", Relocatable ? "LPHashSet<Auto, boxed, relocatable>" : "LPHashSet<Auto, boxed>", "grow", count);
+	if (!reporter.enabled(result.name()))
+		return;
+
+	bench::measure(reporter.options(), result, count,
+		[]() { return std::make_unique<SetT>(); },
+		[&](std::unique_ptr<SetT>& set, uint64_t i) -> uint64_t {
+			return set->emplace(mixKey(static_cast<uint32_t>(i)));
+		});
+	reporter.add(std::move(result));
+}
+
+// Single lookups against containsBatch over the same keys, half of them miss.
+// A batch op is one key so the two are directly comparable.
+template<class SetT>
+void benchContainsBatch(Reporter& reporter, const std::string& container, uint32_t count) {
+	SetT set;
+	for (uint32_t i = 0; i < count; ++i) {
+		set.insert(i);
+	}
 
 	std::default_random_engine el(count);
-	std::uniform_int_distribution<uint32_t> dist(0, count - 1);
+	std::uniform_int_distribution<uint32_t> dist(0, 2 * count - 1);
+	std::vector<uint32_t> keys(count);
+	for (auto& key : keys) {
+		key = dist(el);
+	}
+
+	Result single = makeResult("extra", container, "contains-single", count);
+	if (reporter.enabled(single.name())) {
+		bench::measure(reporter.options(), single, count,
+			[]() { return 0; },
+			[&](int, uint64_t i) -> uint64_t { return set.contains(keys[i]); });
+		reporter.add(std::move(single));
+	}
+
+	Result batch = makeResult("extra", container, "contains-batch", count);
+	if (reporter.enabled(batch.name())) {
+		constexpr uint32_t batchSize = 4096;
+		const uint32_t batchCount = (count + batchSize - 1) / batchSize;
+		std::vector<uint64_t> resultBits(batchSize / 64);
+		bench::measure(reporter.options(), batch, batchCount,
+			[]() { return 0; },
+			[&](int, uint64_t b) -> uint64_t {
+				const uint32_t begin = static_cast<uint32_t>(b) * batchSize;
+				const uint32_t size = std::min(batchSize, count - begin);
+				set.containsBatch(keys.data() + begin, size, resultBits.data());
+				uint64_t found = 0;
+				for (uint32_t i = 0; i < size; ++i) {
+					found += (resultBits[i >> 6] >> (i & 63)) & 1;
+				}
+				return found;
+			});
+		scalePerItem(batch, batchSize);
+		reporter.add(std::move(batch));
+	}
+}
+
+// Single set behind one mutex, the baseline for the sharded set
+template<class SetT>
+class MutexWrappedSet {
+public:
+	void insert(uint32_t key) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		set_.insert(key);
+	}
+
+	bool contains(uint32_t key) const {
+		std::lock_guard<std::mutex> lock(mutex_);
+		return set_.contains(key);
+	}
+
+private:
+	mutable std::mutex mutex_;
+	SetT set_;
+};
+
+template<class SetT>
+void benchConcurrent(Reporter& reporter, const std::string& container, uint32_t count, uint32_t threadCount) {
+	Result result = makeResult("extra", container, "insert-contains-t" + std::to_string(threadCount), count);
+	if (!reporter.enabled(result.name()))
+		return;
+
+	SetT set;
+	std::vector<std::thread> threads;
+	std::vector<uint64_t> found(threadCount);
+
+	bench::Stopwatch sw;
 
-	uint64_t found = 0;
+	for (uint32_t t = 0; t < threadCount; ++t) {
+		threads.emplace_back([&set, &found, count, threadCount, t]() {
+			for (uint32_t i = t; i < count; i += threadCount) {
+				set.insert(i);
+			}
+
+			std::default_random_engine el(t);
+			std::uniform_int_distribution<uint32_t> dist(0, 2 * count - 1);
+			uint64_t threadFound = 0;
+			for (uint32_t i = t; i < count; i += threadCount) {
+				if (set.contains(dist(el)))
+					++threadFound;
+			}
+			found[t] = threadFound;
+		});
+	}
+	for (auto& thread : threads) {
+		thread.join();
+	}
+
+	const uint64_t ns = sw.elapsedNs();
+	for (const auto threadFound : found) {
+		result.checksum += threadFound;
+	}
+	reporter.addTiming(std::move(result), 2ull * count, ns);
+}
 
-	Stopwatch sw{};
+// Reader threads query a prefilled set while one writer inserts a key per 1000 reads.
+// Every reader does the full count so flat scaling means a flat ns/op.
+template<class SetT>
+void benchConcurrentReadMostly(Reporter& reporter, const std::string& container, uint32_t count, uint32_t readerCount) {
+	Result result = makeResult("extra", container, "read-mostly-t" + std::to_string(readerCount), count);
+	if (!reporter.enabled(result.name()))
+		return;
 
 	SetT set;
 	for (uint32_t i = 0; i < count; ++i) {
-		auto num = dist(el);
-		auto op = num % 4;
-		if (op == 0) {
-			set.insert(num);
-		} else if (op == 1) {
-			if constexpr (Type == SetType::Std) {
-				set.erase(num);
-			} else {
-				set.remove(num);
+		set.insert(i);
+	}
+
+	std::atomic<bool> readersDone{ false };
+	std::thread writer([&set, &readersDone, count]() {
+		for (uint32_t i = count; i < count + count / 1000 && !readersDone.load(std::memory_order_relaxed); ++i) {
+			set.insert(i);
+			std::this_thread::yield();
+		}
+	});
+
+	std::vector<std::thread> readers;
+	std::vector<uint64_t> found(readerCount);
+
+	bench::Stopwatch sw;
+
+	for (uint32_t t = 0; t < readerCount; ++t) {
+		readers.emplace_back([&set, &found, count, t]() {
+			std::default_random_engine el(t);
+			std::uniform_int_distribution<uint32_t> dist(0, 2 * count - 1);
+			uint64_t threadFound = 0;
+			for (uint32_t i = 0; i < count; ++i) {
+				if (set.contains(dist(el)))
+					++threadFound;
 			}
-		} else if (op == 2) {
-			set.insert(num);
-			if constexpr (Type == SetType::Std) {
-				set.erase(num);
-			} else {
-				set.remove(num);
+			found[t] = threadFound;
+		});
+	}
+	for (auto& reader : readers) {
+		reader.join();
+	}
+
+	const uint64_t ns = sw.elapsedNs();
+	readersDone = true;
+	writer.join();
+
+	for (const auto threadFound : found) {
+		result.checksum += threadFound;
+	}
+	reporter.addTiming(std::move(result), count, ns);
+}
+
+// Many short-lived small sets, e.g. one per request. One op is a whole set, reported per element.
+template<class MakeSetT>
+void benchShortLivedSets(Reporter& reporter, const std::string& container, uint32_t setCount, uint32_t elementsPerSet, MakeSetT&& makeSet) {
+	Result result = makeResult("extra", container, "short-lived-sets", elementsPerSet);
+	if (!reporter.enabled(result.name()))
+		return;
+
+	bench::measure(reporter.options(), result, setCount,
+		[]() { return 0; },
+		[&](int, uint64_t s) -> uint64_t {
+			auto set = makeSet();
+			for (uint32_t i = 0; i < elementsPerSet; ++i) {
+				set->insert(static_cast<uint32_t>(s) + i);
 			}
-		} else {
+			return set->contains(static_cast<uint32_t>(s)) ? 1 : 0;
+		});
+	scalePerItem(result, elementsPerSet);
+	reporter.add(std::move(result));
+}
+
+// Builds a set from shuffled keys, threadCount 0 inserts them one by one. Reported per element.
+template<class SetT>
+void benchBuild(Reporter& reporter, const std::string& container, uint32_t count, size_t threadCount) {
+	const std::string workload = threadCount == 0 ? "build-insert-loop" : "build-range-t" + std::to_string(threadCount);
+	Result result = makeResult("extra", container, workload, count);
+	if (!reporter.enabled(result.name()))
+		return;
+
+	std::vector<uint32_t> keys(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		keys[i] = i;
+	}
+	std::shuffle(keys.begin(), keys.end(), std::default_random_engine(count));
+
+	bench::measure(reporter.options(), result, 1,
+		[]() { return 0; },
+		[&](int, uint64_t) -> uint64_t {
+			if (threadCount == 0) {
+				SetT set;
+				for (const auto key : keys) {
+					set.insert(key);
+				}
+				return set.count();
+			}
+			SetT set(keys.begin(), keys.end(), threadCount);
+			return set.count();
+		});
+	if (result.checksum != count)
+		fprintf(stderr, "Fail: %s\n", result.name().c_str());
+	scalePerItem(result, count);
+	reporter.add(std::move(result));
+}
+
+// Grows a set of count keys once to twice its capacity with threadCount rehash threads.
+// The set is built untimed for every repetition. Reported per element.
+template<class SetT>
+void benchRehash(Reporter& reporter, const std::string& container, uint32_t count, size_t threadCount) {
+	Result result = makeResult("extra", container, "rehash-t" + std::to_string(threadCount), count);
+	if (!reporter.enabled(result.name()))
+		return;
+
+	bench::measure(reporter.options(), result, 1,
+		[&]() {
+			auto set = std::make_unique<SetT>();
+			for (uint32_t i = 0; i < count; ++i) {
+				set->insert(mixKey(i));
+			}
+			return set;
+		},
+		[&](std::unique_ptr<SetT>& set, uint64_t) -> uint64_t {
+			set->reserve(static_cast<size_t>(set->capacity() * set->maxLoadFactor()) * 2, threadCount);
+			return set->count();
+		});
+	if (result.checksum != count)
+		fprintf(stderr, "Fail: %s\n", result.name().c_str());
+	scalePerItem(result, count);
+	reporter.add(std::move(result));
+}
+
+// std::unordered_map finds an iterator instead of a pointer to the value
+template<SetType Type, class MapT, class TKey>
+auto mapFind(const MapT& map, const TKey& key) {
+	if constexpr (Type == SetType::Std) {
+		const auto it = map.find(key);
+		return it == map.end() ? nullptr : &it->second;
+	} else {
+		return map.find(key);
+	}
+}
+
+// Builds a map of count random keys with operator[] assignments, then looks up present and absent keys
+template<class MapT, SetType Type>
+void benchMap(Reporter& reporter, const std::string& container, uint32_t count) {
+	const auto& options = reporter.options();
+
+	Result insert = makeResult("extra", container, "map-insert", count);
+	if (reporter.enabled(insert.name())) {
+		bench::measure(options, insert, count,
+			[]() { return std::make_unique<MapT>(); },
+			[](std::unique_ptr<MapT>& map, uint64_t i) -> uint64_t {
+				(*map)[mixKey(static_cast<uint32_t>(i))] = i;
+				return 0;
+			});
+		reporter.add(std::move(insert));
+	}
+
+	Result hit = makeResult("extra", container, "map-hit", count);
+	Result miss = makeResult("extra", container, "map-miss", count);
+	if (!reporter.enabled(hit.name()) && !reporter.enabled(miss.name()))
+		return;
+
+	MapT map;
+	for (uint32_t i = 0; i < count; ++i) {
+		map[mixKey(i)] = i;
+	}
+	std::default_random_engine el(count);
+	std::uniform_int_distribution<uint32_t> dist(0, count - 1);
+	std::vector<uint32_t> indices(count);
+	for (auto& index : indices) {
+		index = dist(el);
+	}
+
+	if (reporter.enabled(hit.name())) {
+		bench::measure(options, hit, count,
+			[&]() { return &map; },
+			[&](const MapT* m, uint64_t i) -> uint64_t { return *mapFind<Type>(*m, mixKey(indices[i])); });
+		reporter.add(std::move(hit));
+	}
+	if (reporter.enabled(miss.name())) {
+		bench::measure(options, miss, count,
+			[&]() { return &map; },
+			[&](const MapT* m, uint64_t i) -> uint64_t { return mapFind<Type>(*m, mixKey(count + indices[i])) != nullptr; });
+		if (miss.checksum != 0)
+			fprintf(stderr, "Fail: %s\n", miss.name().c_str());
+		reporter.add(std::move(miss));
+	}
+}
+
+// GROUP BY key with COUNT and SUM over rows whose keys fall into groups random groups. One op
+// aggregates a whole column of rows, reported per row. Batches go through countBatch() and
+// accumulateBatch() in chunks of 1024 rows, the single row version upserts once per row.
+template<class MapT, SetType Type>
+void benchAggregate(Reporter& reporter, const std::string& container, uint32_t rows, uint32_t groups, bool batch) {
+	Result result = makeResult("extra", container, (batch ? "groupby-batch-g" : "groupby-g") + std::to_string(groups), rows);
+	if (!reporter.enabled(result.name()))
+		return;
+
+	std::default_random_engine el(groups);
+	std::uniform_int_distribution<uint32_t> dist(0, groups - 1);
+	std::vector<uint32_t> keys(rows);
+	std::vector<uint64_t> amounts(rows);
+	for (uint32_t i = 0; i < rows; ++i) {
+		keys[i] = mixKey(dist(el));
+		amounts[i] = i & 0xFF;
+	}
+
+	constexpr size_t BATCH = 1024;
+	bench::measure(reporter.options(), result, 1,
+		[]() { return std::make_pair(std::make_unique<MapT>(), std::make_unique<MapT>()); },
+		[&](auto& maps, uint64_t) -> uint64_t {
+			MapT& counts = *maps.first;
+			MapT& sums = *maps.second;
 			if constexpr (Type == SetType::Std) {
-				if (set.find(dist(el)) != set.end()) {
-					++found;
+				for (uint32_t i = 0; i < rows; ++i) {
+					++counts[keys[i]];
+					sums[keys[i]] += amounts[i];
+				}
+			} else if (batch) {
+				for (size_t begin = 0; begin < rows; begin += BATCH) {
+					const size_t size = std::min<size_t>(BATCH, rows - begin);
+					counts.countBatch(&keys[begin], size);
+					sums.accumulateBatch(&keys[begin], &amounts[begin], size);
 				}
 			} else {
-				if (set.contains(dist(el))) {
-					++found;
+				for (uint32_t i = 0; i < rows; ++i) {
+					counts.accumulate(keys[i], 1u);
+					sums.accumulate(keys[i], amounts[i]);
 				}
 			}
+			return elementCount<MapT, Type>(counts) == elementCount<MapT, Type>(sums) ? 1 : 0;
+		});
+	if (result.checksum != 1)
+		fprintf(stderr, "Fail: %s\n", result.name().c_str());
+	scalePerItem(result, rows);
+	reporter.add(std::move(result));
+}
+
+// Intersects a set of count keys with one of count / skew keys, half of the smaller set is shared.
+// The hand written loop over the smaller set calling contains() is the baseline.
+// Reported per element of the smaller set, except unite and difference which walk both / the larger one.
+template<class SetT>
+void benchSetAlgebra(Reporter& reporter, const std::string& container, uint32_t count, uint32_t skew) {
+	const uint32_t smallCount = std::max<uint32_t>(count / skew, 1);
+	SetT large;
+	SetT small;
+	for (uint32_t i = 0; i < count; ++i) {
+		large.insert(i);
+	}
+	for (uint32_t i = 0; i < smallCount; ++i) {
+		small.insert(i % 2 == 0 ? i : count + i);
+	}
+
+	auto run = [&](const char* operation, double items, auto&& op) {
+		Result result = makeResult("extra", container, std::string(operation) + "-skew" + std::to_string(skew), count);
+		if (!reporter.enabled(result.name()))
+			return;
+		bench::measure(reporter.options(), result, 1,
+			[]() { return 0; },
+			[&](int, uint64_t) -> uint64_t { return op(); });
+		scalePerItem(result, items);
+		reporter.add(std::move(result));
+	};
+
+	run("contains-loop", smallCount, [&]() {
+		uint64_t found = 0;
+		for (const auto key : small) {
+			found += large.contains(key);
+		}
+		return found;
+	});
+	run("intersectionCount", smallCount, [&]() { return static_cast<uint64_t>(large.intersectionCount(small)); });
+	run("intersect", smallCount, [&]() { return static_cast<uint64_t>(large.intersect(small).count()); });
+	run("unite", count + smallCount, [&]() { return static_cast<uint64_t>(large.unite(small).count()); });
+	run("difference", count, [&]() { return static_cast<uint64_t>(large.difference(small).count()); });
+}
+
+// Compares rebuilding a set against loading a saved one, the first lookups of the mapped set
+// fault its pages in so they are timed once instead of repeated
+template<class SetT>
+void benchSaveLoad(Reporter& reporter, const std::string& container, uint32_t count) {
+	if (!reporter.enabled(makeResult("extra", container, "save-load", count).name()))
+		return;
+
+	const char* path = "hs_bench_set.bin";
+	{
+		bench::Stopwatch sw;
+		SetT set(count);
+		for (uint32_t i = 0; i < count; ++i) {
+			set.insert(i);
 		}
+		reporter.addTiming(makeResult("extra", container, "save-load-build", count), count, sw.elapsedNs());
+
+		bench::Stopwatch swSave;
+		set.save(path);
+		reporter.addTiming(makeResult("extra", container, "save-load-save", count), count, swSave.elapsedNs());
 	}
 
-	sw.stop(count);
+	bench::Stopwatch swLoad;
+	SetT set = SetT::load(path);
+	reporter.addTiming(makeResult("extra", container, "save-load-load", count), count, swLoad.elapsedNs());
 
-	std::cout << "Checksum found: " << found << std::endl;
+	std::default_random_engine el(count);
+	std::uniform_int_distribution<uint32_t> dist(0, 2 * count - 1);
+	constexpr uint32_t lookupCount = 100000;
+	Result lookups = makeResult("extra", container, "save-load-first-lookups", count);
+	bench::Stopwatch swLookup;
+	for (uint32_t i = 0; i < lookupCount; ++i) {
+		lookups.checksum += set.contains(dist(el));
+	}
+	reporter.addTiming(std::move(lookups), lookupCount, swLookup.elapsedNs());
+
+	std::remove(path);
 }
 
-std::vector<uint32_t> sizes = {
-	100,
-	#if defined (NDEBUG)
-		1000,
-		10000,
-		100000,
-		1000000,
-		10000000,
-		//100000000
-	#endif
-};
+// Builds a set by single inserts from empty and looks every key up. Both results carry the bytes
+// per element of the grown set, which shows the memory a growth policy leaves unused.
+template<class SetT>
+void benchGrowth(Reporter& reporter, const std::string& container, uint32_t count) {
+	std::vector<uint32_t> keys(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		keys[i] = mixKey(i);
+	}
+	SetT grown;
+	for (const auto key : keys) {
+		grown.insert(key);
+	}
+	const double bytes = bytesPerElement<SetT, SetType::Hs>(grown);
+	const auto& options = reporter.options();
 
-int main() {
-	
-	#if 0
-	hs::LPHashSet<uint32_t, hs::LPHashSetPolicy::SSE> set;
+	Result insert = makeResult("extra", container, "grow-insert", count);
+	if (reporter.enabled(insert.name())) {
+		insert.bytesPerElement = bytes;
+		insert.fill = static_cast<double>(grown.count()) / grown.capacity();
+		bench::measure(options, insert, count,
+			[]() { return std::make_unique<SetT>(); },
+			[&](std::unique_ptr<SetT>& set, uint64_t i) -> uint64_t {
+				set->insert(keys[i]);
+				return 0;
+			});
+		reporter.add(std::move(insert));
+	}
 
-	for (uint32_t i = 0; i < 1000000; ++i) {
-		set.insert(i);
+	Result hit = makeResult("extra", container, "grow-hit", count);
+	if (reporter.enabled(hit.name())) {
+		hit.bytesPerElement = bytes;
+		hit.fill = static_cast<double>(grown.count()) / grown.capacity();
+		bench::measure(options, hit, count,
+			[&]() { return &grown; },
+			[&](const SetT* set, uint64_t i) -> uint64_t { return set->contains(keys[i]); });
+		if (hit.checksum != count)
+			fprintf(stderr, "Fail: %s\n", hit.name().c_str());
+		reporter.add(std::move(hit));
 	}
+}
+
+// Times every insert on its own, rehash stalls show up in the tail percentiles
+template<class SetT>
+void benchInsertLatency(Reporter& reporter, const std::string& container, uint32_t count, bool incremental) {
+	Result result = makeResult("extra", container, incremental ? "insert-latency-incremental" : "insert-latency", count);
+	if (!reporter.enabled(result.name()))
+		return;
+
+	// Sampling could skip the few inserts which rehash
+	bench::Options options = reporter.options();
+	options.latencySamples = count;
+
+	bench::measure(options, result, count,
+		[incremental]() {
+			auto set = std::make_unique<SetT>();
+			set->setIncrementalRehash(incremental);
+			return set;
+		},
+		[](std::unique_ptr<SetT>& set, uint64_t i) -> uint64_t {
+			set->insert(static_cast<uint32_t>(i));
+			return 0;
+		});
+	reporter.add(std::move(result));
+}
+
+// Lookups of which hitPercent hit, like the probe side of a join or a dedup check. The plain set
+// pays a random table access per miss, the Bloom filtered one mostly a single filter cache line.
+// Batches of 1024 keys go through containsBatch, their numbers are per key.
+template<class SetT>
+void benchMostlyMisses(Reporter& reporter, const std::string& container, uint32_t count, uint32_t hitPercent, bool batch) {
+	Result result = makeResult("extra", container, (batch ? "lookup-batch-hit" : "lookup-hit") + std::to_string(hitPercent) + "%", count);
+	if (!reporter.enabled(result.name()))
+		return;
+
+	SetT set(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		set.insert(mixKey(i));
+	}
+
+	// Present keys are mixKey(0..count-1), absent ones mixKey(count..2 * count - 1)
+	constexpr size_t BATCH = 1024;
+	std::vector<uint32_t> keys(std::max<size_t>(count, 1u << 20));
+	std::default_random_engine el(count);
+	std::uniform_int_distribution<uint32_t> percent(0, 99);
+	std::uniform_int_distribution<uint32_t> index(0, count - 1);
+	for (auto& key : keys) {
+		key = percent(el) < hitPercent ? mixKey(index(el)) : mixKey(count + index(el));
+	}
+
+	if (batch) {
+		std::vector<uint64_t> bits(BATCH / 64);
+		bench::measure(reporter.options(), result, keys.size() / BATCH,
+			[&]() { return &set; },
+			[&](const SetT* s, uint64_t i) -> uint64_t {
+				s->containsBatch(&keys[i * BATCH], BATCH, bits.data());
+				uint64_t found = 0;
+				for (const uint64_t word : bits) {
+					found += std::bitset<64>(word).count();
+				}
+				return found;
+			});
+		scalePerItem(result, BATCH);
+	} else {
+		bench::measure(reporter.options(), result, keys.size(),
+			[&]() { return &set; },
+			[&](const SetT* s, uint64_t i) -> uint64_t {
+				return s->contains(keys[i]);
+			});
+	}
+	reporter.add(std::move(result));
+}
+
+// Sends runs of 8 consecutive keys to the same home slot, like a skewed hash or key set builds hot regions
+hs::Hash_t hotSpotHash(const uint32_t& key) {
+	const hs::Hash_t home = hs::mulFold(static_cast<uint64_t>(mixKey(key >> 3)) ^ 0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull);
+	return (home & ~static_cast<hs::Hash_t>(0xFF)) | (key & 0x7F);
+}
+
+uint32_t sequentialKey(uint32_t i) {
+	return i;
+}
+
+// Hits and misses of a table filled to exactly loadFactor with the keys keyAt(0..n-1), looked up in random order.
+// A ProbeStats twin built from the same keys reports the probe lengths and the longest cluster,
+// so the timed set runs without counters.
+template<hs::LPHashSetPolicy Policy, class THash>
+void benchProbing(Reporter& reporter, const std::string& container, const char* hashName, uint32_t (*keyAt)(uint32_t), uint64_t slots, double loadFactor) {
+	auto makeProbeResult = [&](const char* workload) {
+		Result result = makeResult("extra", container, workload, slots);
+		result.distribution = hashName;
+		result.loadFactor = loadFactor;
+		return result;
+	};
+	if (!reporter.enabled(makeProbeResult("probe-hit").name()) && !reporter.enabled(makeProbeResult("probe-miss").name()))
+		return;
 
-	std::default_random_engine el(42);
-	std::uniform_int_distribution<uint32_t> dist(0, 1000000 - 1);
+	using TimedSet = hs::LPHashSet<uint32_t, Policy, THash>;
+	using CountedSet = hs::LPHashSet<uint32_t, Policy, THash, std::equal_to<>, hs::AlignedAllocator, false, hs::ProbeStats>;
 
-	std::cout << "Starting contains" << std::endl;
+	const uint32_t count = static_cast<uint32_t>(loadFactor * slots);
+	auto fill = [&](auto& set) {
+		set.setMaxLoadFactor(static_cast<float>(loadFactor));
+		set.reserve(count);
+		for (uint32_t i = 0; i < count; ++i) {
+			set.insert(keyAt(i));
+		}
+	};
+	TimedSet timed;
+	fill(timed);
+	CountedSet counted;
+	fill(counted);
+
+	const uint64_t ops = std::max<uint64_t>(count, 1u << 18);
+	for (const bool hits : { true, false }) {
+		Result result = makeProbeResult(hits ? "probe-hit" : "probe-miss");
+		if (!reporter.enabled(result.name()))
+			continue;
+
+		// Misses look up keyAt(count..2 * count - 1), keyAt is a bijection so none of them is present
+		auto keyOf = [&](uint64_t i) {
+			const uint32_t index = mixKey(static_cast<uint32_t>(i)) % count;
+			return keyAt(hits ? index : count + index);
+		};
 
-	for (uint32_t i = 0; i < 10000000; ++i) {
-		for (uint32_t j = 0; j < 10000000; ++j) {
-			if (!set.contains(dist(el)))
-				std::cout << "Fail" << std::endl;
+		counted.resetStats();
+		for (uint64_t i = 0; i < count; ++i) {
+			counted.contains(keyOf(i));
 		}
+		const hs::HashSetStats stats = counted.stats();
+		result.elements = count;
+		result.fill = stats.loadFactor();
+		result.meanProbeLength = stats.meanProbeLength();
+		result.maxClusterLength = static_cast<double>(stats.maxClusterLength);
+
+		bench::measure(reporter.options(), result, ops,
+			[&]() { return &timed; },
+			[&](const TimedSet* set, uint64_t i) -> uint64_t {
+				return set->contains(keyOf(i));
+			});
+		if (result.checksum != (hits ? result.ops : 0))
+			fprintf(stderr, "Fail: %s found %llu of %llu\n", result.name().c_str(),
+				static_cast<unsigned long long>(result.checksum), static_cast<unsigned long long>(result.ops));
+		reporter.add(std::move(result));
 	}
+}
 
-	return 0;
+// Linear against grouped probing from a half full table up to the 0.85 load factor limit
+void runProbing(Reporter& reporter) {
+	using namespace hs;
+	using HotSpotHasher = FuncHasher<uint32_t, hotSpotHash>;
+
+	std::vector<uint64_t> slotCounts = { 1u << 12 };
+	#if defined (NDEBUG)
+		if (!reporter.options().quick)
+			slotCounts = { 1u << 16, 1u << 22 };
+		else
+			slotCounts = { 1u << 16 };
 	#endif
 
-	std::cout << "\nhs::LPHashset" << std::endl;
+	for (const auto slots : slotCounts) {
+		for (const double loadFactor : { 0.5, 0.625, 0.75, 0.85 }) {
+			benchProbing<LPHashSetPolicy::SSE, Hasher<uint32_t>>(reporter, "LPHashSet<SSE>", "uniform", mixKey, slots, loadFactor);
+			benchProbing<LPHashSetPolicy::Grouped, Hasher<uint32_t>>(reporter, "LPHashSet<Grouped>", "uniform", mixKey, slots, loadFactor);
+			benchProbing<LPHashSetPolicy::SSE, HotSpotHasher>(reporter, "LPHashSet<SSE>", "hotspot", sequentialKey, slots, loadFactor);
+			benchProbing<LPHashSetPolicy::Grouped, HotSpotHasher>(reporter, "LPHashSet<Grouped>", "hotspot", sequentialKey, slots, loadFactor);
+		}
+	}
+}
+
+void runExtras(Reporter& reporter) {
+	using namespace hs;
+	using AutoSet = LPHashSet<uint32_t, LPHashSetPolicy::Auto>;
+	using StdSet = std::unordered_set<uint32_t, DefaultHash>;
+
+	std::vector<uint32_t> sizes = { 100 };
+	#if defined (NDEBUG)
+		if (!reporter.options().quick)
+			sizes = { 1000, 100000, 1000000, 10000000 };
+		else
+			sizes = { 1000, 100000 };
+	#endif
+	const uint32_t large = sizes.back();
+
+	for (const auto size : sizes) {
+		benchBasic<AutoSet, SetType::Hs>(reporter, "LPHashSet<Auto>", size);
+		benchBasic<IntHashSet<uint32_t>, SetType::Hs>(reporter, "IntHashSet", size);
+		benchBasic<HashSet<uint32_t>, SetType::Hs>(reporter, "HashSet (Robin Hood)", size);
+	}
+
+	using StoredHashStringSet = LPHashSet<std::string, LPHashSetPolicy::Auto, Hasher<std::string>, std::equal_to<>, AlignedAllocator, true>;
+	for (const auto size : sizes) {
+		benchStringKeys<LPHashSet<std::string, LPHashSetPolicy::Auto>, SetType::Hs>(reporter, "LPHashSet<Auto, string>", size);
+		benchStringKeys<StoredHashStringSet, SetType::Hs>(reporter, "LPHashSet<Auto, string, stored hash>", size);
+		benchStringKeys<std::unordered_set<std::string>, SetType::Std>(reporter, "std::unordered_set<string, std::hash>", size);
+		benchStringKeys<std::unordered_set<std::string, Hasher<std::string>>, SetType::Std>(reporter, "std::unordered_set<string, hs::Hasher>", size);
+	}
+
+	for (const auto size : sizes) {
+		benchHeavyInsert<LPHashSet<std::string, LPHashSetPolicy::Auto>>(reporter, "LPHashSet<Auto, string>", size);
+		benchRelocation<false>(reporter, size);
+		benchRelocation<true>(reporter, size);
+	}
+
+	for (const auto size : sizes) {
+		benchIterate<AutoSet, SetType::Hs>(reporter, "LPHashSet<Auto>", size);
+		benchIterate<StdSet, SetType::Std>(reporter, Reporter::STD_CONTAINER, size);
+	}
+
 	for (const auto size : sizes) {
-		//benchInsertIntSet<hs::LPHashSet<uint32_t, hs::LPHashSetPolicy::Simple>>(size);
-		//benchContainsInserted<hs::LPHashSet<uint32_t, hs::LPHashSetPolicy::Simple>, SetType::Hs>(size);
-		//benchContainsNotInserted<hs::LPHashSet<uint32_t, hs::LPHashSetPolicy::Simple>, SetType::Hs>(size);
-		benchRandomUsage<hs::LPHashSet<uint32_t, hs::LPHashSetPolicy::Simple>, SetType::Hs>(size);
+		benchBuild<AutoSet>(reporter, "LPHashSet<Auto>", size, 0);
+		for (const size_t threadCount : { 1, 2, 4, 8 }) {
+			benchBuild<AutoSet>(reporter, "LPHashSet<Auto>", size, threadCount);
+		}
 	}
 
-	std::cout << "\nhs::LPHashset SSE" << std::endl;
 	for (const auto size : sizes) {
-		//benchInsertIntSet<hs::LPHashSet<uint32_t, hs::LPHashSetPolicy::Simple>>(size);
-		//benchContainsInserted<hs::LPHashSet<uint32_t, hs::LPHashSetPolicy::SSE>, SetType::Hs>(size);
-		//benchContainsNotInserted<hs::LPHashSet<uint32_t, hs::LPHashSetPolicy::SSE>, SetType::Hs>(size);
-		benchRandomUsage<hs::LPHashSet<uint32_t, hs::LPHashSetPolicy::SSE>, SetType::Hs>(size);
+		benchSetAlgebra<AutoSet>(reporter, "LPHashSet<Auto>", size, 1);
+		benchSetAlgebra<AutoSet>(reporter, "LPHashSet<Auto>", size, 100);
 	}
 
-	std::cout << "\nhs::LPHashset AVX" << std::endl;
+	benchSaveLoad<AutoSet>(reporter, "LPHashSet<Auto>", large);
+
 	for (const auto size : sizes) {
-		//benchInsertIntSet<hs::LPHashSet<uint32_t, hs::LPHashSetPolicy::Simple>>(size);
-		//benchContainsInserted<hs::LPHashSet<uint32_t, hs::LPHashSetPolicy::AVX>, SetType::Hs>(size);
-		//benchContainsNotInserted<hs::LPHashSet<uint32_t, hs::LPHashSetPolicy::SSE>, SetType::Hs>(size);
-		benchRandomUsage<hs::LPHashSet<uint32_t, hs::LPHashSetPolicy::SSE>, SetType::Hs>(size);
+		for (const uint32_t hitPercent : { 0u, 10u, 50u }) {
+			for (const bool batch : { false, true }) {
+				benchMostlyMisses<AutoSet>(reporter, "LPHashSet<Auto>", size, hitPercent, batch);
+				benchMostlyMisses<BloomFilteredLPHashSet<uint32_t>>(reporter, "BloomFilteredLPHashSet", size, hitPercent, batch);
+			}
+		}
+	}
+
+	// One past a power of two growth threshold, where doubling leaves the most memory unused
+	std::vector<uint32_t> growthSizes = sizes;
+	growthSizes.push_back(static_cast<uint32_t>(0.8 * (1u << 20)) + 1);
+	for (const auto size : growthSizes) {
+		benchGrowth<AutoSet>(reporter, "LPHashSet<Auto>", size);
+		benchGrowth<FastRangeSet<uint32_t, 125>>(reporter, "LPHashSet<Auto, fast range 1.25x>", size);
+		benchGrowth<FastRangeSet<uint32_t, 150>>(reporter, "LPHashSet<Auto, fast range 1.5x>", size);
+	}
+
+	benchInsertLatency<AutoSet>(reporter, "LPHashSet<Auto>", large, false);
+	benchInsertLatency<AutoSet>(reporter, "LPHashSet<Auto>", large, true);
+
+	#if defined (NDEBUG)
+		if (!reporter.options().quick) {
+			using HugePageSet = LPHashSet<uint32_t, LPHashSetPolicy::Auto, Hasher<uint32_t>, std::equal_to<>, HugePageAllocator>;
+			benchBasic<HugePageSet, SetType::Hs>(reporter, "LPHashSet<Auto, huge pages>", 10000000);
+		}
+	#endif
+
+	{
+		using ArenaSet = LPHashSet<uint32_t, LPHashSetPolicy::Auto, Hasher<uint32_t>, std::equal_to<>, ArenaAllocator>;
+
+		benchShortLivedSets(reporter, "LPHashSet<Auto, aligned heap>", 100000, 100, []() { return std::make_unique<AutoSet>(); });
+
+		MonotonicArena arena;
+		uint32_t setsInArena = 0;
+		benchShortLivedSets(reporter, "LPHashSet<Auto, arena>", 100000, 100, [&]() {
+			// Reset the arena every now and then like a per-request arena would be
+			if (++setsInArena == 1000) {
+				arena.release();
+				setsInArena = 0;
+			}
+			return std::make_unique<ArenaSet>(ArenaAllocator(arena));
+		});
+	}
+
+	#if defined (NDEBUG)
+		for (const auto size : { 1000000u, 10000000u }) {
+			if (reporter.options().quick && size > large)
+				break;
+			benchContainsBatch<LPHashSet<uint32_t, LPHashSetPolicy::SSE>>(reporter, "LPHashSet<SSE>", size);
+			if (g_SimdLevel >= SimdLevel::AVX2)
+				benchContainsBatch<LPHashSet<uint32_t, LPHashSetPolicy::AVX>>(reporter, "LPHashSet<AVX>", size);
+		}
+	#endif
+
+	std::vector<uint32_t> threadCounts;
+	for (uint32_t threads = 1; threads <= std::max(1u, std::thread::hardware_concurrency()); threads *= 2) {
+		threadCounts.push_back(threads);
 	}
 
-	std::cout << "\nstd::unordered_set" << std::endl;
+	using AutoMap = LPHashMap<uint32_t, uint64_t>;
+	using SeparateMap = LPHashMap<uint32_t, uint64_t, LPHashSetPolicy::Auto, Hasher<uint32_t>, std::equal_to<>, AlignedAllocator, true>;
+	using StdMap = std::unordered_map<uint32_t, uint64_t, DefaultHash>;
 	for (const auto size : sizes) {
-		//benchInsertIntSet<std::unordered_set<uint32_t, hs::DefaultHash>>(size);
-		//benchContainsInserted<std::unordered_set<uint32_t, hs::DefaultHash>, SetType::Std>(size);
-		//benchContainsNotInserted<std::unordered_set<uint32_t, hs::DefaultHash>, SetType::Std>(size);
-		benchRandomUsage<std::unordered_set<uint32_t, hs::DefaultHash>, SetType::Std>(size);
+		benchMap<AutoMap, SetType::Hs>(reporter, "LPHashMap<Auto>", size);
+		benchMap<SeparateMap, SetType::Hs>(reporter, "LPHashMap<Auto, separate values>", size);
+		benchMap<StdMap, SetType::Std>(reporter, "std::unordered_map", size);
+	}
+
+	// From groups which stay in cache to about one group per row
+	for (const auto groups : sizes) {
+		for (const bool batch : { false, true }) {
+			benchAggregate<AutoMap, SetType::Hs>(reporter, "LPHashMap<Auto>", large, groups, batch);
+			benchAggregate<SeparateMap, SetType::Hs>(reporter, "LPHashMap<Auto, separate values>", large, groups, batch);
+		}
+		benchAggregate<StdMap, SetType::Std>(reporter, "std::unordered_map", large, groups, false);
 	}
 
-    return 0;
+	#if defined (NDEBUG)
+		for (const auto size : { 1000000u, 10000000u }) {
+			if (reporter.options().quick && size > 1000000u)
+				break;
+			for (const auto threads : threadCounts) {
+				benchRehash<AutoSet>(reporter, "LPHashSet<Auto>", size, threads);
+				benchRehash<FastRangeSet<uint32_t>>(reporter, "LPHashSet<Auto, fast range>", size, threads);
+			}
+		}
+	#endif
+
+	for (const auto threads : threadCounts) {
+		benchConcurrent<ConcurrentLPHashSet<uint32_t>>(reporter, "ConcurrentLPHashSet", large, threads);
+		benchConcurrent<MutexWrappedSet<AutoSet>>(reporter, "Mutex wrapped LPHashSet<Auto>", large, threads);
+	}
+
+	for (const auto threads : threadCounts) {
+		benchConcurrentReadMostly<LockFreeReadLPHashSet<uint32_t>>(reporter, "LockFreeReadLPHashSet", large, threads);
+		benchConcurrentReadMostly<ConcurrentLPHashSet<uint32_t>>(reporter, "ConcurrentLPHashSet", large, threads);
+	}
+
+	runProbing(reporter);
+}
+
+int main(int argc, char** argv) {
+	bench::Options options;
+	if (!options.parse(argc, argv))
+		return 1;
+
+	Reporter reporter(options);
+
+	if (options.matrix)
+		runMatrix(reporter);
+	if (options.extras)
+		runExtras(reporter);
+
+	reporter.write(simdLevelName(hs::g_SimdLevel));
+
+	return 0;
 }
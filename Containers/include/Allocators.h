@@ -0,0 +1,207 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <new>
+
+#if defined(_WIN32)
+	#if !defined(NOMINMAX)
+		#define NOMINMAX
+	#endif
+	#include <malloc.h>
+	#include <windows.h>
+#else
+	#include <sys/mman.h>
+#endif
+
+namespace hs {
+
+//-----------------------------------------------------------------------------
+// Allocators used by the containers hand out raw bytes:
+//   static constexpr size_t ALIGNMENT - alignment of every returned block
+//   void* allocate(size_t size)
+//   void deallocate(void* ptr, size_t size) - size is the one passed to allocate
+// Containers which load SIMD groups straight from the returned memory check ALIGNMENT.
+
+//-----------------------------------------------------------------------------
+inline void* alignedAlloc(size_t size, size_t alignment) {
+	// aligned_alloc wants the size to be a multiple of the alignment
+	size = (size + alignment - 1) & ~(alignment - 1);
+
+	#if defined(_WIN32)
+		void* ptr = _aligned_malloc(size, alignment);
+	#else
+		void* ptr = aligned_alloc(alignment, size);
+	#endif
+
+	if (!ptr)
+		throw std::bad_alloc();
+	return ptr;
+}
+
+//-----------------------------------------------------------------------------
+inline void alignedFree(void* ptr) {
+	#if defined(_WIN32)
+		_aligned_free(ptr);
+	#else
+		free(ptr);
+	#endif
+}
+
+//-----------------------------------------------------------------------------
+// Cache line aligned heap memory, the default for all containers
+struct AlignedAllocator {
+	static constexpr size_t ALIGNMENT = 64;
+
+	//-----------------------------------------------------------------------------
+	void* allocate(size_t size) {
+		return alignedAlloc(size, ALIGNMENT);
+	}
+	//-----------------------------------------------------------------------------
+	void deallocate(void* ptr, size_t) {
+		alignedFree(ptr);
+	}
+};
+
+//-----------------------------------------------------------------------------
+// Backs blocks of at least 2MB with huge pages to cut TLB misses on large tables.
+// Linux gets 2MB aligned memory marked with MADV_HUGEPAGE for transparent huge pages.
+// Windows tries large pages (requires SeLockMemoryPrivilege) and falls back to regular pages.
+// Smaller blocks use AlignedAllocator.
+struct HugePageAllocator {
+	static constexpr size_t ALIGNMENT = 64;
+	static constexpr size_t HUGE_PAGE_SIZE = static_cast<size_t>(2) << 20;
+
+	//-----------------------------------------------------------------------------
+	void* allocate(size_t size) {
+		if (size < HUGE_PAGE_SIZE)
+			return alignedAlloc(size, ALIGNMENT);
+
+		#if defined(_WIN32)
+			const size_t largePage = GetLargePageMinimum();
+			void* ptr = nullptr;
+			if (largePage) {
+				const size_t largeSize = (size + largePage - 1) & ~(largePage - 1);
+				ptr = VirtualAlloc(nullptr, largeSize, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+			}
+			if (!ptr)
+				ptr = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+			if (!ptr)
+				throw std::bad_alloc();
+			return ptr;
+		#else
+			void* ptr = alignedAlloc(size, HUGE_PAGE_SIZE);
+			#if defined(MADV_HUGEPAGE)
+				// Only a hint, the kernel may ignore it if THP is disabled
+				madvise(ptr, (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1), MADV_HUGEPAGE);
+			#endif
+			return ptr;
+		#endif
+	}
+	//-----------------------------------------------------------------------------
+	void deallocate(void* ptr, size_t size) {
+		if (size < HUGE_PAGE_SIZE) {
+			alignedFree(ptr);
+			return;
+		}
+
+		#if defined(_WIN32)
+			VirtualFree(ptr, 0, MEM_RELEASE);
+		#else
+			alignedFree(ptr);
+		#endif
+	}
+};
+
+//-----------------------------------------------------------------------------
+// Bump allocator for short-lived containers, everything is freed at once when the
+// arena is released or destroyed. Not thread-safe.
+class MonotonicArena {
+public:
+	//-----------------------------------------------------------------------------
+	explicit MonotonicArena(size_t blockSize = DEFAULT_BLOCK_SIZE)
+		: blockSize_(blockSize)
+		, blocks_(nullptr)
+		, current_(nullptr)
+		, end_(nullptr)
+	{}
+	//-----------------------------------------------------------------------------
+	~MonotonicArena() {
+		release();
+	}
+	//-----------------------------------------------------------------------------
+	MonotonicArena(const MonotonicArena&) = delete;
+	MonotonicArena& operator=(const MonotonicArena&) = delete;
+	//-----------------------------------------------------------------------------
+	void* allocate(size_t size, size_t alignment) {
+		uintptr_t aligned = (reinterpret_cast<uintptr_t>(current_) + alignment - 1) & ~(alignment - 1);
+		if (!current_ || aligned + size > reinterpret_cast<uintptr_t>(end_)) {
+			addBlock(size + alignment);
+			aligned = (reinterpret_cast<uintptr_t>(current_) + alignment - 1) & ~(alignment - 1);
+		}
+
+		current_ = reinterpret_cast<uint8_t*>(aligned + size);
+		return reinterpret_cast<void*>(aligned);
+	}
+	//-----------------------------------------------------------------------------
+	// Frees all blocks, memory handed out before must not be used anymore
+	void release() {
+		while (blocks_) {
+			Block* next = blocks_->next_;
+			free(blocks_);
+			blocks_ = next;
+		}
+		current_ = nullptr;
+		end_ = nullptr;
+	}
+
+private:
+	static constexpr size_t DEFAULT_BLOCK_SIZE = static_cast<size_t>(64) << 10;
+
+	struct Block {
+		Block* next_;
+	};
+
+	size_t blockSize_;
+	Block* blocks_;
+	uint8_t* current_;
+	uint8_t* end_;
+
+	//-----------------------------------------------------------------------------
+	void addBlock(size_t minSize) {
+		const size_t size = sizeof(Block) + (minSize > blockSize_ ? minSize : blockSize_);
+		Block* block = static_cast<Block*>(malloc(size));
+		if (!block)
+			throw std::bad_alloc();
+
+		block->next_ = blocks_;
+		blocks_ = block;
+		current_ = reinterpret_cast<uint8_t*>(block + 1);
+		end_ = reinterpret_cast<uint8_t*>(block) + size;
+	}
+};
+
+//-----------------------------------------------------------------------------
+// Allocates from a MonotonicArena which has to outlive the container.
+// Memory freed by the container (e.g. the old arrays after rehash) is only
+// reclaimed when the arena is released.
+class ArenaAllocator {
+public:
+	static constexpr size_t ALIGNMENT = 64;
+
+	//-----------------------------------------------------------------------------
+	explicit ArenaAllocator(MonotonicArena& arena)
+		: arena_(&arena)
+	{}
+	//-----------------------------------------------------------------------------
+	void* allocate(size_t size) {
+		return arena_->allocate(size, ALIGNMENT);
+	}
+	//-----------------------------------------------------------------------------
+	void deallocate(void*, size_t) {}
+
+private:
+	MonotonicArena* arena_;
+};
+
+} // namespace hs
@@ -0,0 +1,357 @@
+#pragma once
+
+#include "Allocators.h"
+#include "HashFunc.h"
+#include "LinearProbingHashSet.h"
+#include "Platform.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <functional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <immintrin.h>
+
+namespace hs {
+
+//-----------------------------------------------------------------------------
+// Bloom filter whose bits for a key all lie in one 64 byte block, so every query touches a
+// single cache line. A block is 8 words of 64 bits and a key sets one bit in each word, the
+// bit positions come from multiplying the low half of the hash by 8 odd salts, the block is
+// picked by the high half of the hash times an odd constant. The AVX2 kernel derives and tests
+// all 8 bits at once.
+// At the default 10 bits per key about 1% of the absent keys pass. Keys can not be removed.
+template<class TKey, class THash = Hasher<TKey>, class TAllocator = AlignedAllocator>
+class BlockedBloomFilter {
+public:
+	static constexpr double DEFAULT_BITS_PER_KEY = 10.0;
+
+	//-----------------------------------------------------------------------------
+	// Sized for expectedCount keys at bitsPerKey bits each, more keys raise the false positive rate
+	explicit BlockedBloomFilter(size_t expectedCount = 0, double bitsPerKey = DEFAULT_BITS_PER_KEY, const THash& hasher = THash(), const TAllocator& allocator = TAllocator())
+		: hasher_(hasher)
+		, allocator_(allocator)
+		, blockCount_(blockCountFor(expectedCount, bitsPerKey))
+	{
+		blocks_ = static_cast<uint64_t*>(allocator_.allocate(blockCount_ * BLOCK_BYTES));
+		clear();
+	}
+	//-----------------------------------------------------------------------------
+	BlockedBloomFilter(BlockedBloomFilter&& other)
+		: hasher_(other.hasher_)
+		, allocator_(other.allocator_)
+		, blockCount_(0)
+		, blocks_(nullptr)
+	{
+		swap(other);
+	}
+	//-----------------------------------------------------------------------------
+	BlockedBloomFilter& operator=(BlockedBloomFilter&& other) {
+		swap(other);
+		return *this;
+	}
+	//-----------------------------------------------------------------------------
+	BlockedBloomFilter(const BlockedBloomFilter&) = delete;
+	BlockedBloomFilter& operator=(const BlockedBloomFilter&) = delete;
+	//-----------------------------------------------------------------------------
+	~BlockedBloomFilter() {
+		if (blocks_)
+			allocator_.deallocate(blocks_, blockCount_ * BLOCK_BYTES);
+	}
+	//-----------------------------------------------------------------------------
+	void swap(BlockedBloomFilter& other) {
+		using std::swap;
+		swap(hasher_, other.hasher_);
+		swap(allocator_, other.allocator_);
+		swap(blockCount_, other.blockCount_);
+		swap(blocks_, other.blocks_);
+	}
+	//-----------------------------------------------------------------------------
+	void insert(const TKey& key) {
+		insertHash(hasher_(key));
+	}
+	//-----------------------------------------------------------------------------
+	// False means key was never inserted, true means it probably was
+	bool mayContain(const TKey& key) const {
+		return mayContainHash(hasher_(key));
+	}
+	//-----------------------------------------------------------------------------
+	// For callers which already hashed the key with THash
+	void insertHash(Hash_t hash) {
+		uint64_t* block = blockOf(hash);
+		if (g_SimdLevel >= SimdLevel::AVX2) {
+			insertAVX(block, static_cast<uint32_t>(hash));
+		} else {
+			for (size_t i = 0; i < WORDS_PER_BLOCK; ++i) {
+				block[i] |= bitOf(static_cast<uint32_t>(hash), i);
+			}
+		}
+	}
+	//-----------------------------------------------------------------------------
+	bool mayContainHash(Hash_t hash) const {
+		const uint64_t* block = blockOf(hash);
+		if (g_SimdLevel >= SimdLevel::AVX2)
+			return mayContainAVX(block, static_cast<uint32_t>(hash));
+
+		for (size_t i = 0; i < WORDS_PER_BLOCK; ++i) {
+			if ((block[i] & bitOf(static_cast<uint32_t>(hash), i)) == 0)
+				return false;
+		}
+		return true;
+	}
+	//-----------------------------------------------------------------------------
+	// Queries keys[0..count), bit i of resultBits is set if keys[i] may be present.
+	// resultBits must hold at least (count + 63) / 64 words. The blocks of a window of
+	// keys are prefetched before any of them is tested, so their cache misses overlap.
+	void mayContainBatch(const TKey* keys, size_t count, uint64_t* resultBits) const {
+		memset(resultBits, 0, sizeof(uint64_t) * ((count + 63) / 64));
+
+		Hash_t hashes[BATCH_WINDOW];
+		for (size_t begin = 0; begin < count; begin += BATCH_WINDOW) {
+			const size_t end = begin + BATCH_WINDOW < count ? begin + BATCH_WINDOW : count;
+			for (size_t i = begin; i < end; ++i) {
+				hashes[i - begin] = hasher_(keys[i]);
+				_mm_prefetch(reinterpret_cast<const char*>(blockOf(hashes[i - begin])), _MM_HINT_T0);
+			}
+			for (size_t i = begin; i < end; ++i) {
+				if (mayContainHash(hashes[i - begin]))
+					resultBits[i >> 6] |= static_cast<uint64_t>(1) << (i & 63);
+			}
+		}
+	}
+	//-----------------------------------------------------------------------------
+	void clear() {
+		memset(blocks_, 0, blockCount_ * BLOCK_BYTES);
+	}
+	//-----------------------------------------------------------------------------
+	const THash& hasher() const {
+		return hasher_;
+	}
+	//-----------------------------------------------------------------------------
+	size_t blockCount() const {
+		return blockCount_;
+	}
+	//-----------------------------------------------------------------------------
+	size_t sizeInBytes() const {
+		return blockCount_ * BLOCK_BYTES;
+	}
+	//-----------------------------------------------------------------------------
+	// Chance that an absent key passes given the bits set so far, assuming uniform hashes.
+	// A key passes a block if its bit is set in every word, walks all blocks once.
+	double falsePositiveRate() const {
+		double sum = 0.0;
+		for (size_t b = 0; b < blockCount_; ++b) {
+			double passes = 1.0;
+			for (size_t i = 0; i < WORDS_PER_BLOCK; ++i) {
+				passes *= static_cast<double>(popCount(blocks_[b * WORDS_PER_BLOCK + i])) / 64;
+			}
+			sum += passes;
+		}
+		return sum / blockCount_;
+	}
+
+private:
+	static constexpr size_t BLOCK_BYTES = 64;
+	static constexpr size_t WORDS_PER_BLOCK = BLOCK_BYTES / sizeof(uint64_t);
+	// Number of keys whose hashes and prefetches run ahead of the tests in batch queries
+	static constexpr size_t BATCH_WINDOW = 16;
+	static_assert(TAllocator::ALIGNMENT >= BLOCK_BYTES, "Blocks have to be cache line aligned");
+
+	THash hasher_;
+	TAllocator allocator_;
+	size_t blockCount_;
+	uint64_t* blocks_;
+
+	//-----------------------------------------------------------------------------
+	// Odd multipliers which spread the low half of the hash over the 8 words, one per word
+	static uint32_t salt(size_t word) {
+		static constexpr uint32_t SALTS[WORDS_PER_BLOCK] = {
+			0x47b6137bu, 0x44974d91u, 0x8824ad5bu, 0xa2b7289du,
+			0x705495c7u, 0x2df1424bu, 0x9efc4947u, 0x5c6bfb31u
+		};
+		return SALTS[word];
+	}
+	//-----------------------------------------------------------------------------
+	static uint64_t bitOf(uint32_t lowHash, size_t word) {
+		return static_cast<uint64_t>(1) << ((lowHash * salt(word)) >> 26);
+	}
+	//-----------------------------------------------------------------------------
+	static size_t popCount(uint64_t word) {
+		#if defined(_MSC_VER)
+			return static_cast<size_t>(__popcnt64(word));
+		#else
+			return static_cast<size_t>(__builtin_popcountll(word));
+		#endif
+	}
+	//-----------------------------------------------------------------------------
+	static size_t blockCountFor(size_t expectedCount, double bitsPerKey) {
+		const size_t blocks = static_cast<size_t>(static_cast<double>(expectedCount) * bitsPerKey / (BLOCK_BYTES * 8) + 0.999);
+		return blocks > 0 ? blocks : 1;
+	}
+	//-----------------------------------------------------------------------------
+	// Maps the high half of the hash onto [0, blockCount_) with a multiply instead of a modulo. The
+	// premix carries the low bits up, the hasher of 32 bit integers leaves the high half of dense keys nearly constant.
+	uint64_t* blockOf(Hash_t hash) const {
+		const uint64_t mixed = hash * 0x9e3779b97f4a7c15ull;
+		const size_t index = static_cast<size_t>(((mixed >> 32) * static_cast<uint64_t>(blockCount_)) >> 32);
+		return blocks_ + index * WORDS_PER_BLOCK;
+	}
+	//-----------------------------------------------------------------------------
+	// Bit of each word in two vectors of 4 words, words 0-3 in low and 4-7 in high
+	HS_TARGET_AVX2
+	static void bitsAVX(uint32_t lowHash, __m256i& low, __m256i& high) {
+		const __m256i salts = _mm256_setr_epi32(
+			static_cast<int>(salt(0)), static_cast<int>(salt(1)), static_cast<int>(salt(2)), static_cast<int>(salt(3)),
+			static_cast<int>(salt(4)), static_cast<int>(salt(5)), static_cast<int>(salt(6)), static_cast<int>(salt(7)));
+		const __m256i positions = _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_set1_epi32(static_cast<int>(lowHash)), salts), 26);
+		const __m256i one = _mm256_set1_epi64x(1);
+		low = _mm256_sllv_epi64(one, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(positions)));
+		high = _mm256_sllv_epi64(one, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(positions, 1)));
+	}
+	//-----------------------------------------------------------------------------
+	HS_TARGET_AVX2
+	static bool mayContainAVX(const uint64_t* block, uint32_t lowHash) {
+		__m256i low, high;
+		bitsAVX(lowHash, low, high);
+		const __m256i* words = reinterpret_cast<const __m256i*>(block);
+		// testc is 1 if every bit set in the second operand is set in the first
+		return _mm256_testc_si256(_mm256_load_si256(words), low) & _mm256_testc_si256(_mm256_load_si256(words + 1), high);
+	}
+	//-----------------------------------------------------------------------------
+	HS_TARGET_AVX2
+	static void insertAVX(uint64_t* block, uint32_t lowHash) {
+		__m256i low, high;
+		bitsAVX(lowHash, low, high);
+		__m256i* words = reinterpret_cast<__m256i*>(block);
+		_mm256_store_si256(words, _mm256_or_si256(_mm256_load_si256(words), low));
+		_mm256_store_si256(words + 1, _mm256_or_si256(_mm256_load_si256(words + 1), high));
+	}
+};
+
+//-----------------------------------------------------------------------------
+// LPHashSet behind a BlockedBloomFilter, for workloads where most lookups miss. Most misses
+// end in the single cache line of the filter and never touch the table, keys which pass the
+// filter are hashed again by the set. Removed keys leave their bits behind, so the filter is
+// rebuilt from the set once they make up a quarter of its keys or when the set outgrows it.
+template<class TKey, LPHashSetPolicy Policy = LPHashSetPolicy::Auto, class THash = Hasher<TKey>, class TEqual = std::equal_to<>>
+class BloomFilteredLPHashSet {
+public:
+	using Set = LPHashSet<TKey, Policy, THash, TEqual>;
+	using Filter = BlockedBloomFilter<TKey, THash>;
+
+	//-----------------------------------------------------------------------------
+	// Sizes the set and the filter so elementCount elements fit without a rebuild
+	explicit BloomFilteredLPHashSet(size_t elementCount = 0, double bitsPerKey = Filter::DEFAULT_BITS_PER_KEY, const THash& hasher = THash())
+		: set_(elementCount, hasher)
+		, filter_(filterCapacityFor(elementCount), bitsPerKey, hasher)
+		, bitsPerKey_(bitsPerKey)
+		, filterCapacity_(filterCapacityFor(elementCount))
+		, staleKeys_(0)
+	{}
+	//-----------------------------------------------------------------------------
+	void insert(const TKey& key) {
+		const size_t before = set_.count();
+		set_.insert(key);
+		if (set_.count() == before)
+			return;
+
+		if (set_.count() + staleKeys_ > filterCapacity_) {
+			rebuildFilter(2 * set_.count());
+		} else {
+			filter_.insert(key);
+		}
+	}
+	//-----------------------------------------------------------------------------
+	void remove(const TKey& key) {
+		const size_t before = set_.count();
+		set_.remove(key);
+		if (set_.count() == before)
+			return;
+
+		if (++staleKeys_ > filterCapacity_ / 4)
+			rebuildFilter(set_.count());
+	}
+	//-----------------------------------------------------------------------------
+	bool contains(const TKey& key) const {
+		return filter_.mayContain(key) && set_.contains(key);
+	}
+	//-----------------------------------------------------------------------------
+	// Looks up keys[0..count), bit i of resultBits is set if keys[i] is present.
+	// resultBits must hold at least (count + 63) / 64 words. The filter is queried for all
+	// keys first, then only the ones which passed probe the set in a batch of their own.
+	void containsBatch(const TKey* keys, size_t count, uint64_t* resultBits) const {
+		filter_.mayContainBatch(keys, count, resultBits);
+
+		if constexpr (std::is_trivially_copyable<TKey>::value) {
+			std::vector<TKey> candidates;
+			std::vector<size_t> positions;
+			forEachSetBit(resultBits, count, [&](size_t i) {
+				candidates.push_back(keys[i]);
+				positions.push_back(i);
+			});
+
+			std::vector<uint64_t> found((candidates.size() + 63) / 64);
+			set_.containsBatch(candidates.data(), candidates.size(), found.data());
+			for (size_t j = 0; j < positions.size(); ++j) {
+				if ((found[j >> 6] & (static_cast<uint64_t>(1) << (j & 63))) == 0)
+					resultBits[positions[j] >> 6] &= ~(static_cast<uint64_t>(1) << (positions[j] & 63));
+			}
+		} else {
+			// Copying expensive keys into a batch costs more than the overlapped probes save
+			forEachSetBit(resultBits, count, [&](size_t i) {
+				if (!set_.contains(keys[i]))
+					resultBits[i >> 6] &= ~(static_cast<uint64_t>(1) << (i & 63));
+			});
+		}
+	}
+	//-----------------------------------------------------------------------------
+	size_t count() const {
+		return set_.count();
+	}
+	//-----------------------------------------------------------------------------
+	const Set& set() const {
+		return set_;
+	}
+	//-----------------------------------------------------------------------------
+	const Filter& filter() const {
+		return filter_;
+	}
+
+private:
+	// Filters smaller than this are not worth rebuilding often
+	static constexpr size_t MIN_FILTER_CAPACITY = 1024;
+
+	Set set_;
+	Filter filter_;
+	double bitsPerKey_;
+	size_t filterCapacity_;	// Keys the filter is sized for
+	size_t staleKeys_;		// Removed keys whose bits are still in the filter
+
+	//-----------------------------------------------------------------------------
+	static size_t filterCapacityFor(size_t elementCount) {
+		return elementCount > MIN_FILTER_CAPACITY ? elementCount : MIN_FILTER_CAPACITY;
+	}
+	//-----------------------------------------------------------------------------
+	void rebuildFilter(size_t capacity) {
+		filterCapacity_ = filterCapacityFor(capacity);
+		Filter filter(filterCapacity_, bitsPerKey_, filter_.hasher());
+		set_.forEach([&](const TKey& key) { filter.insert(key); });
+		filter_ = std::move(filter);
+		staleKeys_ = 0;
+	}
+	//-----------------------------------------------------------------------------
+	template<class TFunc>
+	static void forEachSetBit(const uint64_t* bits, size_t count, TFunc&& func) {
+		for (size_t word = 0; word < (count + 63) / 64; ++word) {
+			uint64_t mask = bits[word];
+			unsigned long firstSet;
+			while (bitScanForward(&firstSet, mask)) {
+				func((word << 6) + firstSet);
+				mask &= mask - 1;
+			}
+		}
+	}
+};
+
+} // namespace hs
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "LinearProbingHashSet.h"
+
+#include <stdint.h>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+
+namespace hs {
+
+//-----------------------------------------------------------------------------
+// Thread-safe set made of independently locked LPHashSet shards. The shard is picked by
+// the high bits of the mixed hash, so every shard grows and rehashes on its own and
+// threads working on different shards never touch the same lock or cache lines.
+// Lookups of the same shard run in parallel under a shared lock.
+template<class TKey, LPHashSetPolicy Policy = LPHashSetPolicy::Auto, class THash = Hasher<TKey>, class TEqual = std::equal_to<>>
+class ConcurrentLPHashSet {
+public:
+	//-----------------------------------------------------------------------------
+	explicit ConcurrentLPHashSet(size_t shardCount = DEFAULT_SHARD_COUNT)
+		: shardBits_(0)
+	{
+		while ((static_cast<size_t>(1) << shardBits_) < shardCount) {
+			++shardBits_;
+		}
+		shards_.reset(new Shard[shardCountInternal()]);
+	}
+	//-----------------------------------------------------------------------------
+	void insert(const TKey& key) {
+		Shard& shard = shardOf(key);
+		std::lock_guard<std::shared_mutex> lock(shard.mutex_);
+		shard.set_.insert(key);
+	}
+	//-----------------------------------------------------------------------------
+	void remove(const TKey& key) {
+		Shard& shard = shardOf(key);
+		std::lock_guard<std::shared_mutex> lock(shard.mutex_);
+		shard.set_.remove(key);
+	}
+	//-----------------------------------------------------------------------------
+	bool contains(const TKey& key) const {
+		Shard& shard = shardOf(key);
+		// Shared, a lookup writes nothing with NoStats
+		std::shared_lock<std::shared_mutex> lock(shard.mutex_);
+		return shard.set_.contains(key);
+	}
+	//-----------------------------------------------------------------------------
+	// Sum over all shards, only exact if no other thread modifies the set meanwhile
+	size_t count() const {
+		size_t total = 0;
+		for (size_t i = 0; i < shardCountInternal(); ++i) {
+			std::shared_lock<std::shared_mutex> lock(shards_[i].mutex_);
+			total += shards_[i].set_.count();
+		}
+		return total;
+	}
+	//-----------------------------------------------------------------------------
+	size_t shardCount() const {
+		return shardCountInternal();
+	}
+
+private:
+	static constexpr size_t DEFAULT_SHARD_COUNT = 64;
+	// 2^64 / golden ratio, spreads the input hash over the high bits
+	static constexpr Hash_t SHARD_MIX = 0x9E3779B97F4A7C15ull;
+
+	// Each shard on its own cache line(s) so locking one does not invalidate its neighbours
+	struct alignas(64) Shard {
+		mutable std::shared_mutex mutex_;
+		LPHashSet<TKey, Policy, THash, TEqual> set_;
+	};
+
+	THash hasher_;
+	size_t shardBits_;
+	std::unique_ptr<Shard[]> shards_;
+
+	//-----------------------------------------------------------------------------
+	size_t shardCountInternal() const {
+		return static_cast<size_t>(1) << shardBits_;
+	}
+	//-----------------------------------------------------------------------------
+	// The shard must not use the bits its LPHashSet reads, the low 7 bits are the fingerprint and the
+	// home slot comes from hash >> 8. The high bits of the remixed hash depend on every bit without
+	// fixing any, so the keys of one shard still spread over all home slots and fingerprints.
+	Shard& shardOf(const TKey& key) const {
+		if (shardBits_ == 0)
+			return shards_[0];
+
+		const Hash_t mixed = hasher_(key) * SHARD_MIX;
+		return shards_[mixed >> (64 - shardBits_)];
+	}
+};
+
+} // namespace hs
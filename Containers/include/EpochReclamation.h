@@ -0,0 +1,158 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace hs {
+
+//-----------------------------------------------------------------------------
+// Epoch based reclamation shared by all lock-free containers.
+// A reader announces the global epoch it saw while inside an EpochGuard.
+// Memory unlinked by a writer is retired with the epoch current at unlink time and
+// is freed only once every active reader has announced a newer epoch - such readers
+// started after the unlink so they cannot hold a pointer to it.
+class EpochDomain {
+public:
+	//-----------------------------------------------------------------------------
+	static EpochDomain& instance() {
+		static EpochDomain domain;
+		return domain;
+	}
+	//-----------------------------------------------------------------------------
+	~EpochDomain() {
+		// Static destruction, no reader can be active anymore
+		for (const Retired& retired : retired_) {
+			retired.deleter_(retired.ptr_);
+		}
+
+		ThreadRecord* record = records_.load(std::memory_order_relaxed);
+		while (record) {
+			ThreadRecord* next = record->next_;
+			delete record;
+			record = next;
+		}
+	}
+	//-----------------------------------------------------------------------------
+	// Must be called after ptr was unlinked from every shared location
+	void retire(void* ptr, void (*deleter)(void*)) {
+		const uint64_t epoch = globalEpoch_.fetch_add(1, std::memory_order_seq_cst);
+
+		std::lock_guard<std::mutex> lock(retiredMutex_);
+		retired_.push_back({ ptr, deleter, epoch });
+		reclaim();
+	}
+
+private:
+	friend class EpochGuard;
+
+	static constexpr uint64_t INACTIVE = ~static_cast<uint64_t>(0);
+
+	// One record per thread, padded so readers never share a cache line
+	struct alignas(64) ThreadRecord {
+		std::atomic<uint64_t> epoch_{ INACTIVE };
+		std::atomic<bool> inUse_{ true };
+		uint32_t depth_{ 0 };	// Only touched by the owning thread
+		ThreadRecord* next_{ nullptr };
+	};
+
+	struct Retired {
+		void* ptr_;
+		void (*deleter_)(void*);
+		uint64_t epoch_;
+	};
+
+	// Gives the record back for reuse when the thread exits
+	struct RecordHolder {
+		ThreadRecord* record_{ nullptr };
+		~RecordHolder() {
+			if (record_)
+				record_->inUse_.store(false, std::memory_order_release);
+		}
+	};
+
+	std::atomic<uint64_t> globalEpoch_{ 0 };
+	std::atomic<ThreadRecord*> records_{ nullptr };
+
+	std::mutex retiredMutex_;
+	std::vector<Retired> retired_;
+
+	//-----------------------------------------------------------------------------
+	EpochDomain() = default;
+	//-----------------------------------------------------------------------------
+	ThreadRecord& localRecord() {
+		thread_local RecordHolder holder;
+		if (!holder.record_)
+			holder.record_ = acquireRecord();
+		return *holder.record_;
+	}
+	//-----------------------------------------------------------------------------
+	ThreadRecord* acquireRecord() {
+		// Reuse a record of an exited thread first
+		for (ThreadRecord* record = records_.load(std::memory_order_acquire); record; record = record->next_) {
+			bool inUse = false;
+			if (!record->inUse_.load(std::memory_order_relaxed) && record->inUse_.compare_exchange_strong(inUse, true))
+				return record;
+		}
+
+		// Records are never unlinked so a lock-free push is enough
+		ThreadRecord* record = new ThreadRecord();
+		ThreadRecord* head = records_.load(std::memory_order_relaxed);
+		do {
+			record->next_ = head;
+		} while (!records_.compare_exchange_weak(head, record, std::memory_order_release, std::memory_order_relaxed));
+
+		return record;
+	}
+	//-----------------------------------------------------------------------------
+	// Expects retiredMutex_ to be held
+	void reclaim() {
+		uint64_t minActive = INACTIVE;
+		for (ThreadRecord* record = records_.load(std::memory_order_acquire); record; record = record->next_) {
+			const uint64_t epoch = record->epoch_.load(std::memory_order_seq_cst);
+			if (epoch < minActive)
+				minActive = epoch;
+		}
+
+		size_t kept = 0;
+		for (size_t i = 0; i < retired_.size(); ++i) {
+			if (retired_[i].epoch_ < minActive) {
+				retired_[i].deleter_(retired_[i].ptr_);
+			} else {
+				retired_[kept++] = retired_[i];
+			}
+		}
+		retired_.resize(kept);
+	}
+};
+
+//-----------------------------------------------------------------------------
+// Marks the current thread as a reader for its lifetime, guards may nest
+class EpochGuard {
+public:
+	//-----------------------------------------------------------------------------
+	EpochGuard()
+		: record_(EpochDomain::instance().localRecord())
+	{
+		if (record_.depth_++ == 0) {
+			const uint64_t epoch = EpochDomain::instance().globalEpoch_.load(std::memory_order_relaxed);
+			record_.epoch_.store(epoch, std::memory_order_relaxed);
+			// The announcement must be visible before any shared pointer is loaded
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+		}
+	}
+	//-----------------------------------------------------------------------------
+	~EpochGuard() {
+		if (--record_.depth_ == 0)
+			record_.epoch_.store(EpochDomain::INACTIVE, std::memory_order_release);
+	}
+	//-----------------------------------------------------------------------------
+	EpochGuard(const EpochGuard&) = delete;
+	EpochGuard& operator=(const EpochGuard&) = delete;
+
+private:
+	EpochDomain::ThreadRecord& record_;
+};
+
+} // namespace hs
@@ -0,0 +1,232 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#if defined(_MSC_VER)
+	#include <intrin.h>
+#endif
+
+namespace hs {
+
+//-----------------------------------------------------------------------------
+using Hash_t = uint64_t;
+
+//-----------------------------------------------------------------------------
+template<class TKey>
+using HashFunc_t = Hash_t(*)(const TKey&);
+
+//-----------------------------------------------------------------------------
+template<class TKey>
+Hash_t defaultHashFunc(const TKey&) {
+	// Dependent condition so the assert only fires when the template is instantiated
+	static_assert(sizeof(TKey) == 0, "defaultHashFunc must be specialized");
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+template<>
+inline Hash_t defaultHashFunc<int>(const int& key) {
+	return 17 + static_cast<Hash_t>(key) * 2654435761;
+}
+
+//-----------------------------------------------------------------------------
+template<>
+inline Hash_t defaultHashFunc<uint32_t>(const uint32_t& key) {
+	return 17 + static_cast<Hash_t>(key) * 2654435761;
+}
+
+//-----------------------------------------------------------------------------
+// 64x64 -> 128 bit multiply, low half in a and high half in b
+inline void mul128(uint64_t* a, uint64_t* b) {
+	#if defined(_MSC_VER)
+		*a = _umul128(*a, *b, b);
+	#else
+		const unsigned __int128 product = static_cast<unsigned __int128>(*a) * *b;
+		*a = static_cast<uint64_t>(product);
+		*b = static_cast<uint64_t>(product >> 64);
+	#endif
+}
+
+//-----------------------------------------------------------------------------
+// Multiply folded back to 64 bits, the mixing step of wyhash
+inline uint64_t mulFold(uint64_t a, uint64_t b) {
+	mul128(&a, &b);
+	return a ^ b;
+}
+
+//-----------------------------------------------------------------------------
+// wyhash (final version) of a byte range. Reads 16 bytes per multiply, short inputs take
+// a branch-light path with overlapping loads.
+inline Hash_t hashBytes(const void* data, size_t size, uint64_t seed = 0) {
+	constexpr uint64_t SECRET[4] = { 0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull, 0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull };
+
+	auto read8 = [](const uint8_t* p) { uint64_t v; memcpy(&v, p, 8); return v; };
+	auto read4 = [](const uint8_t* p) { uint32_t v; memcpy(&v, p, 4); return static_cast<uint64_t>(v); };
+
+	const uint8_t* p = static_cast<const uint8_t*>(data);
+	seed ^= mulFold(seed ^ SECRET[0], SECRET[1]);
+
+	uint64_t a, b;
+	if (size <= 16) {
+		if (size >= 4) {
+			// Up to four overlapping 4 byte loads cover every length in [4, 16]
+			const size_t shift = (size >> 3) << 2;
+			a = (read4(p) << 32) | read4(p + shift);
+			b = (read4(p + size - 4) << 32) | read4(p + size - 4 - shift);
+		} else if (size > 0) {
+			a = (static_cast<uint64_t>(p[0]) << 16) | (static_cast<uint64_t>(p[size >> 1]) << 8) | p[size - 1];
+			b = 0;
+		} else {
+			a = b = 0;
+		}
+	} else {
+		size_t i = size;
+		if (i > 48) {
+			// Three independent lanes keep the multipliers busy on long keys
+			uint64_t seed1 = seed, seed2 = seed;
+			do {
+				seed = mulFold(read8(p) ^ SECRET[1], read8(p + 8) ^ seed);
+				seed1 = mulFold(read8(p + 16) ^ SECRET[2], read8(p + 24) ^ seed1);
+				seed2 = mulFold(read8(p + 32) ^ SECRET[3], read8(p + 40) ^ seed2);
+				p += 48;
+				i -= 48;
+			} while (i > 48);
+			seed ^= seed1 ^ seed2;
+		}
+		while (i > 16) {
+			seed = mulFold(read8(p) ^ SECRET[1], read8(p + 8) ^ seed);
+			p += 16;
+			i -= 16;
+		}
+		a = read8(p + i - 16);
+		b = read8(p + i - 8);
+	}
+
+	a ^= SECRET[1];
+	b ^= seed;
+	mul128(&a, &b);
+	return mulFold(a ^ SECRET[0] ^ size, b ^ SECRET[1]);
+}
+
+//-----------------------------------------------------------------------------
+// Default hasher of the containers. Falls back to defaultHashFunc so existing
+// specializations keep working, integers and strings have their own versions below.
+template<class TKey, class Enable = void>
+struct Hasher {
+	Hash_t operator()(const TKey& key) const {
+		return defaultHashFunc<TKey>(key);
+	}
+};
+
+//-----------------------------------------------------------------------------
+// Up to 32 bits a single multiply spreads the key over the bits the tables use,
+// wider keys need the full 128 bit fold
+template<class TKey>
+struct Hasher<TKey, typename std::enable_if<std::is_integral<TKey>::value>::type> {
+	Hash_t operator()(TKey key) const {
+		if constexpr (sizeof(TKey) <= 4) {
+			return 17 + static_cast<Hash_t>(key) * 2654435761;
+		} else {
+			return mulFold(static_cast<uint64_t>(key) ^ 0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull);
+		}
+	}
+};
+
+//-----------------------------------------------------------------------------
+// Hashes any string-like key through std::string_view, so lookups with a
+// std::string_view or a literal do not construct a std::string.
+// A non-zero seed gives a different hash function, e.g. per process against flooding.
+struct StringHasher {
+	using is_transparent = void;
+
+	uint64_t seed_;
+
+	//-----------------------------------------------------------------------------
+	explicit StringHasher(uint64_t seed = 0)
+		: seed_(seed)
+	{}
+	//-----------------------------------------------------------------------------
+	Hash_t operator()(std::string_view key) const {
+		return hashBytes(key.data(), key.size(), seed_);
+	}
+	//-----------------------------------------------------------------------------
+	bool operator==(const StringHasher& other) const {
+		return seed_ == other.seed_;
+	}
+};
+
+//-----------------------------------------------------------------------------
+template<>
+struct Hasher<std::string> : StringHasher {
+	using StringHasher::StringHasher;
+};
+
+//-----------------------------------------------------------------------------
+template<>
+struct Hasher<std::string_view> : StringHasher {
+	using StringHasher::StringHasher;
+};
+
+//-----------------------------------------------------------------------------
+// Adapts a plain hash function to the hasher interface
+template<class TKey, HashFunc_t<TKey> hashFunc>
+struct FuncHasher {
+	Hash_t operator()(const TKey& key) const {
+		return hashFunc(key);
+	}
+};
+
+//-----------------------------------------------------------------------------
+// Heterogeneous lookup is enabled when both the hasher and the equality define is_transparent
+template<class T, class = void>
+struct IsTransparent : std::false_type {};
+
+template<class T>
+struct IsTransparent<T, std::void_t<typename T::is_transparent>> : std::true_type {};
+
+// Enables the heterogeneous overload of a lookup for key types other than TKey
+template<class THash, class TEqual, class K, class TKey>
+using EnableIfTransparent = typename std::enable_if<
+	IsTransparent<THash>::value && IsTransparent<TEqual>::value && !std::is_same<K, TKey>::value, int>::type;
+
+// Key types an insert can probe with before it constructs the element: TKey itself and, with
+// transparent functors, the types they accept which TKey can be constructed from
+template<class THash, class TEqual, class K, class TKey>
+struct IsLookupKey : std::integral_constant<bool,
+	std::is_same<std::decay_t<K>, TKey>::value || (IsTransparent<THash>::value && IsTransparent<TEqual>::value
+		&& std::is_invocable<const THash&, const K&>::value && std::is_constructible<TKey, K&&>::value)> {};
+
+//-----------------------------------------------------------------------------
+template<class T, class = void>
+struct IsEqualityComparable : std::false_type {};
+
+template<class T>
+struct IsEqualityComparable<T, std::void_t<decltype(std::declval<const T&>() == std::declval<const T&>())>> : std::true_type {};
+
+// True if two hashers of the same type are known to compute the same function, i.e. the type
+// is stateless or the states compare equal. Lets containers reuse hashes across instances.
+template<class THash>
+bool sameHashFunction(const THash& a, const THash& b) {
+	if constexpr (std::is_empty<THash>::value) {
+		return true;
+	} else if constexpr (IsEqualityComparable<THash>::value) {
+		return a == b;
+	} else {
+		return false;
+	}
+}
+
+//-----------------------------------------------------------------------------
+struct DefaultHash {
+	size_t operator()(const uint32_t& key) const {
+		return 17 + static_cast<size_t>(key) * 2654435761;
+	}
+};
+
+} // namespace hs
@@ -1,20 +1,121 @@
+#pragma once
+
+#include "HashFunc.h"
+#include "HashSetStats.h"
 
 #include <stdint.h>
+#include <stdlib.h>
+#include <functional>
+#include <new>
+#include <utility>
 
 namespace hs {
 
-template<class TKey>
+//-----------------------------------------------------------------------------
+// Robin Hood open addressing set. On insert an element which is closer to its
+// ideal slot than the inserted one gives up its slot, which keeps the variance
+// of probe lengths low. Removal shifts the following elements back instead
+// of leaving tombstones. For TStats see HashSetStats.h.
+template<class TKey, class THash = Hasher<TKey>, class TEqual = std::equal_to<>, class TStats = NoStats>
 class HashSet {
 public:
-	using Hash_t = int32_t;
+	//-----------------------------------------------------------------------------
+	explicit HashSet(const THash& hasher = THash(), const TEqual& equal = TEqual())
+		: hasher_(hasher)
+		, equal_(equal)
+		, count_(0)
+		, exponent_(5)
+	{
+		capacity_ = static_cast<size_t>(1) << exponent_;
+		allocEntries();
+	}
+	//-----------------------------------------------------------------------------
+	~HashSet() {
+		for (size_t i = 0; i < capacity_; ++i) {
+			if (entries_[i].distance_ != EMPTY) {
+				entries_[i].key_.~TKey();
+			}
+		}
 
+		free(entries_);
+	}
+	//-----------------------------------------------------------------------------
+	HashSet(const HashSet&) = delete;
+	HashSet& operator=(const HashSet&) = delete;
+	//-----------------------------------------------------------------------------
 	void insert(const TKey& key) {
-		// TODO
+		const size_t modMask = capacity_ - 1;
+		size_t i = hasher_(key) & modMask;
+		int32_t distance = 0;
+
+		// Same walk as indexOf, the first poorer entry is where the key belongs
+		while (distance <= entries_[i].distance_) {
+			if (distance == entries_[i].distance_ && keyEquals(entries_[i].key_, key))
+				return;
+
+			i = (i + 1) & modMask;
+			++distance;
+		}
+
+		emplaceAt(i, distance, TKey(key));
+		++count_;
+
+		if (loadFactor() > MAX_LOAD_FACTOR) {
+			rehash();
+		}
 	}
+	//-----------------------------------------------------------------------------
+	void remove(const TKey& key) {
+		size_t probeLength;
+		size_t idx = indexOf(key, probeLength);
+		if (idx == NPOS)
+			return;
+
+		entries_[idx].key_.~TKey();
+
+		// Backward shift deletion - pull the rest of the cluster one slot closer to its ideal position
+		const size_t modMask = capacity_ - 1;
+		size_t next = (idx + 1) & modMask;
+		while (entries_[next].distance_ > 0) {
+			new (&entries_[idx].key_) TKey(std::move(entries_[next].key_));
+			entries_[next].key_.~TKey();
+			entries_[idx].distance_ = entries_[next].distance_ - 1;
 
-	bool contains(const TKey& key) {
-		// TODO
-		return false;
+			idx = next;
+			next = (next + 1) & modMask;
+		}
+
+		entries_[idx].distance_ = EMPTY;
+		--count_;
+	}
+	//-----------------------------------------------------------------------------
+	bool contains(const TKey& key) const {
+		size_t probeLength;
+		const bool found = indexOf(key, probeLength) != NPOS;
+		stats_.onLookup(found, probeLength);
+		return found;
+	}
+	//-----------------------------------------------------------------------------
+	size_t count() const {
+		return count_;
+	}
+	//-----------------------------------------------------------------------------
+	size_t capacity() const {
+		return capacity_;
+	}
+	//-----------------------------------------------------------------------------
+	// See HashSetStats
+	HashSetStats stats() const {
+		HashSetStats result;
+		stats_.fill(result);
+		result.count = count_;
+		result.capacity = capacity_;
+		result.scanClusters(capacity_, [&](size_t i) { return entries_[i].distance_ != EMPTY; });
+		return result;
+	}
+	//-----------------------------------------------------------------------------
+	void resetStats() {
+		stats_.reset();
 	}
 
 private:
@@ -23,7 +124,97 @@ private:
 		int32_t distance_;
 	};
 
+	static constexpr int32_t EMPTY = -1;
+	static constexpr float MAX_LOAD_FACTOR = 0.9f;
+	static constexpr size_t NPOS = -1;
+
+	THash hasher_;
+	TEqual equal_;
+	size_t count_;
+	size_t capacity_;
+	size_t exponent_;
+
+	Entry* entries_;
 
+	TStats stats_;
+
+	//-----------------------------------------------------------------------------
+	float loadFactor() const {
+		return static_cast<float>(count_) / capacity_;
+	}
+	//-----------------------------------------------------------------------------
+	void allocEntries() {
+		entries_ = static_cast<Entry*>(malloc(sizeof(Entry) * capacity_));
+		for (size_t i = 0; i < capacity_; ++i) {
+			entries_[i].distance_ = EMPTY;
+		}
+	}
+	//-----------------------------------------------------------------------------
+	// Places key at slot i, displaced entries move further along the cluster
+	void emplaceAt(size_t i, int32_t distance, TKey&& key) {
+		const size_t modMask = capacity_ - 1;
+
+		while (entries_[i].distance_ != EMPTY) {
+			if (entries_[i].distance_ < distance) {
+				using std::swap;
+				swap(entries_[i].key_, key);
+				std::swap(entries_[i].distance_, distance);
+			}
+
+			i = (i + 1) & modMask;
+			++distance;
+		}
+
+		new (&entries_[i].key_) TKey(std::move(key));
+		entries_[i].distance_ = distance;
+	}
+	//-----------------------------------------------------------------------------
+	void rehash() {
+		const RehashTimer<TStats> timer(stats_);
+		++exponent_;
+		const size_t oldCapacity = capacity_;
+		capacity_ = static_cast<size_t>(1) << exponent_;
+
+		Entry* oldEntries = entries_;
+
+		allocEntries();
+
+		const size_t modMask = capacity_ - 1;
+		for (size_t i = 0; i < oldCapacity; ++i) {
+			if (oldEntries[i].distance_ != EMPTY) {
+				// Keys are unique, no need to look for duplicates
+				emplaceAt(hasher_(oldEntries[i].key_) & modMask, 0, std::move(oldEntries[i].key_));
+				oldEntries[i].key_.~TKey();
+			}
+		}
+
+		free(oldEntries);
+	}
+	//-----------------------------------------------------------------------------
+	bool keyEquals(const TKey& stored, const TKey& key) const {
+		stats_.onKeyCompare();
+		return equal_(stored, key);
+	}
+	//-----------------------------------------------------------------------------
+	// probeLength receives the number of slots visited, including the one which ended the probe
+	size_t indexOf(const TKey& key, size_t& probeLength) const {
+		const size_t modMask = capacity_ - 1;
+		size_t i = hasher_(key) & modMask;
+
+		// Once we are further from the ideal slot than the stored entry the key cannot be in the table
+		int32_t distance = 0;
+		for (; distance <= entries_[i].distance_; ++distance) {
+			if (distance == entries_[i].distance_ && keyEquals(entries_[i].key_, key)) {
+				probeLength = distance + 1;
+				return i;
+			}
+
+			i = (i + 1) & modMask;
+		}
+
+		probeLength = distance + 1;
+		return NPOS;
+	}
 };
 
 } // namespace hs
@@ -0,0 +1,259 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <chrono>
+
+namespace hs {
+
+//-----------------------------------------------------------------------------
+// Snapshot returned by stats() of the open addressing sets. The counters are only recorded
+// with the ProbeStats policy and stay zero with NoStats, the table shape is always filled in.
+struct HashSetStats {
+	// Histogram bucket b counts lengths in [2^b, 2^(b+1)), the last bucket also everything longer
+	static constexpr size_t HISTOGRAM_BUCKETS = 16;
+
+	// Lookups through contains() and the batch and set operations, inserts and removes are not counted.
+	// A probe length is the number of slots from the home slot to the found key or the empty slot ending the probe.
+	uint64_t lookups{ 0 };
+	uint64_t hits{ 0 };
+	uint64_t probeLengthSum{ 0 };
+	uint64_t probeLengths[HISTOGRAM_BUCKETS]{};
+	// Slots whose fingerprint matched the key, of which falsePositives held a different key.
+	// Counted on every probe including inserts, sets without fingerprints leave them at zero.
+	uint64_t fingerprintMatches{ 0 };
+	uint64_t fingerprintFalsePositives{ 0 };
+	uint64_t keyCompares{ 0 };
+	uint64_t rehashes{ 0 };
+	uint64_t rehashNs{ 0 };
+	uint64_t tombstonePurges{ 0 };
+
+	// Shape of the current table when the snapshot was taken. A cluster is a run of occupied
+	// slots (elements and tombstones) between two empty ones.
+	size_t count{ 0 };
+	size_t capacity{ 0 };
+	size_t tombstones{ 0 };
+	size_t maxClusterLength{ 0 };
+	uint64_t clusterLengths[HISTOGRAM_BUCKETS]{};
+
+	//-----------------------------------------------------------------------------
+	uint64_t misses() const {
+		return lookups - hits;
+	}
+	//-----------------------------------------------------------------------------
+	double hitRatio() const {
+		return lookups ? static_cast<double>(hits) / lookups : 0.0;
+	}
+	//-----------------------------------------------------------------------------
+	double meanProbeLength() const {
+		return lookups ? static_cast<double>(probeLengthSum) / lookups : 0.0;
+	}
+	//-----------------------------------------------------------------------------
+	double fingerprintFalsePositiveRate() const {
+		return fingerprintMatches ? static_cast<double>(fingerprintFalsePositives) / fingerprintMatches : 0.0;
+	}
+	//-----------------------------------------------------------------------------
+	double loadFactor() const {
+		return capacity ? static_cast<double>(count) / capacity : 0.0;
+	}
+	//-----------------------------------------------------------------------------
+	double tombstoneRatio() const {
+		return capacity ? static_cast<double>(tombstones) / capacity : 0.0;
+	}
+	//-----------------------------------------------------------------------------
+	static size_t histogramBucket(size_t length) {
+		size_t bucket = 0;
+		while (bucket + 1 < HISTOGRAM_BUCKETS && (length >> (bucket + 1)) != 0) {
+			++bucket;
+		}
+		return bucket;
+	}
+	//-----------------------------------------------------------------------------
+	// Fills the cluster histogram of a table of any capacity, isOccupied(slot) tells if a slot is not empty.
+	// The scan starts after an empty slot so a cluster wrapping around the end is counted once.
+	template<class TIsOccupied>
+	void scanClusters(size_t tableCapacity, TIsOccupied&& isOccupied) {
+		size_t start = 0;
+		while (start < tableCapacity && isOccupied(start)) {
+			++start;
+		}
+		if (start == tableCapacity) {
+			maxClusterLength = tableCapacity;
+			++clusterLengths[histogramBucket(tableCapacity)];
+			return;
+		}
+
+		size_t length = 0;
+		for (size_t n = 1; n <= tableCapacity; ++n) {
+			const size_t slot = start + n < tableCapacity ? start + n : start + n - tableCapacity;
+			if (isOccupied(slot)) {
+				++length;
+			} else if (length > 0) {
+				++clusterLengths[histogramBucket(length)];
+				maxClusterLength = length > maxClusterLength ? length : maxClusterLength;
+				length = 0;
+			}
+		}
+	}
+};
+
+//-----------------------------------------------------------------------------
+// Stats policies, the TStats parameter of the open addressing sets. The sets call the hooks unconditionally,
+// NoStats has empty inline hooks and no members so the calls compile away, the sets
+// only do extra work for the probe length of a miss if ENABLED is true.
+struct NoStats {
+	static constexpr bool ENABLED = false;
+
+	void onLookup(bool, size_t) const {}
+	void onFingerprintMatch(bool) const {}
+	void onKeyCompare() const {}
+	void onRehash(uint64_t) {}
+	void onTombstonePurge() {}
+	void fill(HashSetStats&) const {}
+	void reset() {}
+};
+
+//-----------------------------------------------------------------------------
+// Records the counters of HashSetStats. Lookups are const and may run concurrently,
+// e.g. under the shared lock of ConcurrentLPHashSet, so the counters are relaxed atomics.
+class ProbeStats {
+public:
+	static constexpr bool ENABLED = true;
+
+	//-----------------------------------------------------------------------------
+	ProbeStats() {
+		reset();
+	}
+	//-----------------------------------------------------------------------------
+	ProbeStats(const ProbeStats&) = delete;
+	ProbeStats& operator=(const ProbeStats&) = delete;
+	//-----------------------------------------------------------------------------
+	// Not thread-safe, like swapping the sets themselves
+	friend void swap(ProbeStats& a, ProbeStats& b) {
+		auto swapCounter = [](std::atomic<uint64_t>& x, std::atomic<uint64_t>& y) {
+			x.store(y.exchange(x.load(std::memory_order_relaxed), std::memory_order_relaxed), std::memory_order_relaxed);
+		};
+		swapCounter(a.lookups_, b.lookups_);
+		swapCounter(a.hits_, b.hits_);
+		swapCounter(a.probeLengthSum_, b.probeLengthSum_);
+		for (size_t i = 0; i < HashSetStats::HISTOGRAM_BUCKETS; ++i) {
+			swapCounter(a.probeLengths_[i], b.probeLengths_[i]);
+		}
+		swapCounter(a.fingerprintMatches_, b.fingerprintMatches_);
+		swapCounter(a.fingerprintFalsePositives_, b.fingerprintFalsePositives_);
+		swapCounter(a.keyCompares_, b.keyCompares_);
+		swapCounter(a.rehashes_, b.rehashes_);
+		swapCounter(a.rehashNs_, b.rehashNs_);
+		swapCounter(a.tombstonePurges_, b.tombstonePurges_);
+	}
+	//-----------------------------------------------------------------------------
+	void onLookup(bool hit, size_t probeLength) const {
+		add(lookups_);
+		if (hit)
+			add(hits_);
+		add(probeLengthSum_, probeLength);
+		add(probeLengths_[HashSetStats::histogramBucket(probeLength)]);
+	}
+	//-----------------------------------------------------------------------------
+	void onFingerprintMatch(bool sameKey) const {
+		add(fingerprintMatches_);
+		if (!sameKey)
+			add(fingerprintFalsePositives_);
+	}
+	//-----------------------------------------------------------------------------
+	void onKeyCompare() const {
+		add(keyCompares_);
+	}
+	//-----------------------------------------------------------------------------
+	void onRehash(uint64_t ns) {
+		add(rehashes_);
+		add(rehashNs_, ns);
+	}
+	//-----------------------------------------------------------------------------
+	void onTombstonePurge() {
+		add(tombstonePurges_);
+	}
+	//-----------------------------------------------------------------------------
+	void fill(HashSetStats& stats) const {
+		stats.lookups = load(lookups_);
+		stats.hits = load(hits_);
+		stats.probeLengthSum = load(probeLengthSum_);
+		for (size_t i = 0; i < HashSetStats::HISTOGRAM_BUCKETS; ++i) {
+			stats.probeLengths[i] = load(probeLengths_[i]);
+		}
+		stats.fingerprintMatches = load(fingerprintMatches_);
+		stats.fingerprintFalsePositives = load(fingerprintFalsePositives_);
+		stats.keyCompares = load(keyCompares_);
+		stats.rehashes = load(rehashes_);
+		stats.rehashNs = load(rehashNs_);
+		stats.tombstonePurges = load(tombstonePurges_);
+	}
+	//-----------------------------------------------------------------------------
+	void reset() {
+		lookups_ = 0;
+		hits_ = 0;
+		probeLengthSum_ = 0;
+		for (auto& bucket : probeLengths_) {
+			bucket = 0;
+		}
+		fingerprintMatches_ = 0;
+		fingerprintFalsePositives_ = 0;
+		keyCompares_ = 0;
+		rehashes_ = 0;
+		rehashNs_ = 0;
+		tombstonePurges_ = 0;
+	}
+
+private:
+	mutable std::atomic<uint64_t> lookups_;
+	mutable std::atomic<uint64_t> hits_;
+	mutable std::atomic<uint64_t> probeLengthSum_;
+	mutable std::atomic<uint64_t> probeLengths_[HashSetStats::HISTOGRAM_BUCKETS];
+	mutable std::atomic<uint64_t> fingerprintMatches_;
+	mutable std::atomic<uint64_t> fingerprintFalsePositives_;
+	mutable std::atomic<uint64_t> keyCompares_;
+	std::atomic<uint64_t> rehashes_;
+	std::atomic<uint64_t> rehashNs_;
+	std::atomic<uint64_t> tombstonePurges_;
+
+	//-----------------------------------------------------------------------------
+	static void add(std::atomic<uint64_t>& counter, uint64_t value = 1) {
+		counter.fetch_add(value, std::memory_order_relaxed);
+	}
+	//-----------------------------------------------------------------------------
+	static uint64_t load(const std::atomic<uint64_t>& counter) {
+		return counter.load(std::memory_order_relaxed);
+	}
+};
+
+//-----------------------------------------------------------------------------
+// Times a rehash for the stats policy, reads no clock with NoStats
+template<class TStats>
+class RehashTimer {
+public:
+	explicit RehashTimer(TStats& stats)
+		: stats_(stats)
+	{
+		if constexpr (TStats::ENABLED)
+			start_ = std::chrono::steady_clock::now();
+	}
+
+	~RehashTimer() {
+		if constexpr (TStats::ENABLED) {
+			const auto elapsed = std::chrono::steady_clock::now() - start_;
+			stats_.onRehash(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+		} else {
+			stats_.onRehash(0);
+		}
+	}
+
+	RehashTimer(const RehashTimer&) = delete;
+	RehashTimer& operator=(const RehashTimer&) = delete;
+
+private:
+	TStats& stats_;
+	std::chrono::steady_clock::time_point start_;
+};
+
+} // namespace hs
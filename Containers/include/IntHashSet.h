@@ -0,0 +1,523 @@
+#pragma once
+
+#include "Allocators.h"
+#include "HashFunc.h"
+#include "HashSetStats.h"
+#include "LinearProbingHashSet.h"
+#include "Platform.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+#include <emmintrin.h>
+#include <immintrin.h>
+
+namespace hs {
+
+//-----------------------------------------------------------------------------
+// Linear probing set of 32 or 64 bit integers without a metadata array. Two key values
+// are reserved as sentinels for empty slots and tombstones, so a probe reads only the key
+// array and the SIMD kernels compare 4-16 keys per instruction directly. Keys which equal
+// a sentinel are kept in two flags outside of the table, every value can be inserted.
+// For TStats see HashSetStats.h.
+template<class TKey, LPHashSetPolicy Policy = LPHashSetPolicy::Auto, class THash = Hasher<TKey>, class TAllocator = AlignedAllocator, class TStats = NoStats>
+class IntHashSet {
+	static_assert(std::is_integral<TKey>::value && (sizeof(TKey) == 4 || sizeof(TKey) == 8), "IntHashSet holds 32 or 64 bit integers");
+	static_assert(Policy != LPHashSetPolicy::Grouped, "IntHashSet only implements the linear probing policies");
+
+public:
+	//-----------------------------------------------------------------------------
+	IntHashSet()
+		: IntHashSet(0)
+	{}
+	//-----------------------------------------------------------------------------
+	// Sizes the table so elementCount elements fit without a rehash
+	explicit IntHashSet(size_t elementCount, const THash& hasher = THash(), const TAllocator& allocator = TAllocator())
+		: hasher_(hasher)
+		, allocator_(allocator)
+		, count_(0)
+		, tombstones_(0)
+		, hasEmptyKey_(false)
+		, hasTombstoneKey_(false)
+		, exponent_(MIN_EXPONENT)
+	{
+		while (static_cast<float>(elementCount) > MAX_LOAD_FACTOR * (static_cast<size_t>(1) << exponent_)) {
+			++exponent_;
+		}
+		capacity_ = static_cast<size_t>(1) << exponent_;
+		keys_ = allocKeys(capacity_);
+	}
+	//-----------------------------------------------------------------------------
+	~IntHashSet() {
+		allocator_.deallocate(keys_, sizeof(TKey) * capacity_);
+	}
+	//-----------------------------------------------------------------------------
+	IntHashSet(const IntHashSet&) = delete;
+	IntHashSet& operator=(const IntHashSet&) = delete;
+	//-----------------------------------------------------------------------------
+	void insert(TKey key) {
+		if (key == EMPTY_KEY || key == TOMBSTONE_KEY) {
+			(key == EMPTY_KEY ? hasEmptyKey_ : hasTombstoneKey_) = true;
+			return;
+		}
+
+		TKey* insertSpot = findInsertSpotTemplate(key);
+		// The key is already present
+		if (insertSpot == nullptr)
+			return;
+
+		if (*insertSpot == TOMBSTONE_KEY)
+			--tombstones_;
+		*insertSpot = key;
+		++count_;
+
+		if (count_ > MAX_LOAD_FACTOR * capacity_) {
+			rehash(exponent_ + 1);
+		} else if (tombstones_ > MAX_TOMBSTONE_FACTOR * capacity_) {
+			rehash(exponent_);
+		}
+	}
+	//-----------------------------------------------------------------------------
+	void remove(TKey key) {
+		if (key == EMPTY_KEY || key == TOMBSTONE_KEY) {
+			(key == EMPTY_KEY ? hasEmptyKey_ : hasTombstoneKey_) = false;
+			return;
+		}
+
+		const size_t idx = indexOfTemplate(key);
+		if (idx == NPOS)
+			return;
+
+		// If the next slot is empty no probe sequence continues past idx so it does not need a tombstone
+		if (keys_[(idx + 1) & (capacity_ - 1)] == EMPTY_KEY) {
+			keys_[idx] = EMPTY_KEY;
+		} else {
+			keys_[idx] = TOMBSTONE_KEY;
+			++tombstones_;
+		}
+		--count_;
+	}
+	//-----------------------------------------------------------------------------
+	bool contains(TKey key) const {
+		if (key == EMPTY_KEY)
+			return hasEmptyKey_;
+		if (key == TOMBSTONE_KEY)
+			return hasTombstoneKey_;
+
+		const size_t idx = indexOfTemplate(key);
+		recordLookup(key, idx);
+		return idx != NPOS;
+	}
+	//-----------------------------------------------------------------------------
+	size_t count() const {
+		return count_ + hasEmptyKey_ + hasTombstoneKey_;
+	}
+	//-----------------------------------------------------------------------------
+	size_t capacity() const {
+		return capacity_;
+	}
+	//-----------------------------------------------------------------------------
+	// See HashSetStats. Keys equal to a sentinel live outside of the table and are only part of count.
+	HashSetStats stats() const {
+		HashSetStats result;
+		stats_.fill(result);
+		result.count = count();
+		result.capacity = capacity_;
+		result.tombstones = tombstones_;
+		result.scanClusters(capacity_, [&](size_t i) { return keys_[i] != EMPTY_KEY; });
+		return result;
+	}
+	//-----------------------------------------------------------------------------
+	void resetStats() {
+		stats_.reset();
+	}
+
+private:
+	using UKey = typename std::make_unsigned<TKey>::type;
+
+	// All ones, lets a table be cleared with memset
+	static constexpr TKey EMPTY_KEY = static_cast<TKey>(~static_cast<UKey>(0));
+	static constexpr TKey TOMBSTONE_KEY = static_cast<TKey>(~static_cast<UKey>(0) - 1);
+	static constexpr float MAX_LOAD_FACTOR = 0.8f;
+	// See LPHashSet::MAX_TOMBSTONE_FACTOR
+	static constexpr float MAX_TOMBSTONE_FACTOR = 0.125f;
+	static constexpr size_t NPOS = -1;
+	// A table holds at least one group of the widest kernel, 64 bytes
+	static constexpr size_t MIN_EXPONENT = 5;
+	static constexpr size_t GROUP_ALIGNMENT =
+		Policy == LPHashSetPolicy::Simple ? 1 :
+		Policy == LPHashSetPolicy::SSE ? 16 :
+		Policy == LPHashSetPolicy::AVX ? 32 : 64;
+	static_assert(TAllocator::ALIGNMENT >= GROUP_ALIGNMENT, "Allocator alignment is too small for the SIMD policy");
+
+	THash hasher_;
+	TAllocator allocator_;
+	size_t count_;		// Keys in the table, without the sentinel valued ones
+	size_t tombstones_;
+	bool hasEmptyKey_;
+	bool hasTombstoneKey_;
+	size_t capacity_;
+	size_t exponent_;
+	TKey* keys_;
+
+	TStats stats_;
+
+	//-----------------------------------------------------------------------------
+	// Same slot bits as LPHashSet so both tables see the same probe sequences
+	static Hash_t computeHashHigh(Hash_t hash) {
+		return hash >> 8;
+	}
+	//-----------------------------------------------------------------------------
+	TKey* allocKeys(size_t capacity) {
+		TKey* keys = static_cast<TKey*>(allocator_.allocate(sizeof(TKey) * capacity));
+		memset(keys, 0xFF, sizeof(TKey) * capacity);
+		return keys;
+	}
+	//-----------------------------------------------------------------------------
+	// Also used with the same exponent to drop all tombstones
+	void rehash(size_t newExponent) {
+		const RehashTimer<TStats> timer(stats_);
+		const size_t oldCapacity = capacity_;
+		TKey* oldKeys = keys_;
+
+		exponent_ = newExponent;
+		capacity_ = static_cast<size_t>(1) << exponent_;
+		keys_ = allocKeys(capacity_);
+		tombstones_ = 0;
+
+		const Hash_t modMask = capacity_ - 1;
+		for (size_t i = 0; i < oldCapacity; ++i) {
+			const TKey key = oldKeys[i];
+			if (key == EMPTY_KEY || key == TOMBSTONE_KEY)
+				continue;
+
+			// Keys are unique, see LPHashSet::rehash()
+			Hash_t target = computeHashHigh(hasher_(key)) & modMask;
+			while (keys_[target] != EMPTY_KEY) {
+				target = (target + 1) & modMask;
+			}
+			keys_[target] = key;
+		}
+
+		allocator_.deallocate(oldKeys, sizeof(TKey) * oldCapacity);
+	}
+	//-----------------------------------------------------------------------------
+	// Reports a lookup of a table key to the stats policy, a miss is walked again to its empty slot
+	void recordLookup(TKey key, size_t idx) const {
+		if constexpr (TStats::ENABLED) {
+			const Hash_t modMask = capacity_ - 1;
+			const Hash_t startIndex = computeHashHigh(hasher_(key)) & modMask;
+			const bool hit = idx != NPOS;
+			if (!hit) {
+				idx = startIndex;
+				for (size_t n = 1; n < capacity_ && keys_[idx] != EMPTY_KEY; ++n) {
+					idx = (idx + 1) & modMask;
+				}
+			}
+			stats_.onLookup(hit, ((idx - startIndex) & modMask) + 1);
+		}
+	}
+	//-----------------------------------------------------------------------------
+	// Returns the slot to write the key to - the first tombstone or empty slot of the
+	// probe sequence - or nullptr if the key is already present
+	TKey* findInsertSpot(TKey key) {
+		const Hash_t modMask = capacity_ - 1;
+		size_t firstFree = NPOS;
+		for (Hash_t i = computeHashHigh(hasher_(key)) & modMask;; i = (i + 1) & modMask) {
+			if (keys_[i] == key)
+				return nullptr;
+			if (keys_[i] == TOMBSTONE_KEY && firstFree == NPOS)
+				firstFree = i;
+			if (keys_[i] == EMPTY_KEY)
+				return &keys_[firstFree != NPOS ? firstFree : i];
+			// Always ends at an empty slot, see MAX_TOMBSTONE_FACTOR
+		}
+	}
+	//-----------------------------------------------------------------------------
+	size_t indexOf(TKey key) const {
+		const Hash_t modMask = capacity_ - 1;
+		const Hash_t startIndex = computeHashHigh(hasher_(key)) & modMask;
+
+		for (Hash_t i = startIndex;;) {
+			if (keys_[i] == key)
+				return i;
+			if (keys_[i] == EMPTY_KEY)
+				return NPOS;
+
+			i = (i + 1) & modMask;
+			if (i == startIndex) // Wrap around is possible if the table is full of tombstones
+				return NPOS;
+		}
+	}
+	//-----------------------------------------------------------------------------
+	// Lane masks of the SIMD compares, one bit per key
+	static __m128i broadcastSSE(TKey key) {
+		if constexpr (sizeof(TKey) == 4) {
+			return _mm_set1_epi32(static_cast<int>(key));
+		} else {
+			return _mm_set1_epi64x(static_cast<long long>(key));
+		}
+	}
+	//-----------------------------------------------------------------------------
+	static uint32_t matchSSE(__m128i group, __m128i value) {
+		const __m128i eq = _mm_cmpeq_epi32(group, value);
+		if constexpr (sizeof(TKey) == 4) {
+			return static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(eq)));
+		} else {
+			// SSE2 has no 64 bit compare, both halves have to match
+			const __m128i eq64 = _mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2, 3, 0, 1)));
+			return static_cast<uint32_t>(_mm_movemask_pd(_mm_castsi128_pd(eq64)));
+		}
+	}
+	//-----------------------------------------------------------------------------
+	HS_TARGET_AVX2
+	static __m256i broadcastAVX(TKey key) {
+		if constexpr (sizeof(TKey) == 4) {
+			return _mm256_set1_epi32(static_cast<int>(key));
+		} else {
+			return _mm256_set1_epi64x(static_cast<long long>(key));
+		}
+	}
+	//-----------------------------------------------------------------------------
+	HS_TARGET_AVX2
+	static uint32_t matchAVX(__m256i group, __m256i value) {
+		if constexpr (sizeof(TKey) == 4) {
+			return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(group, value))));
+		} else {
+			return static_cast<uint32_t>(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(group, value))));
+		}
+	}
+	//-----------------------------------------------------------------------------
+	HS_TARGET_AVX512
+	static __m512i broadcastAVX512(TKey key) {
+		if constexpr (sizeof(TKey) == 4) {
+			return _mm512_set1_epi32(static_cast<int>(key));
+		} else {
+			return _mm512_set1_epi64(static_cast<long long>(key));
+		}
+	}
+	//-----------------------------------------------------------------------------
+	HS_TARGET_AVX512
+	static uint32_t matchAVX512(__m512i group, __m512i value) {
+		if constexpr (sizeof(TKey) == 4) {
+			return _mm512_cmpeq_epi32_mask(group, value);
+		} else {
+			return _mm512_cmpeq_epi64_mask(group, value);
+		}
+	}
+	//-----------------------------------------------------------------------------
+	// The SIMD kernels probe whole aligned groups. Keys are unique so a match anywhere in a
+	// group is a hit, only the empty slots of the first group before startIndex are not
+	// part of the probe sequence and must not end it.
+	size_t indexOfSSE(TKey key) const {
+		constexpr size_t LANES = 16 / sizeof(TKey);
+		constexpr uint32_t FULL_MASK = (1u << LANES) - 1;
+		const Hash_t startIndex = computeHashHigh(hasher_(key)) & (capacity_ - 1);
+		const Hash_t groupMask = capacity_ / LANES - 1;
+		const Hash_t start = startIndex / LANES;
+
+		const __m128i keyValue = broadcastSSE(key);
+		const __m128i emptyValue = broadcastSSE(EMPTY_KEY);
+
+		uint32_t probeMask = (FULL_MASK << (startIndex % LANES)) & FULL_MASK;
+		for (Hash_t i = start;;) {
+			const __m128i group = _mm_load_si128(reinterpret_cast<const __m128i*>(keys_ + i * LANES));
+			unsigned long lane;
+			if (bitScanForward(&lane, matchSSE(group, keyValue)))
+				return i * LANES + lane;
+			if (matchSSE(group, emptyValue) & probeMask)
+				return NPOS;
+
+			probeMask = FULL_MASK;
+			i = (i + 1) & groupMask;
+			if (i == start) // Wrap around is possible if the table is full of tombstones
+				return NPOS;
+		}
+	}
+	//-----------------------------------------------------------------------------
+	HS_TARGET_AVX2
+	size_t indexOfAVX(TKey key) const {
+		constexpr size_t LANES = 32 / sizeof(TKey);
+		constexpr uint32_t FULL_MASK = (1u << LANES) - 1;
+		const Hash_t startIndex = computeHashHigh(hasher_(key)) & (capacity_ - 1);
+		const Hash_t groupMask = capacity_ / LANES - 1;
+		const Hash_t start = startIndex / LANES;
+
+		const __m256i keyValue = broadcastAVX(key);
+		const __m256i emptyValue = broadcastAVX(EMPTY_KEY);
+
+		uint32_t probeMask = (FULL_MASK << (startIndex % LANES)) & FULL_MASK;
+		for (Hash_t i = start;;) {
+			const __m256i group = _mm256_load_si256(reinterpret_cast<const __m256i*>(keys_ + i * LANES));
+			unsigned long lane;
+			if (bitScanForward(&lane, matchAVX(group, keyValue)))
+				return i * LANES + lane;
+			if (matchAVX(group, emptyValue) & probeMask)
+				return NPOS;
+
+			probeMask = FULL_MASK;
+			i = (i + 1) & groupMask;
+			if (i == start) // Wrap around is possible if the table is full of tombstones
+				return NPOS;
+		}
+	}
+	//-----------------------------------------------------------------------------
+	HS_TARGET_AVX512
+	size_t indexOfAVX512(TKey key) const {
+		constexpr size_t LANES = 64 / sizeof(TKey);
+		constexpr uint32_t FULL_MASK = (1u << LANES) - 1;
+		const Hash_t startIndex = computeHashHigh(hasher_(key)) & (capacity_ - 1);
+		const Hash_t groupMask = capacity_ / LANES - 1;
+		const Hash_t start = startIndex / LANES;
+
+		const __m512i keyValue = broadcastAVX512(key);
+		const __m512i emptyValue = broadcastAVX512(EMPTY_KEY);
+
+		uint32_t probeMask = (FULL_MASK << (startIndex % LANES)) & FULL_MASK;
+		for (Hash_t i = start;;) {
+			const __m512i group = _mm512_load_si512(keys_ + i * LANES);
+			unsigned long lane;
+			if (bitScanForward(&lane, matchAVX512(group, keyValue)))
+				return i * LANES + lane;
+			if (matchAVX512(group, emptyValue) & probeMask)
+				return NPOS;
+
+			probeMask = FULL_MASK;
+			i = (i + 1) & groupMask;
+			if (i == start) // Wrap around is possible if the table is full of tombstones
+				return NPOS;
+		}
+	}
+	//-----------------------------------------------------------------------------
+	// A free slot of a group is usable only if no empty slot comes before it in the probe order,
+	// the lowest free lane of the first group that has one is exactly that slot
+	TKey* findInsertSpotSSE(TKey key) {
+		constexpr size_t LANES = 16 / sizeof(TKey);
+		constexpr uint32_t FULL_MASK = (1u << LANES) - 1;
+		const Hash_t startIndex = computeHashHigh(hasher_(key)) & (capacity_ - 1);
+		const Hash_t groupMask = capacity_ / LANES - 1;
+
+		const __m128i keyValue = broadcastSSE(key);
+		const __m128i emptyValue = broadcastSSE(EMPTY_KEY);
+		const __m128i tombstoneValue = broadcastSSE(TOMBSTONE_KEY);
+
+		uint32_t probeMask = (FULL_MASK << (startIndex % LANES)) & FULL_MASK;
+		size_t firstFree = NPOS;
+		for (Hash_t i = startIndex / LANES;;) {
+			const __m128i group = _mm_load_si128(reinterpret_cast<const __m128i*>(keys_ + i * LANES));
+			if (matchSSE(group, keyValue))
+				return nullptr;
+
+			const uint32_t emptyMask = matchSSE(group, emptyValue) & probeMask;
+			unsigned long lane;
+			if (firstFree == NPOS && bitScanForward(&lane, emptyMask | (matchSSE(group, tombstoneValue) & probeMask)))
+				firstFree = i * LANES + lane;
+			if (emptyMask)
+				return &keys_[firstFree];
+
+			probeMask = FULL_MASK;
+			i = (i + 1) & groupMask;
+			// Always ends at an empty slot, see MAX_TOMBSTONE_FACTOR
+		}
+	}
+	//-----------------------------------------------------------------------------
+	HS_TARGET_AVX2
+	TKey* findInsertSpotAVX(TKey key) {
+		constexpr size_t LANES = 32 / sizeof(TKey);
+		constexpr uint32_t FULL_MASK = (1u << LANES) - 1;
+		const Hash_t startIndex = computeHashHigh(hasher_(key)) & (capacity_ - 1);
+		const Hash_t groupMask = capacity_ / LANES - 1;
+
+		const __m256i keyValue = broadcastAVX(key);
+		const __m256i emptyValue = broadcastAVX(EMPTY_KEY);
+		const __m256i tombstoneValue = broadcastAVX(TOMBSTONE_KEY);
+
+		uint32_t probeMask = (FULL_MASK << (startIndex % LANES)) & FULL_MASK;
+		size_t firstFree = NPOS;
+		for (Hash_t i = startIndex / LANES;;) {
+			const __m256i group = _mm256_load_si256(reinterpret_cast<const __m256i*>(keys_ + i * LANES));
+			if (matchAVX(group, keyValue))
+				return nullptr;
+
+			const uint32_t emptyMask = matchAVX(group, emptyValue) & probeMask;
+			unsigned long lane;
+			if (firstFree == NPOS && bitScanForward(&lane, emptyMask | (matchAVX(group, tombstoneValue) & probeMask)))
+				firstFree = i * LANES + lane;
+			if (emptyMask)
+				return &keys_[firstFree];
+
+			probeMask = FULL_MASK;
+			i = (i + 1) & groupMask;
+		}
+	}
+	//-----------------------------------------------------------------------------
+	HS_TARGET_AVX512
+	TKey* findInsertSpotAVX512(TKey key) {
+		constexpr size_t LANES = 64 / sizeof(TKey);
+		constexpr uint32_t FULL_MASK = (1u << LANES) - 1;
+		const Hash_t startIndex = computeHashHigh(hasher_(key)) & (capacity_ - 1);
+		const Hash_t groupMask = capacity_ / LANES - 1;
+
+		const __m512i keyValue = broadcastAVX512(key);
+		const __m512i emptyValue = broadcastAVX512(EMPTY_KEY);
+		const __m512i tombstoneValue = broadcastAVX512(TOMBSTONE_KEY);
+
+		uint32_t probeMask = (FULL_MASK << (startIndex % LANES)) & FULL_MASK;
+		size_t firstFree = NPOS;
+		for (Hash_t i = startIndex / LANES;;) {
+			const __m512i group = _mm512_load_si512(keys_ + i * LANES);
+			if (matchAVX512(group, keyValue))
+				return nullptr;
+
+			const uint32_t emptyMask = matchAVX512(group, emptyValue) & probeMask;
+			unsigned long lane;
+			if (firstFree == NPOS && bitScanForward(&lane, emptyMask | (matchAVX512(group, tombstoneValue) & probeMask)))
+				firstFree = i * LANES + lane;
+			if (emptyMask)
+				return &keys_[firstFree];
+
+			probeMask = FULL_MASK;
+			i = (i + 1) & groupMask;
+		}
+	}
+	//-----------------------------------------------------------------------------
+	TKey* findInsertSpotTemplate(TKey key) {
+		if constexpr (Policy == LPHashSetPolicy::SSE) {
+			return findInsertSpotSSE(key);
+		} else if constexpr (Policy == LPHashSetPolicy::AVX) {
+			return findInsertSpotAVX(key);
+		} else if constexpr (Policy == LPHashSetPolicy::AVX512) {
+			return findInsertSpotAVX512(key);
+		} else if constexpr (Policy == LPHashSetPolicy::Auto) {
+			switch (g_SimdLevel) {
+				case SimdLevel::AVX512:	return findInsertSpotAVX512(key);
+				case SimdLevel::AVX2:	return findInsertSpotAVX(key);
+				case SimdLevel::SSE2:	return findInsertSpotSSE(key);
+				default:				return findInsertSpot(key);
+			}
+		} else {
+			return findInsertSpot(key);
+		}
+	}
+	//-----------------------------------------------------------------------------
+	size_t indexOfTemplate(TKey key) const {
+		if constexpr (Policy == LPHashSetPolicy::SSE) {
+			return indexOfSSE(key);
+		} else if constexpr (Policy == LPHashSetPolicy::AVX) {
+			return indexOfAVX(key);
+		} else if constexpr (Policy == LPHashSetPolicy::AVX512) {
+			return indexOfAVX512(key);
+		} else if constexpr (Policy == LPHashSetPolicy::Auto) {
+			switch (g_SimdLevel) {
+				case SimdLevel::AVX512:	return indexOfAVX512(key);
+				case SimdLevel::AVX2:	return indexOfAVX(key);
+				case SimdLevel::SSE2:	return indexOfSSE(key);
+				default:				return indexOf(key);
+			}
+		} else {
+			return indexOf(key);
+		}
+	}
+};
+
+} // namespace hs
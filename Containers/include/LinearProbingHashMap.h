@@ -0,0 +1,456 @@
+#pragma once
+
+#include "Allocators.h"
+#include "HashFunc.h"
+#include "HashSetStats.h"
+#include "LinearProbingHashSet.h"
+#include "TableGrowth.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+#include <iterator>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace hs {
+
+//-----------------------------------------------------------------------------
+// Slot of an LPHashMap which keeps its values next to the keys
+template<class TKey, class TValue>
+struct LPHashMapEntry {
+	TKey key;
+	TValue value;
+
+	//-----------------------------------------------------------------------------
+	// Tagged so the forwarding constructor never competes with the copy and move constructors
+	template<class K, class... Args>
+	LPHashMapEntry(std::in_place_t, K&& k, Args&&... args)
+		: key(std::forward<K>(k))
+		, value(std::forward<Args>(args)...)
+	{}
+};
+
+template<class TKey, class TValue>
+struct IsTriviallyRelocatable<LPHashMapEntry<TKey, TValue>>
+	: std::integral_constant<bool, IsTriviallyRelocatable<TKey>::value && IsTriviallyRelocatable<TValue>::value> {};
+
+//-----------------------------------------------------------------------------
+// Hashes an entry by its key, any other type goes to THash as is
+template<class THash, class TEntry>
+struct EntryHasher {
+	using is_transparent = void;
+
+	THash hasher_;
+
+	//-----------------------------------------------------------------------------
+	Hash_t operator()(const TEntry& entry) const {
+		return hasher_(entry.key);
+	}
+	//-----------------------------------------------------------------------------
+	template<class K>
+	Hash_t operator()(const K& key) const {
+		return hasher_(key);
+	}
+};
+
+//-----------------------------------------------------------------------------
+// Compares a stored entry by its key with another entry or a lookup key
+template<class TEqual, class TEntry>
+struct EntryEqual {
+	using is_transparent = void;
+
+	TEqual equal_;
+
+	//-----------------------------------------------------------------------------
+	bool operator()(const TEntry& a, const TEntry& b) const {
+		return equal_(a.key, b.key);
+	}
+	//-----------------------------------------------------------------------------
+	template<class K>
+	bool operator()(const TEntry& entry, const K& key) const {
+		return equal_(entry.key, key);
+	}
+};
+
+//-----------------------------------------------------------------------------
+// Hash map on the LPHashTable engine of LPHashSet, same policies, probes and rehashing.
+// By default a slot holds an LPHashMapEntry, a hit finds its value in the cache line of the key.
+// SeparateValues keeps the keys dense and the values in a parallel array instead, probes then
+// scan more keys per cache line and values of any alignment waste no padding.
+// Besides the std::unordered_map style operator[], insertOrAssign() and tryEmplace() the map
+// has upsert() and accumulate() for aggregations, in single and batched form. The batches hash
+// and prefetch a window of keys ahead of their probes like LPHashSet::containsBatch().
+// Values move with their keys on rehashes, so pointers returned by find() and references from
+// operator[] only stay valid until the next insert. Maps can not be saved.
+template<class TKey, class TValue, LPHashSetPolicy Policy = LPHashSetPolicy::Auto, class THash = Hasher<TKey>, class TEqual = std::equal_to<>, class TAllocator = AlignedAllocator, bool SeparateValues = false, class TStats = NoStats, class TGrowth = PowerOfTwoGrowth>
+class LPHashMap {
+public:
+	using Entry = LPHashMapEntry<TKey, TValue>;
+	using Table = std::conditional_t<SeparateValues,
+		LPHashTable<TKey, TValue, Policy, THash, TEqual, TAllocator, false, TStats, TGrowth>,
+		LPHashTable<Entry, void, Policy, EntryHasher<THash, Entry>, EntryEqual<TEqual, Entry>, TAllocator, false, TStats, TGrowth>>;
+
+	//-----------------------------------------------------------------------------
+	// Sizes the map so elementCount elements fit without a rehash
+	explicit LPHashMap(size_t elementCount = 0, const THash& hasher = THash(), const TEqual& equal = TEqual(), const TAllocator& allocator = TAllocator())
+		: table_(elementCount, tableHasher(hasher), tableEqual(equal), allocator)
+	{}
+
+	//-----------------------------------------------------------------------------
+	// Value of key, nullptr if key is not present
+	TValue* find(const TKey& key) {
+		return findImpl(key);
+	}
+	//-----------------------------------------------------------------------------
+	const TValue* find(const TKey& key) const {
+		return findImpl(key);
+	}
+	//-----------------------------------------------------------------------------
+	// Heterogeneous lookup, e.g. find(std::string_view) on a map with std::string keys
+	template<class K, EnableIfTransparent<THash, TEqual, K, TKey> = 0>
+	TValue* find(const K& key) {
+		return findImpl(key);
+	}
+	//-----------------------------------------------------------------------------
+	template<class K, EnableIfTransparent<THash, TEqual, K, TKey> = 0>
+	const TValue* find(const K& key) const {
+		return findImpl(key);
+	}
+	//-----------------------------------------------------------------------------
+	bool contains(const TKey& key) const {
+		return findImpl(key) != nullptr;
+	}
+	//-----------------------------------------------------------------------------
+	template<class K, EnableIfTransparent<THash, TEqual, K, TKey> = 0>
+	bool contains(const K& key) const {
+		return findImpl(key) != nullptr;
+	}
+	//-----------------------------------------------------------------------------
+	// Value of key, a value initialized one is inserted if key is not present.
+	// Also takes the types a key can be converted to.
+	TValue& operator[](const TKey& key) {
+		return *valueOf(findOrInsert(key, table_.hasher_(key)).first);
+	}
+	//-----------------------------------------------------------------------------
+	// Moves key into the map or, with transparent functors, constructs the key only on an insert
+	template<class K, std::enable_if_t<IsLookupKey<THash, TEqual, K, TKey>::value, int> = 0>
+	TValue& operator[](K&& key) {
+		const Hash_t hash = table_.hasher_(key);
+		return *valueOf(findOrInsert(std::forward<K>(key), hash).first);
+	}
+	//-----------------------------------------------------------------------------
+	// Inserts key with a value constructed from args if key is not present, an existing value is
+	// left untouched and args are not used. Returns true if the element was inserted.
+	template<class K, class... Args, std::enable_if_t<IsLookupKey<THash, TEqual, K, TKey>::value, int> = 0>
+	bool tryEmplace(K&& key, Args&&... args) {
+		const Hash_t hash = table_.hasher_(key);
+		return findOrInsert(std::forward<K>(key), hash, std::forward<Args>(args)...).second;
+	}
+	//-----------------------------------------------------------------------------
+	// Inserts key with value or assigns value to the present one. Returns true if the element was inserted.
+	template<class K, class V, std::enable_if_t<IsLookupKey<THash, TEqual, K, TKey>::value, int> = 0>
+	bool insertOrAssign(K&& key, V&& value) {
+		const Hash_t hash = table_.hasher_(key);
+		if (Stored* found = findStored(key, hash)) {
+			*valueOf(found) = std::forward<V>(value);
+			return false;
+		}
+		insertAbsent(std::forward<K>(key), hash, std::forward<V>(value));
+		return true;
+	}
+	//-----------------------------------------------------------------------------
+	// Calls update(TValue&) on the value of key, a key which is not present starts out with a value
+	// initialized TValue. A single probe for both cases. Returns true if the element was inserted.
+	template<class K, class TUpdate, std::enable_if_t<IsLookupKey<THash, TEqual, K, TKey>::value, int> = 0>
+	bool upsert(K&& key, TUpdate&& update) {
+		const Hash_t hash = table_.hasher_(key);
+		const auto [element, inserted] = findOrInsert(std::forward<K>(key), hash);
+		update(*valueOf(element));
+		return inserted;
+	}
+	//-----------------------------------------------------------------------------
+	// Adds delta to the value of key, e.g. the SUM of a GROUP BY
+	template<class K, class TDelta, std::enable_if_t<IsLookupKey<THash, TEqual, K, TKey>::value, int> = 0>
+	void accumulate(K&& key, const TDelta& delta) {
+		upsert(std::forward<K>(key), [&](TValue& value) { value += delta; });
+	}
+	//-----------------------------------------------------------------------------
+	// upsert() of keys[0..count) with update(TValue&, size_t i). The keys of a window are hashed
+	// and their home slots prefetched before the first of them is probed, so the cache misses of
+	// the window overlap. Keys repeated in a batch see the updates of their earlier occurrences.
+	template<class TUpdate>
+	void upsertBatch(const TKey* keys, size_t count, TUpdate&& update) {
+		Hash_t hashes[Table::BATCH_WINDOW];
+		for (size_t base = 0; base < count; base += Table::BATCH_WINDOW) {
+			const size_t windowSize = count - base < Table::BATCH_WINDOW ? count - base : Table::BATCH_WINDOW;
+			// The prefetches need arrays, an insert of the window may replace them but never frees memory still in use
+			table_.ensureArrays();
+			for (size_t i = 0; i < windowSize; ++i) {
+				hashes[i] = table_.hasher_(keys[base + i]);
+				table_.prefetchHome(hashes[i]);
+			}
+			for (size_t i = 0; i < windowSize; ++i) {
+				update(*valueOf(findOrInsert(keys[base + i], hashes[i]).first), base + i);
+			}
+		}
+	}
+	//-----------------------------------------------------------------------------
+	// Adds deltas[i] to the value of keys[i] for every i in [0, count)
+	template<class TDelta>
+	void accumulateBatch(const TKey* keys, const TDelta* deltas, size_t count) {
+		upsertBatch(keys, count, [&](TValue& value, size_t i) { value += deltas[i]; });
+	}
+	//-----------------------------------------------------------------------------
+	// Adds one to the value of every key in keys[0..count), the COUNT of a GROUP BY
+	void countBatch(const TKey* keys, size_t count) {
+		upsertBatch(keys, count, [](TValue& value, size_t) { ++value; });
+	}
+	//-----------------------------------------------------------------------------
+	void remove(const TKey& key) {
+		table_.removeImpl(key);
+	}
+	//-----------------------------------------------------------------------------
+	template<class K, EnableIfTransparent<THash, TEqual, K, TKey> = 0>
+	void remove(const K& key) {
+		table_.removeImpl(key);
+	}
+	//-----------------------------------------------------------------------------
+	// Removes every element for which pred(const TKey&, const TValue&) returns true, e.g. the HAVING
+	// of an aggregation. Returns the removed count.
+	template<class TPred>
+	size_t eraseIf(TPred&& pred) {
+		return table_.eraseIf([&](const Stored& element) {
+			return pred(keyOf(element), static_cast<const TValue&>(*valueOf(&element)));
+		});
+	}
+	//-----------------------------------------------------------------------------
+	// Calls func(const TKey&, TValue&) for every element
+	template<class TFunc>
+	void forEach(TFunc&& func) {
+		table_.forEach([&](const Stored& element) { func(keyOf(element), *valueOf(&element)); });
+	}
+	//-----------------------------------------------------------------------------
+	// Calls func(const TKey&, const TValue&) for every element
+	template<class TFunc>
+	void forEach(TFunc&& func) const {
+		table_.forEach([&](const Stored& element) { func(keyOf(element), static_cast<const TValue&>(*valueOf(&element))); });
+	}
+	//-----------------------------------------------------------------------------
+	size_t count() const {
+		return table_.count();
+	}
+	//-----------------------------------------------------------------------------
+	size_t capacity() const {
+		return table_.capacity();
+	}
+	//-----------------------------------------------------------------------------
+	// See LPHashSet::reserve()
+	void reserve(size_t elementCount, size_t threadCount = 0) {
+		table_.reserve(elementCount, threadCount);
+	}
+	//-----------------------------------------------------------------------------
+	void shrinkToFit() {
+		table_.shrinkToFit();
+	}
+	//-----------------------------------------------------------------------------
+	void setMaxLoadFactor(float maxLoadFactor) {
+		table_.setMaxLoadFactor(maxLoadFactor);
+	}
+	//-----------------------------------------------------------------------------
+	float maxLoadFactor() const {
+		return table_.maxLoadFactor();
+	}
+	//-----------------------------------------------------------------------------
+	void setMinLoadFactor(float minLoadFactor) {
+		table_.setMinLoadFactor(minLoadFactor);
+	}
+	//-----------------------------------------------------------------------------
+	// See LPHashSet::setIncrementalRehash()
+	void setIncrementalRehash(bool enabled) {
+		table_.setIncrementalRehash(enabled);
+	}
+	//-----------------------------------------------------------------------------
+	bool isRehashing() const {
+		return table_.isRehashing();
+	}
+	//-----------------------------------------------------------------------------
+	// See LPHashSet::setRehashThreadCount()
+	void setRehashThreadCount(size_t threadCount) {
+		table_.setRehashThreadCount(threadCount);
+	}
+	//-----------------------------------------------------------------------------
+	size_t sizeInBytes() const {
+		return table_.sizeInBytes();
+	}
+	//-----------------------------------------------------------------------------
+	HashSetStats stats() const {
+		return table_.stats();
+	}
+	//-----------------------------------------------------------------------------
+	void resetStats() {
+		table_.resetStats();
+	}
+	//-----------------------------------------------------------------------------
+	void swap(LPHashMap& other) {
+		table_.swap(other.table_);
+	}
+
+	//-----------------------------------------------------------------------------
+	// Yields std::pair<const TKey&, TValue&> by value, so it binds to auto&& or a structured binding
+	template<bool Const>
+	class IteratorImpl {
+	public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = std::pair<const TKey&, std::conditional_t<Const, const TValue&, TValue&>>;
+		using difference_type = ptrdiff_t;
+		using pointer = void;
+		using reference = value_type;
+
+		//-----------------------------------------------------------------------------
+		IteratorImpl()
+			: map_(nullptr)
+		{}
+		//-----------------------------------------------------------------------------
+		reference operator*() const {
+			const Stored& element = *it_;
+			return reference(map_->keyOf(element), *map_->valueOf(&element));
+		}
+		//-----------------------------------------------------------------------------
+		IteratorImpl& operator++() {
+			++it_;
+			return *this;
+		}
+		//-----------------------------------------------------------------------------
+		IteratorImpl operator++(int) {
+			IteratorImpl previous = *this;
+			++it_;
+			return previous;
+		}
+		//-----------------------------------------------------------------------------
+		bool operator==(const IteratorImpl& other) const {
+			return it_ == other.it_;
+		}
+		//-----------------------------------------------------------------------------
+		bool operator!=(const IteratorImpl& other) const {
+			return it_ != other.it_;
+		}
+
+	private:
+		friend class LPHashMap;
+
+		typename Table::ConstIterator it_;
+		const LPHashMap* map_;
+
+		//-----------------------------------------------------------------------------
+		IteratorImpl(typename Table::ConstIterator it, const LPHashMap* map)
+			: it_(it)
+			, map_(map)
+		{}
+	};
+
+	using Iterator = IteratorImpl<false>;
+	using ConstIterator = IteratorImpl<true>;
+
+	//-----------------------------------------------------------------------------
+	Iterator begin() {
+		return Iterator(table_.begin(), this);
+	}
+	//-----------------------------------------------------------------------------
+	Iterator end() {
+		return Iterator(table_.end(), this);
+	}
+	//-----------------------------------------------------------------------------
+	ConstIterator begin() const {
+		return ConstIterator(table_.begin(), this);
+	}
+	//-----------------------------------------------------------------------------
+	ConstIterator end() const {
+		return ConstIterator(table_.end(), this);
+	}
+
+private:
+	// Type of a slot of the table, the key itself or an entry with key and value
+	using Stored = std::conditional_t<SeparateValues, TKey, Entry>;
+
+	Table table_;
+
+	//-----------------------------------------------------------------------------
+	static auto tableHasher(const THash& hasher) {
+		if constexpr (SeparateValues) {
+			return hasher;
+		} else {
+			return EntryHasher<THash, Entry>{ hasher };
+		}
+	}
+	//-----------------------------------------------------------------------------
+	static auto tableEqual(const TEqual& equal) {
+		if constexpr (SeparateValues) {
+			return equal;
+		} else {
+			return EntryEqual<TEqual, Entry>{ equal };
+		}
+	}
+	//-----------------------------------------------------------------------------
+	static const TKey& keyOf(const Stored& element) {
+		if constexpr (SeparateValues) {
+			return element;
+		} else {
+			return element.key;
+		}
+	}
+	//-----------------------------------------------------------------------------
+	// The table hands out its slots as const, a value takes no part in hashing and may change
+	TValue* valueOf(const Stored* element) const {
+		if constexpr (SeparateValues) {
+			return table_.valueOf(element);
+		} else {
+			return &const_cast<Entry*>(element)->value;
+		}
+	}
+	//-----------------------------------------------------------------------------
+	template<class K>
+	Stored* findStored(const K& key, Hash_t hash) const {
+		return const_cast<Stored*>(table_.find(key, hash));
+	}
+	//-----------------------------------------------------------------------------
+	template<class K>
+	TValue* findImpl(const K& key) const {
+		Stored* found = findStored(key, table_.hasher_(key));
+		return found ? valueOf(found) : nullptr;
+	}
+	//-----------------------------------------------------------------------------
+	// Element of key and whether it was inserted, a new value is constructed from args
+	template<class K, class... Args>
+	std::pair<Stored*, bool> findOrInsert(K&& key, Hash_t hash, Args&&... args) {
+		if (Stored* found = findStored(key, hash))
+			return { found, false };
+		return { insertAbsent(std::forward<K>(key), hash, std::forward<Args>(args)...), true };
+	}
+	//-----------------------------------------------------------------------------
+	// Inserts key which is known to be absent, key and value are constructed in their slots
+	template<class K, class... Args>
+	Stored* insertAbsent(K&& key, Hash_t hash, Args&&... args) {
+		return table_.insertAbsent(hash, [&](Stored* element, [[maybe_unused]] auto* value) {
+			if constexpr (SeparateValues) {
+				new (element) TKey(std::forward<K>(key));
+				try {
+					new (value) TValue(std::forward<Args>(args)...);
+				} catch (...) {
+					element->~TKey();
+					throw;
+				}
+			} else {
+				new (element) Entry(std::in_place, std::forward<K>(key), std::forward<Args>(args)...);
+			}
+		});
+	}
+};
+
+//-----------------------------------------------------------------------------
+// Counts or sums per key, e.g. the groups of an aggregation fed by countBatch() and accumulateBatch()
+template<class TKey, class TCount = uint64_t, LPHashSetPolicy Policy = LPHashSetPolicy::Auto, class THash = Hasher<TKey>, class TEqual = std::equal_to<>>
+using LPHashCounter = LPHashMap<TKey, TCount, Policy, THash, TEqual>;
+
+} // namespace hs
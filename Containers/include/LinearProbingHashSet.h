@@ -1,266 +1,2066 @@
+#pragma once
+
+#include "Allocators.h"
+#include "HashFunc.h"
+#include "HashSetStats.h"
+#include "MappedFile.h"
+#include "Platform.h"
+#include "TableGrowth.h"
 
 #include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <atomic>
+#include <new>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
 #include <emmintrin.h>
 #include <immintrin.h>
 
-namespace hs {
+namespace hs {
+
+enum class LPHashSetPolicy {
+	Simple,
+	SSE,
+	AVX,
+	AVX512,
+	Auto,	// Picks the best kernel supported by the CPU at runtime
+	Grouped	// SSE2 groups of 16 slots visited in triangular steps instead of linearly, see indexOfGrouped()
+};
+
+//-----------------------------------------------------------------------------
+// Keys for which a memcpy to new storage may replace the move constructor plus destructor of the
+// old object. Rehashes relocate such keys as raw bytes. Specialize it for key types which own their
+// memory through plain or unique pointers; types which point into themselves, like the small
+// buffer of libstdc++'s std::string, must keep the default.
+template<class T>
+struct IsTriviallyRelocatable : std::is_trivially_copyable<T> {};
+
+//-----------------------------------------------------------------------------
+// Header of a file written by LPHashSet::save(). The metadata, data and (with StoreHash) hash
+// arrays follow in native byte order, each starting at a multiple of FILE_ALIGNMENT so a mapped
+// file can be probed in place by every SIMD policy.
+struct LPHashSetFileHeader {
+	static constexpr char MAGIC[8] = { 'H', 'S', 'L', 'P', 'S', 'E', 'T', '\0' };
+	static constexpr uint32_t VERSION = 2;
+	static constexpr size_t FILE_ALIGNMENT = 64;
+
+	char magic_[8];
+	uint32_t version_;
+	uint32_t keySize_;
+	uint32_t policy_;		// Only Grouped places elements differently, the other policies share the table layout
+	uint16_t storeHash_;
+	uint16_t fastRange_;	// Home slots by FastRangeGrowth instead of a mask, see TableGrowth.h
+	uint64_t capacity_;
+	uint64_t count_;
+	uint64_t tombstones_;
+	uint64_t hashCheck_;	// Identifies the hash function, see LPHashSet::hashCheck()
+	float maxLoadFactor_;
+	float minLoadFactor_;
+};
+static_assert(sizeof(LPHashSetFileHeader) <= LPHashSetFileHeader::FILE_ALIGNMENT, "Header must fit in front of the metadata");
+
+//-----------------------------------------------------------------------------
+// THash maps a key to a Hash_t, TEqual compares two keys. If both define is_transparent,
+// contains() and remove() accept any key type they can hash and compare without converting it to TKey.
+// StoreHash keeps the full hash of every element in a side array. Probes compare it before the key,
+// which saves most compares of expensive keys, and rehashes never call the hasher. Costs 8 bytes per slot.
+// For TStats see HashSetStats.h.
+// TGrowth picks the capacities and home slots, FastRangeGrowth trades a multiply per probe for
+// tables which are at most a growth step larger than needed, see TableGrowth.h.
+// LPHashTable is the engine shared by LPHashSet (TValue void) and LPHashMap. A non-void TValue
+// keeps a value per slot in a separate array which moves along with the keys, the set interface
+// below ignores it, LPHashMap in LinearProbingHashMap.h is the interface for such tables.
+template<class TKey, class TValue, LPHashSetPolicy Policy, class THash = Hasher<TKey>, class TEqual = std::equal_to<>, class TAllocator = AlignedAllocator, bool StoreHash = false, class TStats = NoStats, class TGrowth = PowerOfTwoGrowth>
+class LPHashTable {
+	static constexpr bool HAS_VALUES = !std::is_void<TValue>::value;
+	// Element type of the value array, sets keep a null pointer to an empty type
+	struct NoValue {};
+	using ValueSlot = std::conditional_t<HAS_VALUES, TValue, NoValue>;
+
+	template<class, class, LPHashSetPolicy, class, class, class, bool, class, class>
+	friend class LPHashMap;
+
+public:
+	//-----------------------------------------------------------------------------
+	LPHashTable()
+		: LPHashTable(TAllocator())
+	{}
+	//-----------------------------------------------------------------------------
+	explicit LPHashTable(const TAllocator& allocator)
+		: LPHashTable(static_cast<size_t>(0), allocator)
+	{}
+	//-----------------------------------------------------------------------------
+	// Sizes the table so elementCount elements fit without a rehash
+	explicit LPHashTable(size_t elementCount, const TAllocator& allocator = TAllocator())
+		: LPHashTable(elementCount, THash(), TEqual(), allocator)
+	{}
+	//-----------------------------------------------------------------------------
+	// For stateful hashers, e.g. a seeded StringHasher
+	LPHashTable(size_t elementCount, const THash& hasher, const TEqual& equal = TEqual(), const TAllocator& allocator = TAllocator())
+		: hasher_(hasher)
+		, equal_(equal)
+		, allocator_(allocator)
+		, count_(0)
+		, tombstones_(0)
+		, maxLoadFactor_(DEFAULT_MAX_LOAD_FACTOR)
+		, minLoadFactor_(0.0f)
+		, capacity_(capacityFor(elementCount, DEFAULT_MAX_LOAD_FACTOR))
+		, incrementalRehash_(false)
+		, rehashThreads_(1)
+		, oldData_(nullptr)
+		, oldMetadata_(nullptr)
+		, oldHashes_(nullptr)
+		, oldValues_(nullptr)
+		, oldCapacity_(0)
+		, migrateIndex_(0)
+		, mapping_(nullptr)
+	{
+		// An empty set allocates on its first insert, so default construction and moves stay cheap
+		if (elementCount > 0) {
+			allocArrays();
+		} else {
+			useEmptyArrays();
+		}
+	}
+	//-----------------------------------------------------------------------------
+	// Builds the set from [first, last), see insert(first, last, threadCount)
+	template<class TIter, class = typename std::iterator_traits<TIter>::iterator_category>
+	LPHashTable(TIter first, TIter last, size_t threadCount = 1, const TAllocator& allocator = TAllocator())
+		: LPHashTable(rangeSize(first, last), allocator)
+	{
+		insert(first, last, threadCount);
+	}
+	//-----------------------------------------------------------------------------
+	// O(1) and allocation free, the moved-from set is left empty without arrays
+	LPHashTable(LPHashTable&& other)
+		: LPHashTable(static_cast<size_t>(0), other.hasher_, other.equal_, other.allocator_)
+	{
+		swap(other);
+	}
+	//-----------------------------------------------------------------------------
+	// The previous elements of this set are destroyed with other
+	LPHashTable& operator=(LPHashTable&& other) {
+		swap(other);
+		return *this;
+	}
+	//-----------------------------------------------------------------------------
+	LPHashTable(const LPHashTable&) = delete;
+	LPHashTable& operator=(const LPHashTable&) = delete;
+	//-----------------------------------------------------------------------------
+	~LPHashTable() {
+		if constexpr (!std::is_trivially_destructible<TKey>::value || !std::is_trivially_destructible<ValueSlot>::value) {
+			forEachSlot(metadata_, capacity_, [&](size_t i) { destroySlot(data_, values_, i); });
+			if (oldData_)
+				forEachSlot(oldMetadata_, oldCapacity_, [&](size_t i) { destroySlot(oldData_, oldValues_, i); });
+		}
+
+		freeArrays(data_, metadata_, hashes_, values_, capacity_);
+		if (oldData_)
+			freeOldArrays();
+	}
+	//-----------------------------------------------------------------------------
+	void swap(LPHashTable& other) {
+		using std::swap;
+		swap(hasher_, other.hasher_);
+		swap(equal_, other.equal_);
+		swap(allocator_, other.allocator_);
+		swap(count_, other.count_);
+		swap(tombstones_, other.tombstones_);
+		swap(maxLoadFactor_, other.maxLoadFactor_);
+		swap(minLoadFactor_, other.minLoadFactor_);
+		swap(capacity_, other.capacity_);
+		swap(data_, other.data_);
+		swap(metadata_, other.metadata_);
+		swap(hashes_, other.hashes_);
+		swap(values_, other.values_);
+		swap(incrementalRehash_, other.incrementalRehash_);
+		swap(rehashThreads_, other.rehashThreads_);
+		swap(oldData_, other.oldData_);
+		swap(oldMetadata_, other.oldMetadata_);
+		swap(oldHashes_, other.oldHashes_);
+		swap(oldValues_, other.oldValues_);
+		swap(oldCapacity_, other.oldCapacity_);
+		swap(migrateIndex_, other.migrateIndex_);
+		swap(mapping_, other.mapping_);
+		swap(stats_, other.stats_);
+	}
+	//-----------------------------------------------------------------------------
+	// Writes the table as is to path, see LPHashSetFileHeader for the format.
+	// Throws std::system_error if the file can not be written.
+	void save(const char* path) const {
+		static_assert(std::is_trivially_copyable<TKey>::value, "Only trivially copyable keys can be saved");
+		static_assert(!HAS_VALUES, "Tables with a value array can not be saved");
+
+		if (oldData_ || data_ == nullptr) {
+			// The file holds a single allocated table, a copy finishes the migration without touching this set
+			LPHashTable copy(count_, hasher_, equal_, allocator_);
+			copy.ensureArrays();
+			forEachSlotHashed([&](const TKey& key, Hash_t hash) { copy.placeAbsent(key, hash); });
+			copy.maxLoadFactor_ = maxLoadFactor_;
+			copy.minLoadFactor_ = minLoadFactor_;
+			copy.save(path);
+			return;
+		}
+
+		LPHashSetFileHeader header = {};
+		memcpy(header.magic_, LPHashSetFileHeader::MAGIC, sizeof(header.magic_));
+		header.version_ = LPHashSetFileHeader::VERSION;
+		header.keySize_ = sizeof(TKey);
+		header.policy_ = static_cast<uint32_t>(Policy);
+		header.storeHash_ = StoreHash;
+		header.fastRange_ = !TGrowth::POWER_OF_TWO;
+		header.capacity_ = capacity_;
+		header.count_ = count_;
+		header.tombstones_ = tombstones_;
+		header.hashCheck_ = hashCheck();
+		header.maxLoadFactor_ = maxLoadFactor_;
+		header.minLoadFactor_ = minLoadFactor_;
+
+		FILE* file = fopen(path, "wb");
+		if (!file)
+			throw std::system_error(errno, std::generic_category(), std::string("Can not open ") + path);
+
+		const FileLayout layout = fileLayout(capacity_);
+		bool ok = writePadded(file, &header, sizeof(header), layout.metadata_);
+		ok = ok && writePadded(file, metadata_, capacity_, layout.data_ - layout.metadata_);
+		if constexpr (StoreHash) {
+			ok = ok && writePadded(file, data_, sizeof(TKey) * capacity_, layout.hashes_ - layout.data_);
+			ok = ok && writePadded(file, hashes_, sizeof(Hash_t) * capacity_, layout.size_ - layout.hashes_);
+		} else {
+			ok = ok && writePadded(file, data_, sizeof(TKey) * capacity_, layout.size_ - layout.data_);
+		}
+		const int error = errno;
+		if (fclose(file) != 0 || !ok)
+			throw std::system_error(ok ? errno : error, std::generic_category(), std::string("Can not write ") + path);
+	}
+	//-----------------------------------------------------------------------------
+	// Maps a file written by save() copy-on-write and probes it in place, pages are only read when
+	// a lookup touches them. The set stays fully usable, writes stay private to the process and the
+	// first rehash moves the elements to memory of the allocator and drops the mapping.
+	// Throws std::system_error if the file can not be mapped and std::runtime_error if it does not
+	// hold a compatible set, including one saved with a different hash function.
+	static LPHashTable load(const char* path, const THash& hasher = THash(), const TEqual& equal = TEqual(), const TAllocator& allocator = TAllocator()) {
+		static_assert(std::is_trivially_copyable<TKey>::value, "Only trivially copyable keys can be loaded");
+		static_assert(!HAS_VALUES, "Tables with a value array can not be loaded");
+
+		std::unique_ptr<MappedFile> mapping(new MappedFile(path));
+		LPHashSetFileHeader header;
+		if (mapping->size() < sizeof(header))
+			throw std::runtime_error(std::string("Not an LPHashSet file: ") + path);
+		memcpy(&header, mapping->data(), sizeof(header));
+
+		if (memcmp(header.magic_, LPHashSetFileHeader::MAGIC, sizeof(header.magic_)) != 0 || header.version_ != LPHashSetFileHeader::VERSION)
+			throw std::runtime_error(std::string("Not an LPHashSet file: ") + path);
+		if (header.keySize_ != sizeof(TKey) || header.storeHash_ != StoreHash)
+			throw std::runtime_error(std::string("Key size or stored hash mode does not match: ") + path);
+		if ((header.policy_ == static_cast<uint32_t>(LPHashSetPolicy::Grouped)) != GROUPED)
+			throw std::runtime_error(std::string("Grouped and linear probing tables are not compatible: ") + path);
+		if (header.fastRange_ != !TGrowth::POWER_OF_TWO)
+			throw std::runtime_error(std::string("Power of two and fast range tables are not compatible: ") + path);
+		if (header.capacity_ < MIN_CAPACITY || header.capacity_ >= (static_cast<uint64_t>(1) << 48) || header.capacity_ % MIN_CAPACITY != 0
+			|| (TGrowth::POWER_OF_TWO && (header.capacity_ & (header.capacity_ - 1)) != 0) || header.count_ + header.tombstones_ >= header.capacity_)
+			throw std::runtime_error(std::string("Corrupt LPHashSet file: ") + path);
+
+		const size_t capacity = static_cast<size_t>(header.capacity_);
+		const FileLayout layout = fileLayout(capacity);
+		if (mapping->size() < layout.size_)
+			throw std::runtime_error(std::string("Truncated LPHashSet file: ") + path);
+
+		// Owns no arrays yet
+		LPHashTable set(static_cast<size_t>(0), hasher, equal, allocator);
+
+		uint8_t* base = mapping->data();
+		set.capacity_ = capacity;
+		set.count_ = static_cast<size_t>(header.count_);
+		set.tombstones_ = static_cast<size_t>(header.tombstones_);
+		set.maxLoadFactor_ = header.maxLoadFactor_;
+		set.minLoadFactor_ = header.minLoadFactor_;
+		set.metadata_ = base + layout.metadata_;
+		set.data_ = reinterpret_cast<TKey*>(base + layout.data_);
+		set.hashes_ = StoreHash ? reinterpret_cast<Hash_t*>(base + layout.hashes_) : nullptr;
+		set.mapping_ = mapping.release();
+
+		if (set.hashCheck() != header.hashCheck_)
+			throw std::runtime_error(std::string("LPHashSet file was saved with a different hash function: ") + path);
+		return set;
+	}
+	//-----------------------------------------------------------------------------
+	// In incremental mode growing the table only allocates the new arrays, the elements
+	// are moved over a few slots per insert/remove while lookups check both tables.
+	// This spreads the cost of a rehash and bounds the latency of a single insert.
+	// The shrink of remove() below the min load factor migrates the same way, explicit
+	// reserve(), shrinkToFit() and eraseIf() finish any migration and rehash at once.
+	void setIncrementalRehash(bool enabled) {
+		incrementalRehash_ = enabled;
+		if (!enabled)
+			finishMigration();
+	}
+	//-----------------------------------------------------------------------------
+	// Rehashes of tables with at least PARALLEL_REHASH_THRESHOLD elements are split over
+	// threadCount threads. Used by growth, reserve and shrinkToFit, incremental rehashes
+	// stay single threaded. Grouped sets, keys with a throwing move and keys which are neither
+	// trivially relocatable nor stored with their hash always rehash serially.
+	void setRehashThreadCount(size_t threadCount) {
+		rehashThreads_ = threadCount > 0 ? threadCount : 1;
+	}
+	//-----------------------------------------------------------------------------
+	size_t rehashThreadCount() const {
+		return rehashThreads_;
+	}
+	//-----------------------------------------------------------------------------
+	// Grows the table once so elementCount elements fit without further rehashes.
+	// threadCount 0 rehashes with rehashThreadCount() threads.
+	void reserve(size_t elementCount, size_t threadCount = 0) {
+		const size_t capacity = capacityFor(elementCount, maxLoadFactor_);
+		if (capacity > capacity_) {
+			finishMigration();
+			rehash(capacity, threadCount);
+		}
+	}
+	//-----------------------------------------------------------------------------
+	// Rehashes into the smallest table which holds the current elements, drops all tombstones
+	void shrinkToFit() {
+		finishMigration();
+		const size_t capacity = capacityFor(count_, maxLoadFactor_);
+		if (capacity < capacity_)
+			rehash(capacity);
+	}
+	//-----------------------------------------------------------------------------
+	// Higher values save memory at the cost of longer probes. Clamped to [0.25, 0.85],
+	// the upper bound together with MAX_TOMBSTONE_FACTOR keeps an empty slot in the table.
+	void setMaxLoadFactor(float maxLoadFactor) {
+		maxLoadFactor_ = maxLoadFactor < 0.25f ? 0.25f : maxLoadFactor > 0.85f ? 0.85f : maxLoadFactor;
+		if (minLoadFactor_ > maxLoadFactor_ / 4)
+			minLoadFactor_ = maxLoadFactor_ / 4;
+		reserve(count_);
+	}
+	//-----------------------------------------------------------------------------
+	float maxLoadFactor() const {
+		return maxLoadFactor_;
+	}
+	//-----------------------------------------------------------------------------
+	// Remove halves the table when the load factor drops below minLoadFactor, 0 disables shrinking.
+	// Clamped to a quarter of the max load factor so a shrink can not immediately trigger growth.
+	void setMinLoadFactor(float minLoadFactor) {
+		minLoadFactor_ = minLoadFactor < 0.0f ? 0.0f : minLoadFactor > maxLoadFactor_ / 4 ? maxLoadFactor_ / 4 : minLoadFactor;
+	}
+	//-----------------------------------------------------------------------------
+	float minLoadFactor() const {
+		return minLoadFactor_;
+	}
+	//-----------------------------------------------------------------------------
+	bool isRehashing() const {
+		return oldData_ != nullptr;
+	}
+	//-----------------------------------------------------------------------------
+	void insert(const TKey& key) {
+		insertHashed(key, hasher_(key), key);
+	}
+	//-----------------------------------------------------------------------------
+	// Moves key into the set, key is left as is if an equal element is already present
+	void insert(TKey&& key) {
+		const Hash_t hash = hasher_(key);
+		insertHashed(key, hash, std::move(key));
+	}
+	//-----------------------------------------------------------------------------
+	// Constructs the element from key only if no equal element is present, e.g. a std::string
+	// from a std::string_view with a transparent hasher. Returns true if the element was inserted.
+	template<class K, std::enable_if_t<IsLookupKey<THash, TEqual, K, TKey>::value, int> = 0>
+	bool tryEmplace(K&& key) {
+		const Hash_t hash = hasher_(key);
+		return insertHashed(key, hash, std::forward<K>(key));
+	}
+	//-----------------------------------------------------------------------------
+	// Returns true if the element was inserted. A single argument the set can look up directly goes
+	// through tryEmplace(), other arguments construct a temporary key which is moved into the slot.
+	template<class... Args>
+	bool emplace(Args&&... args) {
+		if constexpr (sizeof...(Args) == 1 && (IsLookupKey<THash, TEqual, Args, TKey>::value && ...)) {
+			return tryEmplace(std::forward<Args>(args)...);
+		} else {
+			TKey key(std::forward<Args>(args)...);
+			const Hash_t hash = hasher_(key);
+			return insertHashed(key, hash, std::move(key));
+		}
+	}
+	//-----------------------------------------------------------------------------
+	// Inserts [first, last). Forward ranges size the table once up front and compute the hashes
+	// a window ahead with the slots prefetched. With threadCount > 1 large random access ranges
+	// are inserted by several threads, each filling its own region of the table, and growing
+	// a large table for the range rehashes with as many threads.
+	template<class TIter, class = typename std::iterator_traits<TIter>::iterator_category>
+	void insert(TIter first, TIter last, size_t threadCount = 1) {
+		using Category = typename std::iterator_traits<TIter>::iterator_category;
+		if constexpr (!std::is_base_of<std::forward_iterator_tag, Category>::value) {
+			for (; first != last; ++first) {
+				insert(*first);
+			}
+		} else {
+			const size_t size = rangeSize(first, last);
+			finishMigration();
+			reserve(count_ + size, threadCount > rehashThreads_ ? threadCount : rehashThreads_);
+			ensureArrays();
+
+			if constexpr (std::is_base_of<std::random_access_iterator_tag, Category>::value) {
+				// The regions of the parallel build rely on linear probes
+				if (threadCount > 1 && size >= PARALLEL_BUILD_THRESHOLD && !GROUPED) {
+					insertParallel(first, size, threadCount);
+					return;
+				}
+			}
+
+			TIter window[BATCH_WINDOW];
+			Hash_t hashes[BATCH_WINDOW];
+			while (first != last) {
+				size_t windowSize = 0;
+				for (; windowSize < BATCH_WINDOW && first != last; ++windowSize, ++first) {
+					window[windowSize] = first;
+					hashes[windowSize] = hasher_(*first);
+					prefetchHome(hashes[windowSize]);
+				}
+				for (size_t i = 0; i < windowSize; ++i) {
+					// Moves the elements of a std::move_iterator range
+					auto&& key = *window[i];
+					insertHashed(key, hashes[i], std::forward<decltype(key)>(key));
+				}
+			}
+		}
+	}
+	//-----------------------------------------------------------------------------
+	void remove(const TKey& key) {
+		removeImpl(key);
+	}
+	//-----------------------------------------------------------------------------
+	template<class K, EnableIfTransparent<THash, TEqual, K, TKey> = 0>
+	void remove(const K& key) {
+		removeImpl(key);
+	}
+	//-----------------------------------------------------------------------------
+	bool contains(const TKey& key) const {
+		return find(key, hasher_(key)) != nullptr;
+	}
+	//-----------------------------------------------------------------------------
+	// Heterogeneous lookup, e.g. contains(std::string_view) on a set of std::string
+	template<class K, EnableIfTransparent<THash, TEqual, K, TKey> = 0>
+	bool contains(const K& key) const {
+		return find(key, hasher_(key)) != nullptr;
+	}
+	//-----------------------------------------------------------------------------
+	// Looks up keys[0..count), bit i of resultBits is set if keys[i] is present.
+	// resultBits must hold at least (count + 63) / 64 words.
+	void containsBatch(const TKey* keys, size_t count, uint64_t* resultBits) const {
+		memset(resultBits, 0, sizeof(uint64_t) * ((count + 63) / 64));
+		indexOfBatch(keys, count, [&](size_t i, const TKey* found) {
+			if (found)
+				resultBits[i >> 6] |= static_cast<uint64_t>(1) << (i & 63);
+		});
+	}
+	//-----------------------------------------------------------------------------
+	// Looks up keys[0..count), results[i] points to the stored key or is nullptr if keys[i] is not present
+	void findBatch(const TKey* keys, size_t count, const TKey** results) const {
+		indexOfBatch(keys, count, [&](size_t i, const TKey* found) {
+			results[i] = found;
+		});
+	}
+	//-----------------------------------------------------------------------------
+	size_t count() const {
+		return count_;
+	}
+	//-----------------------------------------------------------------------------
+	size_t capacity() const {
+		return capacity_;
+	}
+	//-----------------------------------------------------------------------------
+	size_t tombstoneCount() const {
+		return tombstones_;
+	}
+	//-----------------------------------------------------------------------------
+	// Bytes of the table arrays, of both tables during a migration. An empty set owns none until its first insert.
+	size_t sizeInBytes() const {
+		constexpr size_t SLOT_BYTES = sizeof(TKey) + 1 + (StoreHash ? sizeof(Hash_t) : 0) + (HAS_VALUES ? sizeof(ValueSlot) : 0);
+		return (data_ ? capacity_ * SLOT_BYTES : 0) + (oldData_ ? oldCapacity_ * SLOT_BYTES : 0);
+	}
+	//-----------------------------------------------------------------------------
+	// See HashSetStats. Walks the metadata once for the cluster histogram.
+	HashSetStats stats() const {
+		HashSetStats result;
+		stats_.fill(result);
+		result.count = count_;
+		result.capacity = capacity_;
+		result.tombstones = tombstones_;
+		result.scanClusters(capacity_, [&](size_t i) { return metadata_[i] != 0; });
+		return result;
+	}
+	//-----------------------------------------------------------------------------
+	void resetStats() {
+		stats_.reset();
+	}
+	//-----------------------------------------------------------------------------
+	// Calls func(const TKey&) for every element. Skips a cache line of empty slots with a few movemasks.
+	template<class TFunc>
+	void forEach(TFunc&& func) const {
+		forEachSlot(metadata_, capacity_, [&](size_t i) { func(static_cast<const TKey&>(data_[i])); });
+		// Migrated slots of the old table are tombstones, the valid ones are not in the new table yet
+		if (oldData_)
+			forEachSlot(oldMetadata_, oldCapacity_, [&](size_t i) { func(static_cast<const TKey&>(oldData_[i])); });
+	}
+	//-----------------------------------------------------------------------------
+	// Removes every element for which pred(const TKey&) returns true in a single pass, returns the removed count.
+	// Tombstones which end up in front of an empty slot are dropped afterwards, the rest is purged in place if needed.
+	template<class TPred>
+	size_t eraseIf(TPred&& pred) {
+		finishMigration();
+
+		size_t erased = 0;
+		forEachSlot(metadata_, capacity_, [&](size_t i) {
+			if (pred(static_cast<const TKey&>(data_[i]))) {
+				eraseSlot(i);
+				++erased;
+			}
+		});
+		finishErase(erased);
+		return erased;
+	}
+	//-----------------------------------------------------------------------------
+	// Number of keys present in both sets. Like all set operations below it probes the
+	// larger set with the elements of the smaller one, see probeEach().
+	size_t intersectionCount(const LPHashTable& other) const {
+		const bool otherSmaller = other.count_ < count_;
+		const LPHashTable& smaller = otherSmaller ? other : *this;
+		const LPHashTable& larger = otherSmaller ? *this : other;
+
+		size_t count = 0;
+		larger.probeEach(smaller, [&](const TKey&, Hash_t, const TKey* found) {
+			count += found != nullptr;
+		});
+		return count;
+	}
+	//-----------------------------------------------------------------------------
+	// Set operations returning a new set, which copies the hasher, equality and allocator of this set
+	LPHashTable intersect(const LPHashTable& other) const {
+		const bool otherSmaller = other.count_ < count_;
+		const LPHashTable& smaller = otherSmaller ? other : *this;
+		const LPHashTable& larger = otherSmaller ? *this : other;
+
+		LPHashTable result(smaller.count_, hasher_, equal_, allocator_);
+		larger.probeEach(smaller, [&](const TKey& key, Hash_t hash, const TKey* found) {
+			if (found)
+				result.placeAbsent(key, hashFor(larger, key, hash));
+		});
+		return result;
+	}
+	//-----------------------------------------------------------------------------
+	LPHashTable unite(const LPHashTable& other) const {
+		const bool otherSmaller = other.count_ < count_;
+		const LPHashTable& smaller = otherSmaller ? other : *this;
+		const LPHashTable& larger = otherSmaller ? *this : other;
+
+		// Collecting the missing keys first sizes the result exactly
+		std::vector<std::pair<const TKey*, Hash_t>> missing;
+		larger.probeEach(smaller, [&](const TKey& key, Hash_t hash, const TKey* found) {
+			if (!found)
+				missing.emplace_back(&key, hashFor(larger, key, hash));
+		});
+
+		LPHashTable result(larger.count_ + missing.size(), hasher_, equal_, allocator_);
+		larger.forEachSlotHashed([&](const TKey& key, Hash_t hash) {
+			result.placeAbsent(key, hashFor(larger, key, hash));
+		});
+		for (const auto& [key, hash] : missing) {
+			result.placeAbsent(*key, hash);
+		}
+		return result;
+	}
+	//-----------------------------------------------------------------------------
+	// Keys of this set which are not in other
+	LPHashTable difference(const LPHashTable& other) const {
+		if (count_ <= other.count_) {
+			LPHashTable result(count_, hasher_, equal_, allocator_);
+			other.probeEach(*this, [&](const TKey& key, Hash_t hash, const TKey* found) {
+				if (!found)
+					result.placeAbsent(key, hashFor(other, key, hash));
+			});
+			return result;
+		}
+
+		// The smaller other marks the elements to drop, the rest is copied in one pass
+		std::vector<uint64_t> drop((capacity_ + oldCapacity_ + 63) / 64);
+		size_t dropCount = 0;
+		probeEach(other, [&](const TKey&, Hash_t, const TKey* found) {
+			if (found) {
+				const size_t slot = slotOf(found);
+				drop[slot >> 6] |= static_cast<uint64_t>(1) << (slot & 63);
+				++dropCount;
+			}
+		});
+
+		LPHashTable result(count_ - dropCount, hasher_, equal_, allocator_);
+		forEachSlotHashed([&](const TKey& key, Hash_t hash) {
+			const size_t slot = slotOf(&key);
+			if ((drop[slot >> 6] & (static_cast<uint64_t>(1) << (slot & 63))) == 0)
+				result.placeAbsent(key, hash);
+		});
+		return result;
+	}
+	//-----------------------------------------------------------------------------
+	// In-place versions of the set operations
+	void intersectWith(const LPHashTable& other) {
+		if (&other == this)
+			return;
+		finishMigration();
+
+		size_t erased = 0;
+		if (count_ <= other.count_) {
+			// Erasing the visited slot does not disturb the walk over this table
+			other.probeEach(*this, [&](const TKey& key, Hash_t, const TKey* found) {
+				if (!found) {
+					eraseSlot(&key - data_);
+					++erased;
+				}
+			});
+		} else {
+			std::vector<uint64_t> keep((capacity_ + 63) / 64);
+			probeEach(other, [&](const TKey&, Hash_t, const TKey* found) {
+				if (found) {
+					const size_t slot = found - data_;
+					keep[slot >> 6] |= static_cast<uint64_t>(1) << (slot & 63);
+				}
+			});
+			forEachSlot(metadata_, capacity_, [&](size_t i) {
+				if ((keep[i >> 6] & (static_cast<uint64_t>(1) << (i & 63))) == 0) {
+					eraseSlot(i);
+					++erased;
+				}
+			});
+		}
+		finishErase(erased);
+	}
+	//-----------------------------------------------------------------------------
+	void uniteWith(const LPHashTable& other) {
+		if (&other == this)
+			return;
+		finishMigration();
+
+		std::vector<std::pair<const TKey*, Hash_t>> missing;
+		probeEach(other, [&](const TKey& key, Hash_t hash, const TKey* found) {
+			if (!found)
+				missing.emplace_back(&key, hash);
+		});
+
+		reserve(count_ + missing.size());
+		for (const auto& [key, hash] : missing) {
+			placeAbsent(*key, hash);
+		}
+		if (tombstoneFactor() > MAX_TOMBSTONE_FACTOR)
+			purgeTombstones();
+	}
+	//-----------------------------------------------------------------------------
+	// Removes the keys of other from this set
+	void subtract(const LPHashTable& other) {
+		finishMigration();
+
+		size_t erased = 0;
+		if (count_ <= other.count_) {
+			other.probeEach(*this, [&](const TKey& key, Hash_t, const TKey* found) {
+				if (found) {
+					eraseSlot(&key - data_);
+					++erased;
+				}
+			});
+		} else {
+			// Tombstones keep the probe sequences intact while this table is still being probed
+			probeEach(other, [&](const TKey&, Hash_t, const TKey* found) {
+				if (found) {
+					eraseSlot(found - data_);
+					++erased;
+				}
+			});
+		}
+		finishErase(erased);
+	}
+
+	//-----------------------------------------------------------------------------
+	// Forward iterator over the elements, any insert or remove invalidates it
+	class ConstIterator {
+	public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = TKey;
+		using difference_type = ptrdiff_t;
+		using pointer = const TKey*;
+		using reference = const TKey&;
+
+		//-----------------------------------------------------------------------------
+		ConstIterator()
+			: set_(nullptr)
+			, index_(NPOS)
+			, mask_(0)
+			, inOldTable_(false)
+		{}
+		//-----------------------------------------------------------------------------
+		reference operator*() const {
+			return inOldTable_ ? set_->oldData_[index_] : set_->data_[index_];
+		}
+		//-----------------------------------------------------------------------------
+		pointer operator->() const {
+			return &**this;
+		}
+		//-----------------------------------------------------------------------------
+		ConstIterator& operator++() {
+			unsigned long firstSet;
+			if (bitScanForward(&firstSet, mask_)) {
+				index_ = (index_ & ~static_cast<size_t>(63)) + firstSet;
+				mask_ &= mask_ - 1;
+			} else {
+				seek((index_ & ~static_cast<size_t>(63)) + 64);
+			}
+			return *this;
+		}
+		//-----------------------------------------------------------------------------
+		ConstIterator operator++(int) {
+			ConstIterator previous = *this;
+			++*this;
+			return previous;
+		}
+		//-----------------------------------------------------------------------------
+		bool operator==(const ConstIterator& other) const {
+			return index_ == other.index_ && inOldTable_ == other.inOldTable_;
+		}
+		//-----------------------------------------------------------------------------
+		bool operator!=(const ConstIterator& other) const {
+			return !(*this == other);
+		}
+
+	private:
+		friend class LPHashTable;
+
+		const LPHashTable* set_;
+		size_t index_;
+		uint64_t mask_;		// Valid slots after index_ in its block of 64, saves rescanning the block on every step
+		bool inOldTable_;	// During an incremental rehash the not yet migrated elements follow the new table
+
+		//-----------------------------------------------------------------------------
+		explicit ConstIterator(const LPHashTable* set)
+			: set_(set)
+			, index_(0)
+			, mask_(0)
+			, inOldTable_(false)
+		{
+			seek(0);
+		}
+		//-----------------------------------------------------------------------------
+		// Moves to the first element in the blocks starting at base
+		void seek(size_t base) {
+			if (!inOldTable_) {
+				if (seekIn(set_->metadata_, set_->capacity_, base) || !set_->oldData_)
+					return;
+				inOldTable_ = true;
+				base = 0;
+			}
+
+			if (!seekIn(set_->oldMetadata_, set_->oldCapacity_, base))
+				inOldTable_ = false;
+		}
+		//-----------------------------------------------------------------------------
+		bool seekIn(const uint8_t* metadata, size_t capacity, size_t base) {
+			for (; base < capacity; base += 64) {
+				const uint64_t mask = validMask(metadata, base, capacity);
+				unsigned long firstSet;
+				if (bitScanForward(&firstSet, mask)) {
+					index_ = base + firstSet;
+					mask_ = mask & (mask - 1);
+					return true;
+				}
+			}
+
+			index_ = NPOS;
+			mask_ = 0;
+			return false;
+		}
+	};
+
+	//-----------------------------------------------------------------------------
+	ConstIterator begin() const {
+		return ConstIterator(this);
+	}
+	//-----------------------------------------------------------------------------
+	ConstIterator end() const {
+		return ConstIterator();
+	}
+
+private:
+	static constexpr Hash_t VALID_ELEMENT_MASK = 1 << 7;	// 0b1000_0000
+	static constexpr uint8_t TOMBSTONE_MASK = 1 << 6;		// 0b0100_0000
+	static constexpr uint8_t LOW_MASK = 0x7F;				// 0b0111_1111
+	static constexpr float DEFAULT_MAX_LOAD_FACTOR = 0.8f;
+	// Together with the max load factor this guarantees there is always an empty slot to end a probe
+	static constexpr float MAX_TOMBSTONE_FACTOR = 0.125f;
+	static constexpr size_t NPOS = -1;
+	// Number of keys whose hashes and prefetches run ahead of the probes in batch lookups
+	static constexpr size_t BATCH_WINDOW = 16;
+	// Old slots migrated per insert/remove during an incremental rehash. The new table takes
+	// at least 0.8 * oldCapacity inserts before it grows again, so 16 slots per operation finish
+	// the migration long before that.
+	static constexpr size_t MIGRATION_STEP = 16;
+	// Smaller ranges are not worth starting threads for
+	static constexpr size_t PARALLEL_BUILD_THRESHOLD = static_cast<size_t>(1) << 16;
+	// Every worker thread gets several regions so uneven regions balance out
+	static constexpr size_t REGIONS_PER_THREAD = 4;
+	// Smaller tables rehash faster than threads start
+	static constexpr size_t PARALLEL_REHASH_THRESHOLD = static_cast<size_t>(1) << 17;
+	// The SIMD kernels need at least one full metadata group, AVX512 groups are 64 bytes
+	static constexpr size_t MIN_CAPACITY = (Policy == LPHashSetPolicy::AVX512 || Policy == LPHashSetPolicy::Auto) ? 64 : 32;
+	// Metadata groups are loaded with aligned loads
+	static constexpr size_t GROUP_ALIGNMENT =
+		Policy == LPHashSetPolicy::Simple ? 1 :
+		Policy == LPHashSetPolicy::SSE || Policy == LPHashSetPolicy::Grouped ? 16 :
+		Policy == LPHashSetPolicy::AVX ? 32 : 64;
+	// Grouped probes visit whole aligned groups of 16 slots, never single slots
+	static constexpr bool GROUPED = Policy == LPHashSetPolicy::Grouped;
+	static constexpr size_t GROUP_SHIFT = 4;
+	static constexpr size_t GROUP_SLOTS = static_cast<size_t>(1) << GROUP_SHIFT;
+	// Rehash threads bound probes by regions and read the hashes of old slots other threads move
+	// from, which needs a key left intact by its relocation or a stored hash
+	static constexpr bool PARALLEL_REHASH = !GROUPED && std::is_nothrow_move_constructible<TKey>::value
+		&& std::is_nothrow_move_constructible<ValueSlot>::value && (IsTriviallyRelocatable<TKey>::value || StoreHash);
+	static_assert(TAllocator::ALIGNMENT >= GROUP_ALIGNMENT, "Allocator alignment is too small for the SIMD policy");
+	static_assert(TAllocator::ALIGNMENT >= alignof(TKey) && TAllocator::ALIGNMENT >= alignof(ValueSlot), "Allocator alignment is too small for the elements");
+	static_assert(MIN_CAPACITY >= GROUP_ALIGNMENT, "Table must hold at least one metadata group");
+	static_assert(TGrowth::POWER_OF_TWO || !GROUPED, "Triangular group steps only visit every group of a power of two table");
+	// Metadata of empty sets which have not allocated yet, a minimal table of empty slots
+	alignas(64) static constexpr uint8_t EMPTY_METADATA[64] = {};
+	static_assert(MIN_CAPACITY <= sizeof(EMPTY_METADATA), "EMPTY_METADATA must cover a minimal table");
+
+	THash hasher_;
+	TEqual equal_;
+	TAllocator allocator_;
+	size_t count_;
+	size_t tombstones_;
+	float maxLoadFactor_;
+	float minLoadFactor_;
+	size_t capacity_;
+
+	TKey* data_;
+	union {
+		uint8_t* metadata_;
+		__m128i* metadata_m128_;
+		__m256i* metadata_m256_;
+		__m512i* metadata_m512_;
+	};
+	// Full hash of each element if StoreHash, nullptr otherwise
+	Hash_t* hashes_;
+	// Value of each element if HAS_VALUES, nullptr otherwise
+	ValueSlot* values_;
+
+	// Table being migrated by an incremental rehash, slots before migrateIndex_ are already moved
+	bool incrementalRehash_;
+	size_t rehashThreads_;
+	TKey* oldData_;
+	uint8_t* oldMetadata_;
+	Hash_t* oldHashes_;
+	ValueSlot* oldValues_;
+	size_t oldCapacity_;
+	size_t migrateIndex_;
+
+	// File mapping which holds the arrays of a loaded set until the first rehash
+	MappedFile* mapping_;
+
+	TStats stats_;
+
+	//-----------------------------------------------------------------------------
+	// Home slot of hash in a table of capacity slots, the low bits of the hash are left to computeHashLow()
+	static Hash_t homeSlot(Hash_t hash, size_t capacity) {
+		return TGrowth::homeSlot(hash, capacity);
+	}
+	//-----------------------------------------------------------------------------
+	uint8_t computeHashLow(Hash_t hash) const {
+		return static_cast<uint8_t>(hash & LOW_MASK);
+	}
+	//-----------------------------------------------------------------------------
+	// Smallest capacity of the growth policy which holds elementCount elements
+	static size_t capacityFor(size_t elementCount, float maxLoadFactor) {
+		size_t capacity = TGrowth::capacityAtLeast(static_cast<size_t>(static_cast<double>(elementCount) / maxLoadFactor), MIN_CAPACITY);
+		while (static_cast<float>(elementCount) > maxLoadFactor * capacity) {
+			capacity = TGrowth::grow(capacity, MIN_CAPACITY);
+		}
+		return capacity;
+	}
+	//-----------------------------------------------------------------------------
+	float loadFactor() const {
+		return static_cast<float>(count_) / capacity_;
+	}
+	//-----------------------------------------------------------------------------
+	float tombstoneFactor() const {
+		return static_cast<float>(tombstones_) / capacity_;
+	}
+	//-----------------------------------------------------------------------------
+	// Hash of the element stored in slot idx of the given arrays
+	Hash_t slotHash(const TKey* data, const Hash_t* hashes, size_t idx) const {
+		if constexpr (StoreHash) {
+			return hashes[idx];
+		} else {
+			return hasher_(data[idx]);
+		}
+	}
+	//-----------------------------------------------------------------------------
+	// Final check of a slot whose fingerprint matched, the stored hash filters out
+	// fingerprint collisions before the possibly expensive key compare
+	template<class K>
+	bool slotMatches(const TKey* data, const Hash_t* hashes, size_t idx, const K& key, Hash_t hash) const {
+		if constexpr (StoreHash) {
+			if (hashes[idx] != hash) {
+				stats_.onFingerprintMatch(false);
+				return false;
+			}
+		}
+		stats_.onKeyCompare();
+		const bool equal = equal_(data[idx], key);
+		stats_.onFingerprintMatch(equal);
+		return equal;
+	}
+	//-----------------------------------------------------------------------------
+	// Reports a lookup to the stats policy. The kernels do not track where a miss ended,
+	// so with stats enabled the probe sequence of a miss is walked again to its empty slot.
+	void recordLookup(const uint8_t* metadata, size_t capacity, Hash_t hash, size_t idx) const {
+		if constexpr (TStats::ENABLED) {
+			const Hash_t startIndex = homeSlot(hash, capacity);
+			const bool hit = idx != NPOS;
+			if constexpr (GROUPED) {
+				// Slots of all groups visited before the last one count in full
+				const Hash_t groupMask = (capacity - 1) >> GROUP_SHIFT;
+				Hash_t group = startIndex >> GROUP_SHIFT;
+				size_t groupsBefore = 0;
+				for (Hash_t step = 1; step <= groupMask && (hit ? group != (idx >> GROUP_SHIFT) : groupMatch(metadata, group, 0) == 0); ++step) {
+					group = (group + step) & groupMask;
+					++groupsBefore;
+				}
+				unsigned long firstEmpty = GROUP_SLOTS - 1;
+				if (!hit)
+					bitScanForward(&firstEmpty, groupMatch(metadata, group, 0));
+				const size_t lastSlot = hit ? (idx & (GROUP_SLOTS - 1)) : firstEmpty;
+				stats_.onLookup(hit, (groupsBefore << GROUP_SHIFT) + lastSlot + 1);
+				return;
+			}
+
+			if (!hit) {
+				idx = startIndex;
+				for (size_t n = 1; n < capacity && metadata[idx] != 0; ++n) {
+					idx = TGrowth::next(idx, capacity);
+				}
+			}
+			stats_.onLookup(hit, (idx >= startIndex ? idx - startIndex : idx + capacity - startIndex) + 1);
+		}
+	}
+	//-----------------------------------------------------------------------------
+	// Probes with key and constructs the element from args only once the key is known to be absent.
+	// Returns true if the element was inserted.
+	template<class K, class... Args>
+	bool insertHashed(const K& key, const Hash_t hash, Args&&... args) {
+		ensureArrays();
+		if (oldData_) {
+			migrateStep();
+			if (oldData_ && indexOfOld(key, hash) != NPOS)
+				return false;
+		}
+
+		TKey* insertSpot = findInsertSpotTemplate(key, hash);
+		
+		// Spot not found or the key is already present
+		if (insertSpot == nullptr)
+			return false;
+
+		// Slots are raw memory until an element is placed there
+		try {
+			new (insertSpot) TKey(std::forward<Args>(args)...);
+		} catch (...) {
+			// The claimed slot holds no element, a tombstone keeps the probes through it intact
+			metadata_[insertSpot - data_] = TOMBSTONE_MASK;
+			++tombstones_;
+			throw;
+		}
+		++count_;
+
+		if (loadFactor() > maxLoadFactor_) {
+			grow();
+		} else if (tombstoneFactor() > MAX_TOMBSTONE_FACTOR) {
+			purgeTombstones();
+		}
+		return true;
+	}
+	//-----------------------------------------------------------------------------
+	// Places a key which is known to be absent at the first free slot of its probe sequence,
+	// skipping all key compares. Expects no migration and a table reserved for the key.
+	void placeAbsent(const TKey& key, const Hash_t hash) {
+		ensureArrays();
+		new (claimSlot(firstFreeSlot(hash), hash)) TKey(key);
+		++count_;
+	}
+	//-----------------------------------------------------------------------------
+	// Inserts an element whose key is known to be absent from both tables, e.g. after a failed find().
+	// Claims the first free slot of its probe without key compares and calls construct(TKey*, ValueSlot*)
+	// on the raw slot. Unlike insertHashed() it grows or purges before the insert, so the returned
+	// element stays where it was constructed.
+	template<class TConstruct>
+	TKey* insertAbsent(const Hash_t hash, TConstruct&& construct) {
+		ensureArrays();
+		if (oldData_)
+			migrateStep();
+		if (static_cast<float>(count_ + 1) / capacity_ > maxLoadFactor_) {
+			grow();
+		} else if (tombstoneFactor() > MAX_TOMBSTONE_FACTOR) {
+			purgeTombstones();
+		}
+
+		const size_t idx = firstFreeSlot(hash);
+		TKey* element = claimSlot(idx, hash);
+		ValueSlot* value = nullptr;
+		if constexpr (HAS_VALUES)
+			value = &values_[idx];
+		try {
+			construct(element, value);
+		} catch (...) {
+			metadata_[idx] = TOMBSTONE_MASK;
+			++tombstones_;
+			throw;
+		}
+		++count_;
+		return element;
+	}
+	//-----------------------------------------------------------------------------
+	// Value of an element stored in either table
+	ValueSlot* valueOf(const TKey* element) const {
+		const size_t slot = slotOf(element);
+		return slot < capacity_ ? &values_[slot] : &oldValues_[slot - capacity_];
+	}
+	//-----------------------------------------------------------------------------
+	// Pulls the home slot of hash into the cache ahead of its probe. Expects allocated arrays.
+	void prefetchHome(Hash_t hash) const {
+		const Hash_t idx = homeSlot(hash, capacity_);
+		_mm_prefetch(reinterpret_cast<const char*>(&metadata_[idx]), _MM_HINT_T0);
+		_mm_prefetch(reinterpret_cast<const char*>(&data_[idx]), _MM_HINT_T0);
+		if constexpr (HAS_VALUES)
+			_mm_prefetch(reinterpret_cast<const char*>(&values_[idx]), _MM_HINT_T0);
+	}
+	//-----------------------------------------------------------------------------
+	// Destroys the element in slot idx and leaves a tombstone, the counters are updated by finishErase()
+	void eraseSlot(size_t idx) {
+		destroySlot(data_, values_, idx);
+		metadata_[idx] = TOMBSTONE_MASK;
+	}
+	//-----------------------------------------------------------------------------
+	// Accounts for erased eraseSlot() calls. Tombstones which no probe passes are dropped,
+	// the rest is purged in place if needed.
+	void finishErase(size_t erased) {
+		if (erased == 0)
+			return;
+
+		count_ -= erased;
+		tombstones_ += erased;
+
+		// Backwards so a whole run of tombstones in front of an empty slot is cleared
+		for (size_t i = capacity_; i-- > 0;) {
+			if (metadata_[i] == TOMBSTONE_MASK && endsProbes(i)) {
+				metadata_[i] = 0;
+				--tombstones_;
+			}
+		}
+
+		if (loadFactor() < minLoadFactor_ && capacity_ > MIN_CAPACITY) {
+			shrinkToFit();
+		} else if (tombstoneFactor() > MAX_TOMBSTONE_FACTOR) {
+			purgeTombstones();
+		}
+	}
+	//-----------------------------------------------------------------------------
+	// Calls func(const TKey&, Hash_t) with every element and its hash, both tables during a migration
+	template<class TFunc>
+	void forEachSlotHashed(TFunc&& func) const {
+		forEachSlot(metadata_, capacity_, [&](size_t i) { func(static_cast<const TKey&>(data_[i]), slotHash(data_, hashes_, i)); });
+		if (oldData_)
+			forEachSlot(oldMetadata_, oldCapacity_, [&](size_t i) { func(static_cast<const TKey&>(oldData_[i]), slotHash(oldData_, oldHashes_, i)); });
+	}
+	//-----------------------------------------------------------------------------
+	// Slot of a stored element, slots of the table being migrated follow the ones of the current table
+	size_t slotOf(const TKey* element) const {
+		const uintptr_t address = reinterpret_cast<uintptr_t>(element);
+		const uintptr_t data = reinterpret_cast<uintptr_t>(data_);
+		if (address >= data && address < data + sizeof(TKey) * capacity_)
+			return element - data_;
+		return capacity_ + (element - oldData_);
+	}
+	//-----------------------------------------------------------------------------
+	// Hash of key for this set's hasher, given its hash in owner
+	Hash_t hashFor(const LPHashTable& owner, const TKey& key, Hash_t ownerHash) const {
+		return &owner == this || sameHashFunction(hasher_, owner.hasher_) ? ownerHash : hasher_(key);
+	}
+	//-----------------------------------------------------------------------------
+	// Looks up every element of source in this set and calls onResult(const TKey& key, Hash_t hash, const TKey* found),
+	// where key is the element in source and hash its hash in this set. Hashes and the prefetches of the home slots
+	// run a window ahead of the probes. With a shared hash function the hashes stored in source are reused, and if the
+	// capacities match too source is walked in the slot order of this table, so the probes stream through it in order.
+	template<class TFunc>
+	void probeEach(const LPHashTable& source, TFunc&& onResult) const {
+		const bool sharedHash = sameHashFunction(hasher_, source.hasher_);
+		// Probes without the window if they stream through this table in order anyway, or if it has
+		// no arrays to prefetch yet
+		const bool direct = (sharedHash && source.capacity_ == capacity_ && !source.oldData_ && !oldData_) || data_ == nullptr;
+		const TKey* window[BATCH_WINDOW];
+		Hash_t windowHashes[BATCH_WINDOW];
+		size_t windowSize = 0;
+		auto flush = [&]() {
+			for (size_t i = 0; i < windowSize; ++i) {
+				onResult(*window[i], windowHashes[i], find(*window[i], windowHashes[i]));
+			}
+			windowSize = 0;
+		};
+		auto visit = [&](const TKey* data, const uint8_t* metadata, const Hash_t* hashes, size_t capacity) {
+			forEachSlot(metadata, capacity, [&](size_t i) {
+				const Hash_t hash = sharedHash ? source.slotHash(data, hashes, i) : hasher_(data[i]);
+				if (direct) {
+					onResult(data[i], hash, find(data[i], hash));
+					return;
+				}
+
+				const Hash_t startIndex = homeSlot(hash, capacity_);
+				_mm_prefetch(reinterpret_cast<const char*>(&metadata_[startIndex]), _MM_HINT_T0);
+				_mm_prefetch(reinterpret_cast<const char*>(&data_[startIndex]), _MM_HINT_T0);
+				window[windowSize] = &data[i];
+				windowHashes[windowSize] = hash;
+				if (++windowSize == BATCH_WINDOW)
+					flush();
+			});
+		};
+
+		visit(source.data_, source.metadata_, source.hashes_, source.capacity_);
+		if (source.oldData_)
+			visit(source.oldData_, source.oldMetadata_, source.oldHashes_, source.oldCapacity_);
+		flush();
+	}
+	//-----------------------------------------------------------------------------
+	// Number of elements of a forward range, 0 for single pass ranges which can not be counted
+	template<class TIter>
+	static size_t rangeSize(TIter first, TIter last) {
+		using Category = typename std::iterator_traits<TIter>::iterator_category;
+		if constexpr (std::is_base_of<std::forward_iterator_tag, Category>::value) {
+			return static_cast<size_t>(std::distance(first, last));
+		} else {
+			return 0;
+		}
+	}
+	//-----------------------------------------------------------------------------
+	// The table is split into regions of consecutive slots. First every thread
+	// hashes a chunk of the input and sorts the positions by region, then every region is
+	// filled by a single thread, so no two threads write the same slot. A probe which would
+	// run past the end of its region is deferred and finished serially at the end.
+	// Expects the table to be reserved for all keys and not to be migrating.
+	template<class TIter>
+	void insertParallel(TIter first, size_t size, size_t threadCount) {
+		// Regions only hold empty and valid slots
+		if (tombstones_ > 0)
+			purgeTombstones();
+
+		// Regions of at least 64 slots which split the table evenly
+		size_t regionBits = 0;
+		while ((static_cast<size_t>(1) << regionBits) < threadCount * REGIONS_PER_THREAD
+			&& (capacity_ >> (regionBits + 1)) >= 64 && capacity_ % (static_cast<size_t>(2) << regionBits) == 0) {
+			++regionBits;
+		}
+		const size_t regionCount = static_cast<size_t>(1) << regionBits;
+		const size_t regionSize = capacity_ >> regionBits;
+		size_t regionShift = 0;
+		while ((static_cast<size_t>(1) << regionShift) < regionSize) {
+			++regionShift;
+		}
+		auto regionOf = [&](Hash_t slot) -> size_t {
+			if constexpr (TGrowth::POWER_OF_TWO)
+				return slot >> regionShift;
+			else
+				return slot / regionSize;
+		};
+
+		// positions[thread][region] - input offsets of the chunk of thread which hash into region
+		std::vector<std::vector<std::vector<size_t>>> positions(threadCount, std::vector<std::vector<size_t>>(regionCount));
+		std::vector<std::vector<size_t>> deferred(regionCount);
+		std::vector<size_t> inserted(threadCount, 0);
+		std::atomic<size_t> nextRegion{ 0 };
+
+		auto runThreads = [&](auto&& work) {
+			std::vector<std::thread> threads;
+			for (size_t t = 1; t < threadCount; ++t) {
+				threads.emplace_back(work, t);
+			}
+			work(0);
+			for (auto& thread : threads) {
+				thread.join();
+			}
+		};
+
+		runThreads([&](size_t t) {
+			const size_t chunkBegin = size * t / threadCount;
+			const size_t chunkEnd = size * (t + 1) / threadCount;
+			for (size_t i = chunkBegin; i < chunkEnd; ++i) {
+				positions[t][regionOf(homeSlot(hasher_(first[i]), capacity_))].push_back(i);
+			}
+		});
+
+		runThreads([&](size_t t) {
+			for (size_t region = nextRegion++; region < regionCount; region = nextRegion++) {
+				const Hash_t regionEnd = (region + 1) * regionSize;
+				for (size_t source = 0; source < threadCount; ++source) {
+					for (const size_t i : positions[source][region]) {
+						const TKey& key = first[i];
+						const Hash_t hash = hasher_(key);
+						const uint8_t control = computeHashLow(hash) | VALID_ELEMENT_MASK;
+
+						// Like findInsertSpot but bounded by the region, no stats are recorded
+						Hash_t slot = homeSlot(hash, capacity_);
+						for (; slot < regionEnd && metadata_[slot] != 0; ++slot) {
+							if (metadata_[slot] == control && (!StoreHash || hashes_[slot] == hash) && equal_(data_[slot], key))
+								break;
+						}
+
+						if (slot == regionEnd) {
+							deferred[region].push_back(i);
+						} else if (metadata_[slot] == 0) {
+							new (&data_[slot]) TKey(key);
+							metadata_[slot] = control;
+							if constexpr (StoreHash)
+								hashes_[slot] = hash;
+							++inserted[t];
+						}
+					}
+				}
+			}
+		});
+
+		for (const size_t count : inserted) {
+			count_ += count;
+		}
+		for (const auto& regionDeferred : deferred) {
+			for (const size_t i : regionDeferred) {
+				insert(first[i]);
+			}
+		}
+	}
+	//-----------------------------------------------------------------------------
+	// Bit i is set if slot base + i holds an element. The valid flag is the top bit of a
+	// control byte so movemask extracts it directly. Capacities are multiples of 32.
+	static uint64_t validMask(const uint8_t* metadata, size_t base, size_t capacity) {
+		const size_t count = capacity - base < 64 ? capacity - base : 64;
+		uint64_t mask = 0;
+		for (size_t i = 0; i < count; i += 16) {
+			const __m128i group = _mm_loadu_si128(reinterpret_cast<const __m128i*>(metadata + base + i));
+			mask |= static_cast<uint64_t>(static_cast<uint32_t>(_mm_movemask_epi8(group))) << i;
+		}
+		return mask;
+	}
+	//-----------------------------------------------------------------------------
+	// Calls func(index) for every valid slot of the given metadata array
+	template<class TFunc>
+	static void forEachSlot(const uint8_t* metadata, size_t capacity, TFunc&& func) {
+		for (size_t base = 0; base < capacity; base += 64) {
+			uint64_t mask = validMask(metadata, base, capacity);
+			unsigned long firstSet;
+			while (bitScanForward(&firstSet, mask)) {
+				func(base + firstSet);
+				mask &= mask - 1;
+			}
+		}
+	}
+	//-----------------------------------------------------------------------------
+	// Empty sets share EMPTY_METADATA, every probe of it ends at its first slot
+	void useEmptyArrays() {
+		data_ = nullptr;
+		metadata_ = const_cast<uint8_t*>(EMPTY_METADATA);
+		hashes_ = nullptr;
+		values_ = nullptr;
+	}
+	//-----------------------------------------------------------------------------
+	void ensureArrays() {
+		if (data_ == nullptr)
+			allocArrays();
+	}
+	//-----------------------------------------------------------------------------
+	void allocArrays() {
+		data_ = static_cast<TKey*>(allocator_.allocate(sizeof(TKey) * capacity_));
+		metadata_ = static_cast<uint8_t*>(allocator_.allocate(capacity_));
+		memset(metadata_, 0, capacity_);
+		hashes_ = StoreHash ? static_cast<Hash_t*>(allocator_.allocate(sizeof(Hash_t) * capacity_)) : nullptr;
+		values_ = HAS_VALUES ? static_cast<ValueSlot*>(allocator_.allocate(sizeof(ValueSlot) * capacity_)) : nullptr;
+	}
+	//-----------------------------------------------------------------------------
+	// Frees arrays of allocArrays(), arrays of a loaded set release the file mapping instead
+	void freeArrays(TKey* data, uint8_t* metadata, Hash_t* hashes, ValueSlot* values, size_t capacity) {
+		if (data == nullptr)
+			return;
+
+		if (mapping_ && metadata == mapping_->data() + LPHashSetFileHeader::FILE_ALIGNMENT) {
+			delete mapping_;
+			mapping_ = nullptr;
+			return;
+		}
+
+		allocator_.deallocate(metadata, capacity);
+		allocator_.deallocate(data, sizeof(TKey) * capacity);
+		if constexpr (StoreHash)
+			allocator_.deallocate(hashes, sizeof(Hash_t) * capacity);
+		if constexpr (HAS_VALUES)
+			allocator_.deallocate(values, sizeof(ValueSlot) * capacity);
+	}
+	//-----------------------------------------------------------------------------
+	// Offsets of the arrays in a saved file and its total size
+	struct FileLayout {
+		size_t metadata_;
+		size_t data_;
+		size_t hashes_;
+		size_t size_;
+	};
+	//-----------------------------------------------------------------------------
+	static FileLayout fileLayout(size_t capacity) {
+		auto align = [](size_t offset) {
+			return (offset + LPHashSetFileHeader::FILE_ALIGNMENT - 1) & ~(LPHashSetFileHeader::FILE_ALIGNMENT - 1);
+		};
+
+		FileLayout layout;
+		layout.metadata_ = LPHashSetFileHeader::FILE_ALIGNMENT;
+		layout.data_ = align(layout.metadata_ + capacity);
+		layout.hashes_ = align(layout.data_ + sizeof(TKey) * capacity);
+		layout.size_ = StoreHash ? align(layout.hashes_ + sizeof(Hash_t) * capacity) : layout.hashes_;
+		return layout;
+	}
+	//-----------------------------------------------------------------------------
+	// Writes size bytes followed by zeros up to paddedSize
+	static bool writePadded(FILE* file, const void* data, size_t size, size_t paddedSize) {
+		static const uint8_t zeros[LPHashSetFileHeader::FILE_ALIGNMENT] = {};
+		if (size > 0 && fwrite(data, 1, size, file) != size)
+			return false;
+		const size_t padding = paddedSize - size;
+		return padding == 0 || fwrite(zeros, 1, padding, file) == padding;
+	}
+	//-----------------------------------------------------------------------------
+	// Mix of the hashes of the first elements in slot order. Saved sets store it and load()
+	// recomputes it with its own hasher, so a set is never probed with a different hash function.
+	Hash_t hashCheck() const {
+		constexpr size_t SAMPLES = 16;
+		Hash_t check = count_;
+		size_t sampled = 0;
+		for (size_t i = 0; i < capacity_ && sampled < SAMPLES && sampled < count_; ++i) {
+			if (metadata_[i] & VALID_ELEMENT_MASK) {
+				check = mulFold(check ^ hasher_(data_[i]), 0x9E3779B97F4A7C15ull);
+				++sampled;
+			}
+		}
+		return check;
+	}
+	//-----------------------------------------------------------------------------
+	void grow() {
+		resize(TGrowth::grow(capacity_, MIN_CAPACITY));
+	}
+	//-----------------------------------------------------------------------------
+	// Rehashes into a table of newCapacity, in incremental mode only allocates it and leaves the moves to migrateStep()
+	void resize(size_t newCapacity) {
+		if (!incrementalRehash_) {
+			rehash(newCapacity);
+			return;
+		}
+
+		// The previous migration has to finish before the table can be resized again
+		finishMigration();
+		// Only the allocation, the migration itself is spread over the following operations
+		const RehashTimer<TStats> timer(stats_);
+
+		oldData_ = data_;
+		oldMetadata_ = metadata_;
+		oldHashes_ = hashes_;
+		oldValues_ = values_;
+		oldCapacity_ = capacity_;
+		migrateIndex_ = 0;
+
+		capacity_ = newCapacity;
+		allocArrays();
+		tombstones_ = 0;
+	}
+	//-----------------------------------------------------------------------------
+	void migrateStep() {
+		const size_t end = migrateIndex_ + MIGRATION_STEP < oldCapacity_ ? migrateIndex_ + MIGRATION_STEP : oldCapacity_;
+		migrateSlots(end);
+	}
+	//-----------------------------------------------------------------------------
+	void finishMigration() {
+		if (oldData_)
+			migrateSlots(oldCapacity_);
+	}
+	//-----------------------------------------------------------------------------
+	void migrateSlots(size_t end) {
+		for (; migrateIndex_ < end; ++migrateIndex_) {
+			if (oldMetadata_[migrateIndex_] & VALID_ELEMENT_MASK) {
+				// Keys are unique across both tables
+				const Hash_t hash = slotHash(oldData_, oldHashes_, migrateIndex_);
+				relocateSlot(firstFreeSlot(hash), hash, oldData_, oldValues_, migrateIndex_);
+				// Tombstone keeps the probe sequences of the not yet migrated slots intact
+				oldMetadata_[migrateIndex_] = TOMBSTONE_MASK;
+			}
+		}
+
+		if (migrateIndex_ == oldCapacity_)
+			freeOldArrays();
+	}
+	//-----------------------------------------------------------------------------
+	void freeOldArrays() {
+		freeArrays(oldData_, oldMetadata_, oldHashes_, oldValues_, oldCapacity_);
+		oldData_ = nullptr;
+		oldMetadata_ = nullptr;
+		oldHashes_ = nullptr;
+		oldValues_ = nullptr;
+		oldCapacity_ = 0;
+		migrateIndex_ = 0;
+	}
+	//-----------------------------------------------------------------------------
+	template<class K>
+	void removeImpl(const K& key) {
+		if (oldData_)
+			migrateStep();
+
+		size_t idx = indexOfTemplate(key);
+		if (idx == NPOS) {
+			if (oldData_)
+				removeOld(key);
+			return;
+		}
+
+		if (endsProbes(idx)) {
+			metadata_[idx] = 0;
+		} else {
+			metadata_[idx] = TOMBSTONE_MASK;
+			++tombstones_;
+		}
+		destroySlot(data_, values_, idx);
+		--count_;
+
+		if (loadFactor() < minLoadFactor_ && capacity_ > MIN_CAPACITY && !oldData_)
+			resize(TGrowth::shrink(capacity_, MIN_CAPACITY));
+	}
+	//-----------------------------------------------------------------------------
+	template<class K>
+	void removeOld(const K& key) {
+		const size_t idx = indexOfOld(key, hasher_(key));
+		if (idx == NPOS)
+			return;
+
+		oldMetadata_[idx] = TOMBSTONE_MASK;
+		destroySlot(oldData_, oldValues_, idx);
+		--count_;
+	}
+	//-----------------------------------------------------------------------------
+	// Scalar probe of the table being migrated, only used during an incremental rehash. Grouped sets
+	// probe it like the current table.
+	template<class K>
+	size_t indexOfOld(const K& key, const Hash_t hash) const {
+		if constexpr (GROUPED)
+			return indexOfGrouped(oldData_, oldMetadata_, oldHashes_, oldCapacity_, key, hash);
+
+		const uint8_t hashLow = computeHashLow(hash);
+		const Hash_t startIndex = homeSlot(hash, oldCapacity_);
+
+		for (Hash_t i = startIndex;;) {
+			if (oldMetadata_[i] == 0)
+				return NPOS;
+
+			if (oldMetadata_[i] == (hashLow | VALID_ELEMENT_MASK) && slotMatches(oldData_, oldHashes_, i, key, hash))
+				return i;
+
+			i = TGrowth::next(i, oldCapacity_);
+			if (i == startIndex)
+				return NPOS;
+		}
+	}
+	//-----------------------------------------------------------------------------
+	template<class K>
+	const TKey* find(const K& key, const Hash_t hash) const {
+		const size_t idx = indexOfTemplate(key, hash);
+		if (idx != NPOS) {
+			recordLookup(metadata_, capacity_, hash, idx);
+			return &data_[idx];
+		}
+
+		if (oldData_) {
+			const size_t oldIdx = indexOfOld(key, hash);
+			if (oldIdx != NPOS) {
+				recordLookup(oldMetadata_, oldCapacity_, hash, oldIdx);
+				return &oldData_[oldIdx];
+			}
+		}
+
+		recordLookup(metadata_, capacity_, hash, NPOS);
+		return nullptr;
+	}
+	//-----------------------------------------------------------------------------
+	// threadCount 0 uses rehashThreads_
+	void rehash(size_t newCapacity, size_t threadCount = 0) {
+		const RehashTimer<TStats> timer(stats_);
+		Hash_t oldCapacity = capacity_;
+		capacity_ = newCapacity;
+		
+		TKey* oldData = data_;
+		uint8_t* oldMetadata = metadata_;
+		Hash_t* oldHashes = hashes_;
+		ValueSlot* oldValues = values_;
+
+		allocArrays();
+		tombstones_ = 0;
 
-//-----------------------------------------------------------------------------
-using Hash_t = uint64_t;
+		if (threadCount == 0)
+			threadCount = rehashThreads_;
+		if constexpr (PARALLEL_REHASH) {
+			if (threadCount > 1 && count_ >= PARALLEL_REHASH_THRESHOLD) {
+				rehashParallel(oldData, oldMetadata, oldHashes, oldValues, oldCapacity, threadCount);
+				freeArrays(oldData, oldMetadata, oldHashes, oldValues, oldCapacity);
+				return;
+			}
+		}
 
-//-----------------------------------------------------------------------------
-template<class TKey>
-using HashFunc_t = Hash_t(*)(const TKey&);
+		forEachSlot(oldMetadata, oldCapacity, [&](size_t i) {
+			// Keys are unique and the new table has no tombstones, the first empty slot is the spot
+			const Hash_t hash = slotHash(oldData, oldHashes, i);
+			relocateSlot(firstFreeSlot(hash), hash, oldData, oldValues, i);
+		});
 
-//-----------------------------------------------------------------------------
-template<class TKey>
-Hash_t defaultHashFunc(const TKey&) {
-	static_assert(false, "defaultHashFunc must be specialized");
-}
+		freeArrays(oldData, oldMetadata, oldHashes, oldValues, oldCapacity);
+	}
+	//-----------------------------------------------------------------------------
+	// The new table is split into regions of consecutive slots and every task moves the elements
+	// whose new home slot is in its regions, so no two threads write the same slot. A task scans
+	// the old home slots which can map into its regions plus the probe runs past their end and
+	// skips elements of other tasks. A probe which would run past the end of its region is
+	// deferred and finished serially. Power of two tables keep the low bits of a home slot,
+	// so on growth one task fills every new region fed by the same old slots and reads them once.
+	void rehashParallel(TKey* oldData, const uint8_t* oldMetadata, const Hash_t* oldHashes, ValueSlot* oldValues, size_t oldCapacity, size_t threadCount) {
+		const size_t smaller = capacity_ < oldCapacity ? capacity_ : oldCapacity;
+		const size_t wantedTasks = threadCount * REGIONS_PER_THREAD;
+		size_t regionSize = smaller;
+		size_t regionShift = 0;
+		size_t taskCount = 0;
+		if constexpr (TGrowth::POWER_OF_TWO) {
+			while (smaller / regionSize < wantedTasks && regionSize >= 128) {
+				regionSize >>= 1;
+			}
+			while ((static_cast<size_t>(1) << regionShift) < regionSize) {
+				++regionShift;
+			}
+			taskCount = smaller / regionSize;
+		} else {
+			regionSize = (capacity_ / wantedTasks + 63) / 64 * 64;
+			taskCount = (capacity_ + regionSize - 1) / regionSize;
+		}
 
-//-----------------------------------------------------------------------------
-template<>
-Hash_t defaultHashFunc<int>(const int& key) {
-	return 17 + static_cast<Hash_t>(key) * 2654435761;
-}
+		// Scalars are captured by value, the metadata stores could alias them
+		auto taskOf = [regionShift, taskCount, regionSize](Hash_t home) -> size_t {
+			if constexpr (TGrowth::POWER_OF_TWO)
+				return (home >> regionShift) & (taskCount - 1);
+			else
+				return home / regionSize;
+		};
+		auto regionEndOf = [regionShift, regionSize, capacity = capacity_](Hash_t home) -> size_t {
+			if constexpr (TGrowth::POWER_OF_TWO) {
+				return ((home >> regionShift) + 1) << regionShift;
+			} else {
+				const size_t end = (home / regionSize + 1) * regionSize;
+				return end < capacity ? end : capacity;
+			}
+		};
 
-//-----------------------------------------------------------------------------
-template<>
-Hash_t defaultHashFunc<uint32_t>(const uint32_t& key) {
-	return 17 + static_cast<Hash_t>(key) * 2654435761;
-}
+		// Calls func(begin, end) for the old slot ranges holding the home slots of a task
+		auto forEachSource = [&](size_t task, auto&& func) {
+			if constexpr (TGrowth::POWER_OF_TWO) {
+				for (size_t begin = task * regionSize; begin < oldCapacity; begin += smaller) {
+					func(begin, begin + regionSize, (begin + smaller) % oldCapacity);
+				}
+			} else {
+				// Fast range keeps the order of hashes, the margin covers rounding of the scaled bounds
+				const double scale = static_cast<double>(oldCapacity) / capacity_;
+				const double first = static_cast<double>(task * regionSize) * scale - 1;
+				const double last = static_cast<double>((task + 1) * regionSize) * scale + 1;
+				const size_t begin = first <= 0 ? 0 : static_cast<size_t>(first) / 64 * 64;
+				const size_t end = last >= oldCapacity ? oldCapacity : (static_cast<size_t>(last) + 63) / 64 * 64;
+				func(begin, end < oldCapacity ? end : oldCapacity, begin);
+			}
+		};
 
-struct DefaultHash {
-	size_t operator()(const uint32_t& key) const {
-		return 17 + static_cast<size_t>(key) * 2654435761;
-	}
-};
+		std::vector<std::vector<size_t>> deferred(taskCount);
+		std::atomic<size_t> nextTask{ 0 };
 
-enum class LPHashSetPolicy {
-	Simple,
-	SSE,
-	AVX
-};
+		auto work = [&]() {
+			for (size_t task = nextTask++; task < taskCount; task = nextTask++) {
+				auto move = [&](size_t i) {
+					const Hash_t hash = slotHash(oldData, oldHashes, i);
+					const Hash_t home = homeSlot(hash, capacity_);
+					if (taskOf(home) != task)
+						return;
 
-//-----------------------------------------------------------------------------
-template<class TKey, LPHashSetPolicy Policy, HashFunc_t<TKey> hashFunc = defaultHashFunc<TKey>>
-class LPHashSet {
-public:
-	#define TESTING
-	#if defined(TESTING)
-		mutable uint64_t QueryCount{ 0 };
-		mutable uint64_t ElementsTested{ 0 };
-	#endif
-
-	//-----------------------------------------------------------------------------
-	LPHashSet()
-		: count_(0) 
-		, exponent_(5)
-		, EMPTY_MASK_128(_mm_set1_epi8(VALID_ELEMENT_MASK | TOMBSTONE_MASK))
-		, EMPTY_MASK_256(_mm256_set1_epi8(VALID_ELEMENT_MASK | TOMBSTONE_MASK))
-	{
-		capacity_ = static_cast<size_t>(1) << exponent_;
-		allocArrays();
-	}
-	//-----------------------------------------------------------------------------
-	~LPHashSet() {
-		for (size_t i = 0; i < capacity_; ++i) {
-			if (metadata_[i] & VALID_ELEMENT_MASK) {
-				data_[i].~TKey();
+					const size_t regionEnd = regionEndOf(home);
+					Hash_t slot = home;
+					for (; slot < regionEnd && metadata_[slot] != 0; ++slot) {}
+
+					if (slot == regionEnd) {
+						deferred[task].push_back(i);
+					} else {
+						relocateSlot(slot, hash, oldData, oldValues, i);
+					}
+				};
+
+				forEachSource(task, [&](size_t begin, size_t end, size_t nextBegin) {
+					forEachSlot(oldMetadata + begin, end - begin, [&](size_t i) { move(begin + i); });
+					// Elements with their home in the range can sit past its end, up to the next empty slot.
+					// The next range of the task is scanned on its own.
+					for (size_t i = end == oldCapacity ? 0 : end; i != nextBegin && oldMetadata[i] != 0; i = TGrowth::next(i, oldCapacity)) {
+						if (oldMetadata[i] & VALID_ELEMENT_MASK)
+							move(i);
+					}
+				});
 			}
+		};
+
+		std::vector<std::thread> threads;
+		for (size_t t = 1; t < threadCount && t < taskCount; ++t) {
+			threads.emplace_back(work);
+		}
+		work();
+		for (auto& thread : threads) {
+			thread.join();
 		}
 
-		free(metadata_);
-		free(data_);
+		for (const auto& taskDeferred : deferred) {
+			for (const size_t i : taskDeferred) {
+				const Hash_t hash = slotHash(oldData, oldHashes, i);
+				relocateSlot(firstFreeSlot(hash), hash, oldData, oldValues, i);
+			}
+		}
 	}
 	//-----------------------------------------------------------------------------
-	void insert(const TKey& key) {
-		TKey* insertSpot = findInsertSpot(key);
-		
-		// Spot not found or the key is already present
-		if (insertSpot == nullptr)
-			return;
+	// Same-capacity cleanup which drops all tombstones without allocating.
+	// Tombstones become empty and every element is marked pending (TOMBSTONE_MASK),
+	// each pending element is then moved to the first non-valid slot of its probe sequence.
+	// Slots marked valid are final so the probe invariant holds for the rebuilt table,
+	// for linear and grouped probe sequences alike.
+	void purgeTombstones() {
+		stats_.onTombstonePurge();
+		for (size_t i = 0; i < capacity_; ++i) {
+			metadata_[i] = (metadata_[i] & VALID_ELEMENT_MASK) ? TOMBSTONE_MASK : 0;
+		}
 
-		*insertSpot = key;
-		++count_;
+		for (size_t i = 0; i < capacity_; ++i) {
+			while (metadata_[i] == TOMBSTONE_MASK) {
+				const Hash_t hash = slotHash(data_, hashes_, i);
+				const uint8_t hashLow = computeHashLow(hash);
+				const Hash_t target = firstFreeSlot(hash);
 
-		if (loadFactor() > MAX_LOAD_FACTOR) {
-			rehash();
+				if (target == i) {
+					// Already at the first free spot of its probe sequence
+					metadata_[i] = hashLow | VALID_ELEMENT_MASK;
+				} else if (metadata_[target] == 0) {
+					relocate(&data_[target], &data_[i]);
+					if constexpr (HAS_VALUES)
+						relocate(&values_[target], &values_[i]);
+					metadata_[target] = hashLow | VALID_ELEMENT_MASK;
+					metadata_[i] = 0;
+					if constexpr (StoreHash)
+						hashes_[target] = hash;
+				} else {
+					// Target holds another pending element, swap and process it in the next iteration
+					swapSlots(&data_[i], &data_[target]);
+					if constexpr (HAS_VALUES)
+						swapSlots(&values_[i], &values_[target]);
+					metadata_[target] = hashLow | VALID_ELEMENT_MASK;
+					if constexpr (StoreHash) {
+						hashes_[i] = hashes_[target];
+						hashes_[target] = hash;
+					}
+				}
+			}
 		}
+
+		tombstones_ = 0;
 	}
 	//-----------------------------------------------------------------------------
-	void remove(const TKey& key) {
-		size_t idx = indexOfTemplate(key);
-		if (idx == NPOS)
-			return;
-
-		metadata_[idx] = TOMBSTONE_MASK;
-		data_[idx].~TKey();
-		--count_;
+	// Moves slot from of the given arrays into the free slot idx of the current table
+	void relocateSlot(size_t idx, Hash_t hash, TKey* fromData, ValueSlot* fromValues, size_t from) {
+		relocate(claimSlot(idx, hash), &fromData[from]);
+		if constexpr (HAS_VALUES)
+			relocate(&values_[idx], &fromValues[from]);
 	}
 	//-----------------------------------------------------------------------------
-	bool contains(const TKey& key) const {
-		return indexOfTemplate(key) != NPOS;
+	static void destroySlot(TKey* data, ValueSlot* values, size_t idx) {
+		data[idx].~TKey();
+		if constexpr (HAS_VALUES)
+			values[idx].~ValueSlot();
 	}
 	//-----------------------------------------------------------------------------
-	size_t count() const {
-		return count_;
+	// Moves the object at from into the raw memory at to and ends the lifetime of the original
+	template<class T>
+	static void relocate(T* to, T* from) {
+		if constexpr (IsTriviallyRelocatable<T>::value) {
+			memcpy(static_cast<void*>(to), static_cast<const void*>(from), sizeof(T));
+		} else {
+			new (to) T(std::move(*from));
+			from->~T();
+		}
 	}
 	//-----------------------------------------------------------------------------
-	size_t capacity() const {
-		return capacity_;
+	template<class T>
+	static void swapSlots(T* a, T* b) {
+		if constexpr (IsTriviallyRelocatable<T>::value) {
+			alignas(T) unsigned char temp[sizeof(T)];
+			memcpy(temp, static_cast<const void*>(a), sizeof(T));
+			memcpy(static_cast<void*>(a), static_cast<const void*>(b), sizeof(T));
+			memcpy(static_cast<void*>(b), temp, sizeof(T));
+		} else {
+			using std::swap;
+			swap(*a, *b);
+		}
 	}
-
-private:
-	static constexpr Hash_t VALID_ELEMENT_MASK = 1 << 7;	// 0b1000_0000
-	static constexpr uint8_t TOMBSTONE_MASK = 1 << 6;		// 0b0100_0000
-	static constexpr uint8_t LOW_MASK = 0x7F;				// 0b0111_1111
-	static constexpr float MAX_LOAD_FACTOR = 0.8f;
-	static constexpr size_t NPOS = -1;
-	const __m128i EMPTY_MASK_128; // TODO make static
-	const __m256i EMPTY_MASK_256; // TODO make static
-
-	size_t count_;
-	size_t capacity_;
-	size_t exponent_;
-
-	TKey* data_;
-	union {
-		uint8_t* metadata_;
-		__m128i* metadata_m128_;
-		__m256i* metadata_m256_;
-	};
-
 	//-----------------------------------------------------------------------------
-	Hash_t computeHashHigh(Hash_t hash) const {
-		return hash >> 8;
+	// First slot of the probe sequence of hash which holds no element
+	Hash_t firstFreeSlot(const Hash_t hash) const {
+		if constexpr (GROUPED) {
+			const Hash_t groupMask = (capacity_ - 1) >> GROUP_SHIFT;
+			Hash_t group = homeSlot(hash, capacity_) >> GROUP_SHIFT;
+			for (Hash_t step = 1;; ++step) {
+				// The valid flag is the top bit, movemask gives the occupied slots directly
+				const __m128i metadata = _mm_load_si128(metadata_m128_ + group);
+				const uint32_t freeMask = ~static_cast<uint32_t>(_mm_movemask_epi8(metadata)) & 0xFFFFu;
+				unsigned long firstFree;
+				if (bitScanForward(&firstFree, freeMask))
+					return (group << GROUP_SHIFT) + firstFree;
+				group = (group + step) & groupMask;
+			}
+		} else {
+			Hash_t target = homeSlot(hash, capacity_);
+			while (metadata_[target] & VALID_ELEMENT_MASK) {
+				target = TGrowth::next(target, capacity_);
+			}
+			return target;
+		}
 	}
 	//-----------------------------------------------------------------------------
-	uint8_t computeHashLow(Hash_t hash) const {
-		return static_cast<uint8_t>(hash & LOW_MASK);
+	// True if no probe sequence continues past slot idx, so it needs no tombstone once it is free.
+	// Linear probes end at the next empty slot, grouped ones at the first group with an empty slot.
+	bool endsProbes(size_t idx) const {
+		if constexpr (GROUPED) {
+			return groupMatch(metadata_, idx >> GROUP_SHIFT, 0) != 0;
+		} else {
+			return metadata_[TGrowth::next(idx, capacity_)] == 0;
+		}
 	}
 	//-----------------------------------------------------------------------------
-	float loadFactor() const {
-		return static_cast<float>(count_) / capacity_;
+	// Bit i is set if slot 16 * group + i of a grouped table holds control byte value
+	static uint32_t groupMatch(const uint8_t* metadata, Hash_t group, uint8_t value) {
+		const __m128i bytes = _mm_load_si128(reinterpret_cast<const __m128i*>(metadata) + group);
+		return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(static_cast<char>(value)))));
 	}
 	//-----------------------------------------------------------------------------
-	void allocArrays() {
-		data_ = static_cast<TKey*>(malloc(sizeof(TKey) * capacity_));
-		metadata_ = static_cast<uint8_t*>(malloc(capacity_));
-		memset(metadata_, 0, capacity_);
+	// Marks the slot as used, reusing a tombstone is accounted for
+	TKey* claimSlot(Hash_t idx, Hash_t hash) {
+		if (metadata_[idx] == TOMBSTONE_MASK)
+			--tombstones_;
+		metadata_[idx] = computeHashLow(hash) | VALID_ELEMENT_MASK;
+		if constexpr (StoreHash)
+			hashes_[idx] = hash;
+		return &data_[idx];
 	}
 	//-----------------------------------------------------------------------------
-	void rehash() {
-		++exponent_;
-		Hash_t oldCapacity = capacity_;
-		capacity_ = static_cast<size_t>(1) << exponent_;
-		
-		TKey* oldData = data_;
-		uint8_t* oldMetadata = metadata_;
+	template<class K>
+	TKey* findInsertSpot(const K& key, const Hash_t hash) {
+		const uint8_t hashLow = computeHashLow(hash);
+		const Hash_t startIndex = homeSlot(hash, capacity_);
 
-		allocArrays();
+		Hash_t firstTombstone = NPOS;
+		for (Hash_t i = startIndex;;) {
+			// data_[i] is empty - the key is not present, reuse the first tombstone if we passed one
+			if (metadata_[i] == 0)
+				return claimSlot(firstTombstone != NPOS ? firstTombstone : i, hash);
 
-		for (size_t i = 0; i < oldCapacity; ++i) {
-			if (oldMetadata[i] & VALID_ELEMENT_MASK) {
-				// this insert may be optimized - duplicate keys do not have to be checked
-				TKey* insertSpot = findInsertSpot(oldData[i]);
-				*insertSpot = std::move(oldData[i]);
-				oldData[i].~TKey();
+			if (metadata_[i] == TOMBSTONE_MASK) {
+				if (firstTombstone == NPOS)
+					firstTombstone = i;
+			} else if ((metadata_[i] & LOW_MASK) == hashLow && slotMatches(data_, hashes_, i, key, hash)) {
+				// if key already present, disallow second insertion
+				return nullptr;
 			}
-		}
 
-		free(oldData);
-		free(oldMetadata);
+			i = TGrowth::next(i, capacity_);
+			// Wrap around is not possible - tombstone and load factor limits keep an empty slot in the table
+		}
+		
+		return nullptr;
 	}
 	//-----------------------------------------------------------------------------
-	TKey* findInsertSpot(const TKey& key) const {
-		const Hash_t hash = hashFunc(key);
+	template<class K>
+	TKey* findInsertSpotSSE(const K& key, const Hash_t hash) {
 		const uint8_t hashLow = computeHashLow(hash);
-		const Hash_t hashHigh = computeHashHigh(hash);
-		const Hash_t modMask = capacity_ - 1;
-		const Hash_t startIndex = hashHigh & modMask;
+		const Hash_t groupCount = capacity_ >> 4;
+		const Hash_t startIndex = homeSlot(hash, capacity_);
 
-		for (Hash_t i = startIndex;;) {
-			// data_[i] is empty - this is the spot
-			if ((metadata_[i] & VALID_ELEMENT_MASK) == 0) {
-				metadata_[i] = hashLow | VALID_ELEMENT_MASK;
-				return &data_[i];
+		const Hash_t start = startIndex >> 4;
+		const Hash_t overlap = startIndex & 15;
+
+		const __m128i elemMask = _mm_set1_epi8(hashLow | VALID_ELEMENT_MASK);
+		const __m128i emptyMask = _mm_setzero_si128();
+		const __m128i tombstoneMask = _mm_set1_epi8(TOMBSTONE_MASK);
+
+		// Slots of the first group which lie before startIndex are not part of the probe sequence
+		uint32_t probeMask = (0xFFFFu << overlap) & 0xFFFFu;
+		Hash_t firstTombstone = NPOS;
+
+		for (Hash_t i = start;;) {
+			const __m128i group = metadata_m128_[i];
+			const uint32_t emptyResultMask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(group, emptyMask))) & probeMask;
+			uint32_t tombstoneResultMask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(group, tombstoneMask))) & probeMask;
+			uint32_t resultMask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(group, elemMask))) & probeMask;
+
+			unsigned long firstEmpty;
+			const char hasEmpty = bitScanForward(&firstEmpty, emptyResultMask);
+			// The probe sequence ends at the first empty slot
+			if (hasEmpty) {
+				resultMask &= (1u << firstEmpty) - 1;
+				tombstoneResultMask &= (1u << firstEmpty) - 1;
 			}
 
 			// if key already present, disallow second insertion
-			if ((metadata_[i] & LOW_MASK) == hashLow && data_[i] == key)
-				return nullptr;
+			while (true) {
+				unsigned long firstSet;
+				const char hasAnySet = bitScanForward(&firstSet, resultMask);
+				if (!hasAnySet)
+					break;
+
+				if (slotMatches(data_, hashes_, (i << 4) + firstSet, key, hash))
+					return nullptr;
+
+				resultMask &= ~(1u << firstSet);
+			}
+
+			unsigned long tombstoneFirstSet;
+			if (firstTombstone == NPOS && bitScanForward(&tombstoneFirstSet, tombstoneResultMask))
+				firstTombstone = (i << 4) + tombstoneFirstSet;
 
-			i = (i + 1) & modMask;
-			// Wrap around is not possible - it would mean that the table is 100% full
+			// The key is not present, reuse the first tombstone if we passed one
+			if (hasEmpty)
+				return claimSlot(firstTombstone != NPOS ? firstTombstone : (i << 4) + firstEmpty, hash);
+
+			probeMask = 0xFFFFu;
+			i = TGrowth::next(i, groupCount);
+			// Wrap around is not possible - tombstone and load factor limits keep an empty slot in the table
 		}
-		
+
 		return nullptr;
 	}
 	//-----------------------------------------------------------------------------
-	TKey* findInsertSpotSSE(const TKey& key) const {
-		// TODO implement
-
-		const Hash_t hash = hashFunc(key);
+	template<class K>
+	HS_TARGET_AVX2
+	TKey* findInsertSpotAVX(const K& key, const Hash_t hash) {
 		const uint8_t hashLow = computeHashLow(hash);
-		const Hash_t hashHigh = computeHashHigh(hash);
-		const Hash_t modMask = capacity_ - 1;
-		const Hash_t startIndex = hashHigh & modMask;
+		const Hash_t groupCount = capacity_ >> 5;
+		const Hash_t startIndex = homeSlot(hash, capacity_);
 
-		for (Hash_t i = startIndex;;) {
-			// data_[i] is empty - this is the spot
-			if ((metadata_[i] & VALID_ELEMENT_MASK) == 0) {
-				metadata_[i] = hashLow | VALID_ELEMENT_MASK;
-				return &data_[i];
+		// For indexing 32byte chunks
+		const Hash_t start = startIndex >> 5;
+		const Hash_t overlap = startIndex & 31;
+
+		const __m256i elemMask = _mm256_set1_epi8(hashLow | VALID_ELEMENT_MASK);
+		const __m256i emptyMask = _mm256_setzero_si256();
+		const __m256i tombstoneMask = _mm256_set1_epi8(TOMBSTONE_MASK);
+
+		uint32_t probeMask = 0xFFFFFFFFu << overlap;
+		Hash_t firstTombstone = NPOS;
+
+		for (Hash_t i = start;;) {
+			const __m256i group = metadata_m256_[i];
+			const uint32_t emptyResultMask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(group, emptyMask))) & probeMask;
+			uint32_t tombstoneResultMask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(group, tombstoneMask))) & probeMask;
+			uint32_t resultMask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(group, elemMask))) & probeMask;
+
+			unsigned long firstEmpty;
+			const char hasEmpty = bitScanForward(&firstEmpty, emptyResultMask);
+			if (hasEmpty) {
+				resultMask &= (1u << firstEmpty) - 1;
+				tombstoneResultMask &= (1u << firstEmpty) - 1;
 			}
 
-			// if key already present, disallow second insertion
-			if ((metadata_[i] & LOW_MASK) == hashLow && data_[i] == key)
-				return nullptr;
+			while (true) {
+				unsigned long firstSet;
+				const char hasAnySet = bitScanForward(&firstSet, resultMask);
+				if (!hasAnySet)
+					break;
+
+				if (slotMatches(data_, hashes_, (i << 5) + firstSet, key, hash))
+					return nullptr;
+
+				resultMask &= ~(1u << firstSet);
+			}
+
+			unsigned long tombstoneFirstSet;
+			if (firstTombstone == NPOS && bitScanForward(&tombstoneFirstSet, tombstoneResultMask))
+				firstTombstone = (i << 5) + tombstoneFirstSet;
+
+			if (hasEmpty)
+				return claimSlot(firstTombstone != NPOS ? firstTombstone : (i << 5) + firstEmpty, hash);
 
-			i = (i + 1) & modMask;
-			// Wrap around is not possible - it would mean that the table is 100% full
+			probeMask = 0xFFFFFFFFu;
+			i = TGrowth::next(i, groupCount);
 		}
 
 		return nullptr;
 	}
 	//-----------------------------------------------------------------------------
-	size_t indexOf(const TKey& key) const {
-		const Hash_t hash = hashFunc(key);
+	template<class K>
+	HS_TARGET_AVX512
+	TKey* findInsertSpotAVX512(const K& key, const Hash_t hash) {
 		const uint8_t hashLow = computeHashLow(hash);
-		const Hash_t hashHigh = computeHashHigh(hash);
-		const Hash_t modMask = capacity_ - 1;
-		const Hash_t startIndex = hashHigh & modMask;
+		const Hash_t groupCount = capacity_ >> 6;
+		const Hash_t startIndex = homeSlot(hash, capacity_);
+
+		// For indexing 64byte chunks
+		const Hash_t start = startIndex >> 6;
+		const Hash_t overlap = startIndex & 63;
+
+		const __m512i elemMask = _mm512_set1_epi8(hashLow | VALID_ELEMENT_MASK);
+		const __m512i tombstoneMask = _mm512_set1_epi8(TOMBSTONE_MASK);
+
+		uint64_t probeMask = ~static_cast<uint64_t>(0) << overlap;
+		Hash_t firstTombstone = NPOS;
+
+		for (Hash_t i = start;;) {
+			const __m512i group = metadata_m512_[i];
+			// Compares go straight to mask registers, no movemask needed
+			const uint64_t emptyResultMask = _mm512_testn_epi8_mask(group, group) & probeMask;
+			uint64_t tombstoneResultMask = _mm512_cmpeq_epi8_mask(group, tombstoneMask) & probeMask;
+			uint64_t resultMask = _mm512_cmpeq_epi8_mask(group, elemMask) & probeMask;
+
+			unsigned long firstEmpty;
+			const char hasEmpty = bitScanForward(&firstEmpty, emptyResultMask);
+			if (hasEmpty) {
+				const uint64_t beforeEmpty = (static_cast<uint64_t>(1) << firstEmpty) - 1;
+				resultMask &= beforeEmpty;
+				tombstoneResultMask &= beforeEmpty;
+			}
+
+			while (true) {
+				unsigned long firstSet;
+				const char hasAnySet = bitScanForward(&firstSet, resultMask);
+				if (!hasAnySet)
+					break;
+
+				if (slotMatches(data_, hashes_, (i << 6) + firstSet, key, hash))
+					return nullptr;
+
+				resultMask &= ~(static_cast<uint64_t>(1) << firstSet);
+			}
+
+			unsigned long tombstoneFirstSet;
+			if (firstTombstone == NPOS && bitScanForward(&tombstoneFirstSet, tombstoneResultMask))
+				firstTombstone = (i << 6) + tombstoneFirstSet;
+
+			if (hasEmpty)
+				return claimSlot(firstTombstone != NPOS ? firstTombstone : (i << 6) + firstEmpty, hash);
+
+			probeMask = ~static_cast<uint64_t>(0);
+			i = TGrowth::next(i, groupCount);
+		}
+
+		return nullptr;
+	}
+	//-----------------------------------------------------------------------------
+	// Insert counterpart of indexOfGrouped(), the first tombstone of any visited group is reused
+	template<class K>
+	TKey* findInsertSpotGrouped(const K& key, const Hash_t hash) {
+		const uint8_t control = computeHashLow(hash) | VALID_ELEMENT_MASK;
+		const Hash_t groupMask = (capacity_ - 1) >> GROUP_SHIFT;
+		Hash_t group = homeSlot(hash, capacity_) >> GROUP_SHIFT;
+
+		Hash_t firstTombstone = NPOS;
+		for (Hash_t step = 1;; ++step) {
+			uint32_t resultMask = groupMatch(metadata_, group, control);
+			while (true) {
+				unsigned long firstSet;
+				if (!bitScanForward(&firstSet, resultMask))
+					break;
+
+				// if key already present, disallow second insertion
+				if (slotMatches(data_, hashes_, (group << GROUP_SHIFT) + firstSet, key, hash))
+					return nullptr;
+
+				resultMask &= resultMask - 1;
+			}
+
+			unsigned long tombstoneFirstSet;
+			if (firstTombstone == NPOS && bitScanForward(&tombstoneFirstSet, groupMatch(metadata_, group, TOMBSTONE_MASK)))
+				firstTombstone = (group << GROUP_SHIFT) + tombstoneFirstSet;
+
+			// The key is not present, reuse the first tombstone if we passed one
+			unsigned long firstEmpty;
+			if (bitScanForward(&firstEmpty, groupMatch(metadata_, group, 0)))
+				return claimSlot(firstTombstone != NPOS ? firstTombstone : (group << GROUP_SHIFT) + firstEmpty, hash);
 
-		#if defined(TESTING)
-			++QueryCount;
-		#endif
+			group = (group + step) & groupMask;
+			// Wrap around is not possible - tombstone and load factor limits keep an empty slot in the table
+		}
+
+		return nullptr;
+	}
+	//-----------------------------------------------------------------------------
+	template<class K>
+	TKey* findInsertSpotTemplate(const K& key, const Hash_t hash) {
+		if constexpr (Policy == LPHashSetPolicy::Grouped) {
+			return findInsertSpotGrouped(key, hash);
+		} else if constexpr (Policy == LPHashSetPolicy::SSE) {
+			return findInsertSpotSSE(key, hash);
+		} else if constexpr (Policy == LPHashSetPolicy::AVX) {
+			return findInsertSpotAVX(key, hash);
+		} else if constexpr (Policy == LPHashSetPolicy::AVX512) {
+			return findInsertSpotAVX512(key, hash);
+		} else if constexpr (Policy == LPHashSetPolicy::Auto) {
+			switch (g_SimdLevel) {
+				case SimdLevel::AVX512:	return findInsertSpotAVX512(key, hash);
+				case SimdLevel::AVX2:	return findInsertSpotAVX(key, hash);
+				case SimdLevel::SSE2:	return findInsertSpotSSE(key, hash);
+				default:				return findInsertSpot(key, hash);
+			}
+		} else {
+			return findInsertSpot(key, hash);
+		}
+	}
+	//-----------------------------------------------------------------------------
+	template<class K>
+	size_t indexOf(const K& key, const Hash_t hash) const {
+		const uint8_t hashLow = computeHashLow(hash);
+		const Hash_t startIndex = homeSlot(hash, capacity_);
 
 		// iterate metadata
 		for (Hash_t i = startIndex;;) {
-			#if defined(TESTING)
-				++ElementsTested;
-			#endif
 			if ((metadata_[i] & VALID_ELEMENT_MASK) == 0 && (metadata_[i] & TOMBSTONE_MASK) == 0)
 				return NPOS;
 
 			// if metadata_[i] has the same hash as `hash` && data_[i] == key // return true
-			if ((metadata_[i] & LOW_MASK) == hashLow && data_[i] == key)
+			if (metadata_[i] == (hashLow | VALID_ELEMENT_MASK) && slotMatches(data_, hashes_, i, key, hash))
 				return i;
 
-			i = (i + 1) & modMask;
+			i = TGrowth::next(i, capacity_);
 			if (i == startIndex) // Wrap around is possible if the table is full of tombstones
 				return NPOS;
 		}
 	}
 	//-----------------------------------------------------------------------------
-	size_t indexOfSSE(const TKey& key) const {
-		const Hash_t hash = hashFunc(key);
+	template<class K>
+	size_t indexOfSSE(const K& key, const Hash_t hash) const {
 		const uint8_t hashLow = computeHashLow(hash);
-		const Hash_t hashHigh = computeHashHigh(hash);
-		const Hash_t modMask = capacity_ - 1;
-		const Hash_t modMask128 = modMask >> 4;
-		const Hash_t startIndex = hashHigh & modMask;
+		const Hash_t groupCount = capacity_ >> 4;
+		const Hash_t startIndex = homeSlot(hash, capacity_);
 
 		const Hash_t start = startIndex >> 4;
 		const Hash_t overlap = startIndex & 15;
@@ -268,10 +2068,6 @@ private:
 		const __m128i elemMask = _mm_set1_epi8(hashLow | VALID_ELEMENT_MASK);
 		const __m128i emptyMask = _mm_set1_epi8(0);
 
-		#if defined(TESTING)
-			++QueryCount;
-		#endif
-
 		// iterate metadata
 		for (Hash_t i = start;;) {
 			// if metadata_[i] has the same hash as `hash` && data_[i] == key // return true
@@ -279,18 +2075,15 @@ private:
 			int resultMask = _mm_movemask_epi8(eqResult);
 			#if 1
 			while (true) {
-				#if defined(TESTING)
-					++ElementsTested;
-				#endif
 				unsigned long firstSet;
-				// _BitScanForward intrinsic is faster than manual bit iteration
-				const char hasAnySet = _BitScanForward(&firstSet, resultMask);
+				// Bit scan (tzcnt/bsf) is faster than manual bit iteration
+				const char hasAnySet = bitScanForward(&firstSet, resultMask);
 				if (!hasAnySet)
 					break;
 				
 				// Do comparison of the value
 				const Hash_t dataIdx = (i << 4) + firstSet;
-				if (data_[dataIdx] == key)
+				if (slotMatches(data_, hashes_, dataIdx, key, hash))
 					return dataIdx;
 
 				// Try the next one
@@ -302,23 +2095,22 @@ private:
 			const __m128i emptyResult = _mm_cmpeq_epi8(metadata_m128_[i], emptyMask);
 			int emptyResultMask = _mm_movemask_epi8(emptyResult);
 			unsigned long emptyFirstSet;
-			const char emptyAnySet = _BitScanForward(&emptyFirstSet, emptyResultMask);
+			const char emptyAnySet = bitScanForward(&emptyFirstSet, emptyResultMask);
 			if (emptyAnySet && (i != start || emptyFirstSet >= overlap))
 				return NPOS;
 
-			i = ((i + 1) & modMask128);
+			i = TGrowth::next(i, groupCount);
 			if (i == start) // Wrap around is possible if the table is full of tombstones
 				return NPOS;
 		}
 	}
 	//-----------------------------------------------------------------------------
-	size_t indexOfAVX(const TKey& key) const {
-		const Hash_t hash = hashFunc(key);
+	template<class K>
+	HS_TARGET_AVX2
+	size_t indexOfAVX(const K& key, const Hash_t hash) const {
 		const uint8_t hashLow = computeHashLow(hash);
-		const Hash_t hashHigh = computeHashHigh(hash);
-		const Hash_t modMask = capacity_ - 1;
-		const Hash_t modMask256 = modMask >> 5;
-		const Hash_t startIndex = hashHigh & modMask;
+		const Hash_t groupCount = capacity_ >> 5;
+		const Hash_t startIndex = homeSlot(hash, capacity_);
 
 		// For indexing 32byte chunks
 		const Hash_t start = startIndex >> 5;
@@ -327,56 +2119,189 @@ private:
 		const __m256i elemMask = _mm256_set1_epi8(hashLow | VALID_ELEMENT_MASK);
 		const __m256i emptyMask = _mm256_setzero_si256();
 
-		#if defined(TESTING)
-			++QueryCount;
-		#endif
-
 		for (Hash_t i = start;;) {
-			const __m256i eqResult = _mm256_cmpeq_epi8(metadata_m256_[i], elemMask);
-			int resultMask = _mm256_movemask_epi8(eqResult);
+			const __m256i group = metadata_m256_[i];
+			const __m256i eqResult = _mm256_cmpeq_epi8(group, elemMask);
+			uint32_t resultMask = static_cast<uint32_t>(_mm256_movemask_epi8(eqResult));
 			while (true) {
-				#if defined(TESTING)
-					++ElementsTested;
-				#endif
 				unsigned long firstSet;
-				const char hasAnySet = _BitScanForward(&firstSet, resultMask);
+				const char hasAnySet = bitScanForward(&firstSet, resultMask);
 				if (!hasAnySet)
 					break;
 
 				// Do comparison of the value
 				const Hash_t dataIdx = (i << 5) + firstSet;
-				if (data_[dataIdx] == key)
+				if (slotMatches(data_, hashes_, dataIdx, key, hash))
 					return dataIdx;
 
 				// Try the next one
-				resultMask &= ~(1 << firstSet);
+				resultMask &= ~(1u << firstSet);
 			}
 
-			const __m256i emptyResult = _mm256_cmpeq_epi8(metadata_m256_[i], emptyMask);
-			int emptyResultMask = _mm256_movemask_epi8(emptyResult);
+			const __m256i emptyResult = _mm256_cmpeq_epi8(group, emptyMask);
+			uint32_t emptyResultMask = static_cast<uint32_t>(_mm256_movemask_epi8(emptyResult));
 			// TODO try masking out part of result before overlap (if start == i)
 			unsigned long emptyFirstSet;
-			const char emptyAnySet = _BitScanForward(&emptyFirstSet, emptyResultMask);
+			const char emptyAnySet = bitScanForward(&emptyFirstSet, emptyResultMask);
+			if (emptyAnySet && (i != start || emptyFirstSet >= overlap))
+				return NPOS;
+
+			i = TGrowth::next(i, groupCount);
+			if (i == start) // Wrap around is possible if the table is full of tombstones
+				return NPOS;
+		}
+	}
+	//-----------------------------------------------------------------------------
+	template<class K>
+	HS_TARGET_AVX512
+	size_t indexOfAVX512(const K& key, const Hash_t hash) const {
+		const uint8_t hashLow = computeHashLow(hash);
+		const Hash_t groupCount = capacity_ >> 6;
+		const Hash_t startIndex = homeSlot(hash, capacity_);
+
+		// For indexing 64byte chunks
+		const Hash_t start = startIndex >> 6;
+		const Hash_t overlap = startIndex & 63;
+
+		const __m512i elemMask = _mm512_set1_epi8(hashLow | VALID_ELEMENT_MASK);
+
+		for (Hash_t i = start;;) {
+			const __m512i group = metadata_m512_[i];
+			uint64_t resultMask = _mm512_cmpeq_epi8_mask(group, elemMask);
+			while (true) {
+				unsigned long firstSet;
+				const char hasAnySet = bitScanForward(&firstSet, resultMask);
+				if (!hasAnySet)
+					break;
+
+				// Do comparison of the value
+				const Hash_t dataIdx = (i << 6) + firstSet;
+				if (slotMatches(data_, hashes_, dataIdx, key, hash))
+					return dataIdx;
+
+				// Try the next one
+				resultMask &= ~(static_cast<uint64_t>(1) << firstSet);
+			}
+
+			// Zero bytes are empty slots
+			const uint64_t emptyResultMask = _mm512_testn_epi8_mask(group, group);
+			unsigned long emptyFirstSet;
+			const char emptyAnySet = bitScanForward(&emptyFirstSet, emptyResultMask);
 			if (emptyAnySet && (i != start || emptyFirstSet >= overlap))
 				return NPOS;
 
-			i = ((i + 1) & modMask256);
+			i = TGrowth::next(i, groupCount);
 			if (i == start) // Wrap around is possible if the table is full of tombstones
 				return NPOS;
 		}
 	}
 	//-----------------------------------------------------------------------------
-	size_t indexOfTemplate(const TKey& key) const {
-		if constexpr (Policy == LPHashSetPolicy::SSE) {
-			return indexOfSSE(key);
+	// Swiss table style probe. The home slot only selects an aligned group of 16 slots, the whole
+	// group is matched at once and an empty slot anywhere in it ends the probe, so no part of the
+	// first group has to be masked off. Further groups follow in triangular steps 1, 2, 3, ...,
+	// which visit every group of a power of two table once and break up the clusters linear
+	// probing builds around hot regions. Works on either table of an incremental rehash.
+	template<class K>
+	size_t indexOfGrouped(const TKey* data, const uint8_t* metadata, const Hash_t* hashes, size_t capacity, const K& key, const Hash_t hash) const {
+		const uint8_t control = computeHashLow(hash) | VALID_ELEMENT_MASK;
+		const Hash_t groupMask = (capacity - 1) >> GROUP_SHIFT;
+		Hash_t group = homeSlot(hash, capacity) >> GROUP_SHIFT;
+
+		for (Hash_t step = 1; step <= groupMask + 1; ++step) {
+			uint32_t resultMask = groupMatch(metadata, group, control);
+			while (true) {
+				unsigned long firstSet;
+				if (!bitScanForward(&firstSet, resultMask))
+					break;
+
+				const Hash_t dataIdx = (group << GROUP_SHIFT) + firstSet;
+				if (slotMatches(data, hashes, dataIdx, key, hash))
+					return dataIdx;
+
+				resultMask &= resultMask - 1;
+			}
+
+			if (groupMatch(metadata, group, 0) != 0)
+				return NPOS;
+
+			group = (group + step) & groupMask;
+		}
+
+		// Every group visited, possible if the table is full of tombstones
+		return NPOS;
+	}
+	//-----------------------------------------------------------------------------
+	template<class K>
+	size_t indexOfTemplate(const K& key, const Hash_t hash) const {
+		if constexpr (Policy == LPHashSetPolicy::Grouped) {
+			return indexOfGrouped(data_, metadata_, hashes_, capacity_, key, hash);
+		} else if constexpr (Policy == LPHashSetPolicy::SSE) {
+			return indexOfSSE(key, hash);
 		} else if constexpr (Policy == LPHashSetPolicy::AVX) {
-			return indexOfAVX(key);
+			return indexOfAVX(key, hash);
+		} else if constexpr (Policy == LPHashSetPolicy::AVX512) {
+			return indexOfAVX512(key, hash);
+		} else if constexpr (Policy == LPHashSetPolicy::Auto) {
+			switch (g_SimdLevel) {
+				case SimdLevel::AVX512:	return indexOfAVX512(key, hash);
+				case SimdLevel::AVX2:	return indexOfAVX(key, hash);
+				case SimdLevel::SSE2:	return indexOfSSE(key, hash);
+				default:				return indexOf(key, hash);
+			}
 		} else {
-			return indexOf(key);
+			return indexOf(key, hash);
+		}
+	}
+	//-----------------------------------------------------------------------------
+	template<class K>
+	size_t indexOfTemplate(const K& key) const {
+		return indexOfTemplate(key, hasher_(key));
+	}
+	//-----------------------------------------------------------------------------
+	// Software pipelined lookup of many keys. While one window of keys is probed the
+	// hashes of the next window are computed and the cache lines they will touch
+	// are prefetched, so the cache misses of different keys overlap.
+	template<class TFunc>
+	void indexOfBatch(const TKey* keys, size_t count, TFunc&& onResult) const {
+		if (data_ == nullptr) {
+			// Nothing to prefetch before the first insert
+			for (size_t i = 0; i < count; ++i) {
+				onResult(i, find(keys[i], hasher_(keys[i])));
+			}
+			return;
+		}
+
+		Hash_t hashes[2][BATCH_WINDOW];
+		auto prepareWindow = [&](size_t begin, Hash_t* windowHashes) {
+			const size_t end = begin + BATCH_WINDOW < count ? begin + BATCH_WINDOW : count;
+			for (size_t i = begin; i < end; ++i) {
+				const Hash_t hash = hasher_(keys[i]);
+				const Hash_t startIndex = homeSlot(hash, capacity_);
+				_mm_prefetch(reinterpret_cast<const char*>(&metadata_[startIndex]), _MM_HINT_T0);
+				_mm_prefetch(reinterpret_cast<const char*>(&data_[startIndex]), _MM_HINT_T0);
+				windowHashes[i - begin] = hash;
+			}
+		};
+
+		prepareWindow(0, hashes[0]);
+		for (size_t begin = 0, window = 0; begin < count; begin += BATCH_WINDOW, window ^= 1) {
+			const size_t next = begin + BATCH_WINDOW;
+			if (next < count)
+				prepareWindow(next, hashes[window ^ 1]);
+
+			const size_t end = next < count ? next : count;
+			for (size_t i = begin; i < end; ++i) {
+				onResult(i, find(keys[i], hashes[window][i - begin]));
+			}
 		}
 	}
 };
 
+//-----------------------------------------------------------------------------
+// Open addressing hash set with linear probing over SIMD compared control bytes, see LPHashTable
+template<class TKey, LPHashSetPolicy Policy, class THash = Hasher<TKey>, class TEqual = std::equal_to<>, class TAllocator = AlignedAllocator, bool StoreHash = false, class TStats = NoStats, class TGrowth = PowerOfTwoGrowth>
+using LPHashSet = LPHashTable<TKey, void, Policy, THash, TEqual, TAllocator, StoreHash, TStats, TGrowth>;
+
 
 
 } // namespace hs
@@ -0,0 +1,201 @@
+#pragma once
+
+#include "HashFunc.h"
+#include "EpochReclamation.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <type_traits>
+
+namespace hs {
+
+//-----------------------------------------------------------------------------
+// Linear probing set for read-mostly workloads. contains() never takes a lock,
+// writers are serialized by a mutex.
+//
+// Metadata uses the same control bytes as LPHashSet. A writer fills a data slot
+// first and then publishes it with a release store of its control byte. Slots are
+// never reused while the table is live, removed keys become tombstones and stay
+// readable. Rehash builds a new table, swaps it in through an atomic pointer and
+// retires the old one to the EpochDomain, which frees it once no reader can see it.
+template<class TKey, class THash = Hasher<TKey>, class TEqual = std::equal_to<>>
+class LockFreeReadLPHashSet {
+	static_assert(std::is_trivially_copyable<TKey>::value, "Readers may copy keys concurrently with writers");
+
+public:
+	//-----------------------------------------------------------------------------
+	explicit LockFreeReadLPHashSet(const THash& hasher = THash(), const TEqual& equal = TEqual())
+		: hasher_(hasher)
+		, equal_(equal)
+		, count_(0)
+		, tombstones_(0)
+	{
+		table_.store(allocTable(static_cast<size_t>(1) << MIN_EXPONENT), std::memory_order_relaxed);
+	}
+	//-----------------------------------------------------------------------------
+	~LockFreeReadLPHashSet() {
+		freeTable(table_.load(std::memory_order_relaxed));
+	}
+	//-----------------------------------------------------------------------------
+	LockFreeReadLPHashSet(const LockFreeReadLPHashSet&) = delete;
+	LockFreeReadLPHashSet& operator=(const LockFreeReadLPHashSet&) = delete;
+	//-----------------------------------------------------------------------------
+	void insert(const TKey& key) {
+		std::lock_guard<std::mutex> lock(writeMutex_);
+
+		Table* table = table_.load(std::memory_order_relaxed);
+		const Hash_t hash = hasher_(key);
+		const uint8_t hashLow = computeHashLow(hash);
+		const Hash_t modMask = table->capacity_ - 1;
+
+		// Tombstones are skipped, a reader may still be comparing against the removed key
+		Hash_t i = computeHashHigh(hash) & modMask;
+		for (;;) {
+			const uint8_t metadata = table->metadata_[i].load(std::memory_order_relaxed);
+			if (metadata == 0)
+				break;
+			if (metadata == (hashLow | VALID_ELEMENT_MASK) && equal_(table->data_[i], key))
+				return;
+
+			i = (i + 1) & modMask;
+		}
+
+		table->data_[i] = key;
+		table->metadata_[i].store(hashLow | VALID_ELEMENT_MASK, std::memory_order_release);
+		count_.store(count_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+		const size_t used = count_.load(std::memory_order_relaxed) + tombstones_;
+		if (used > MAX_LOAD_FACTOR * table->capacity_) {
+			// Grow only if live elements need it, otherwise just drop the tombstones
+			const bool grow = count_.load(std::memory_order_relaxed) > MAX_LOAD_FACTOR / 2 * table->capacity_;
+			rehash(grow ? table->capacity_ * 2 : table->capacity_);
+		}
+	}
+	//-----------------------------------------------------------------------------
+	void remove(const TKey& key) {
+		std::lock_guard<std::mutex> lock(writeMutex_);
+
+		Table* table = table_.load(std::memory_order_relaxed);
+		const size_t idx = indexOf(table, key);
+		if (idx == NPOS)
+			return;
+
+		// The key stays in data_ so readers which already matched the slot compare against valid memory
+		table->metadata_[idx].store(TOMBSTONE_MASK, std::memory_order_release);
+		++tombstones_;
+		count_.store(count_.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+	}
+	//-----------------------------------------------------------------------------
+	bool contains(const TKey& key) const {
+		EpochGuard guard;
+		return indexOf(table_.load(std::memory_order_acquire), key) != NPOS;
+	}
+	//-----------------------------------------------------------------------------
+	size_t count() const {
+		return count_.load(std::memory_order_relaxed);
+	}
+	//-----------------------------------------------------------------------------
+	size_t capacity() const {
+		EpochGuard guard;
+		return table_.load(std::memory_order_acquire)->capacity_;
+	}
+
+private:
+	static constexpr uint8_t VALID_ELEMENT_MASK = 1 << 7;	// 0b1000_0000
+	static constexpr uint8_t TOMBSTONE_MASK = 1 << 6;		// 0b0100_0000
+	static constexpr uint8_t LOW_MASK = 0x7F;				// 0b0111_1111
+	static constexpr float MAX_LOAD_FACTOR = 0.8f;
+	static constexpr size_t MIN_EXPONENT = 5;
+	static constexpr size_t NPOS = -1;
+
+	struct Table {
+		size_t capacity_;
+		std::atomic<uint8_t>* metadata_;
+		TKey* data_;
+	};
+
+	THash hasher_;
+	TEqual equal_;
+	std::atomic<Table*> table_;
+	std::atomic<size_t> count_;
+	size_t tombstones_;	// Writer only
+	std::mutex writeMutex_;
+
+	//-----------------------------------------------------------------------------
+	static Hash_t computeHashHigh(Hash_t hash) {
+		return hash >> 8;
+	}
+	//-----------------------------------------------------------------------------
+	static uint8_t computeHashLow(Hash_t hash) {
+		return static_cast<uint8_t>(hash & LOW_MASK);
+	}
+	//-----------------------------------------------------------------------------
+	static Table* allocTable(size_t capacity) {
+		Table* table = new Table;
+		table->capacity_ = capacity;
+		table->metadata_ = new std::atomic<uint8_t>[capacity];
+		for (size_t i = 0; i < capacity; ++i) {
+			table->metadata_[i].store(0, std::memory_order_relaxed);
+		}
+		table->data_ = static_cast<TKey*>(malloc(sizeof(TKey) * capacity));
+		return table;
+	}
+	//-----------------------------------------------------------------------------
+	static void freeTable(void* ptr) {
+		Table* table = static_cast<Table*>(ptr);
+		delete[] table->metadata_;
+		free(table->data_);
+		delete table;
+	}
+	//-----------------------------------------------------------------------------
+	// Expects writeMutex_ to be held
+	void rehash(size_t newCapacity) {
+		Table* oldTable = table_.load(std::memory_order_relaxed);
+		Table* newTable = allocTable(newCapacity);
+
+		const Hash_t modMask = newCapacity - 1;
+		for (size_t i = 0; i < oldTable->capacity_; ++i) {
+			const uint8_t metadata = oldTable->metadata_[i].load(std::memory_order_relaxed);
+			if ((metadata & VALID_ELEMENT_MASK) == 0)
+				continue;
+
+			// Keys are unique and the new table is private, no need for duplicate checks or ordering
+			Hash_t j = computeHashHigh(hasher_(oldTable->data_[i])) & modMask;
+			while (newTable->metadata_[j].load(std::memory_order_relaxed) != 0) {
+				j = (j + 1) & modMask;
+			}
+			newTable->data_[j] = oldTable->data_[i];
+			newTable->metadata_[j].store(metadata, std::memory_order_relaxed);
+		}
+
+		tombstones_ = 0;
+		table_.store(newTable, std::memory_order_seq_cst);
+		EpochDomain::instance().retire(oldTable, &LockFreeReadLPHashSet::freeTable);
+	}
+	//-----------------------------------------------------------------------------
+	size_t indexOf(const Table* table, const TKey& key) const {
+		const Hash_t hash = hasher_(key);
+		const uint8_t hashLow = computeHashLow(hash);
+		const Hash_t modMask = table->capacity_ - 1;
+		const Hash_t startIndex = computeHashHigh(hash) & modMask;
+
+		for (Hash_t i = startIndex;;) {
+			// Acquire pairs with the publishing store, data_[i] is complete once the byte is valid
+			const uint8_t metadata = table->metadata_[i].load(std::memory_order_acquire);
+			if (metadata == 0)
+				return NPOS;
+
+			if (metadata == (hashLow | VALID_ELEMENT_MASK) && equal_(table->data_[i], key))
+				return i;
+
+			i = (i + 1) & modMask;
+			if (i == startIndex)
+				return NPOS;
+		}
+	}
+};
+
+} // namespace hs
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+#include <string>
+#include <system_error>
+
+#if defined(_WIN32)
+	#if !defined(NOMINMAX)
+		#define NOMINMAX
+	#endif
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+namespace hs {
+
+//-----------------------------------------------------------------------------
+// Maps a whole file copy-on-write. Pages are read from the page cache on first access,
+// writes through the mapping stay private to the process and never reach the file.
+// The mapping starts at a page boundary. Throws std::system_error if the file can not be mapped.
+class MappedFile {
+public:
+	//-----------------------------------------------------------------------------
+	explicit MappedFile(const char* path)
+		: data_(nullptr)
+		, size_(0)
+	{
+		#if defined(_WIN32)
+			HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (file == INVALID_HANDLE_VALUE)
+				throwLastError(path);
+
+			LARGE_INTEGER size;
+			if (!GetFileSizeEx(file, &size)) {
+				CloseHandle(file);
+				throwLastError(path);
+			}
+			size_ = static_cast<size_t>(size.QuadPart);
+
+			if (size_ > 0) {
+				HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+				if (!mapping) {
+					CloseHandle(file);
+					throwLastError(path);
+				}
+				data_ = static_cast<uint8_t*>(MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0));
+				// The view keeps the mapping and the file alive
+				CloseHandle(mapping);
+				if (!data_) {
+					CloseHandle(file);
+					throwLastError(path);
+				}
+			}
+			CloseHandle(file);
+		#else
+			const int fd = open(path, O_RDONLY);
+			if (fd < 0)
+				throwErrno(path);
+
+			struct stat info;
+			if (fstat(fd, &info) != 0) {
+				const int error = errno;
+				close(fd);
+				throwErrno(path, error);
+			}
+			size_ = static_cast<size_t>(info.st_size);
+
+			if (size_ > 0) {
+				void* ptr = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+				if (ptr == MAP_FAILED) {
+					const int error = errno;
+					close(fd);
+					throwErrno(path, error);
+				}
+				data_ = static_cast<uint8_t*>(ptr);
+			}
+			// The mapping stays valid after the descriptor is closed
+			close(fd);
+		#endif
+	}
+	//-----------------------------------------------------------------------------
+	~MappedFile() {
+		if (!data_)
+			return;
+
+		#if defined(_WIN32)
+			UnmapViewOfFile(data_);
+		#else
+			munmap(data_, size_);
+		#endif
+	}
+	//-----------------------------------------------------------------------------
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	//-----------------------------------------------------------------------------
+	uint8_t* data() const {
+		return data_;
+	}
+	//-----------------------------------------------------------------------------
+	size_t size() const {
+		return size_;
+	}
+
+private:
+	uint8_t* data_;
+	size_t size_;
+
+	#if defined(_WIN32)
+		//-----------------------------------------------------------------------------
+		[[noreturn]] static void throwLastError(const char* path) {
+			throw std::system_error(static_cast<int>(GetLastError()), std::system_category(), std::string("Can not map ") + path);
+		}
+	#else
+		//-----------------------------------------------------------------------------
+		[[noreturn]] static void throwErrno(const char* path, int error = errno) {
+			throw std::system_error(error, std::generic_category(), std::string("Can not map ") + path);
+		}
+	#endif
+};
+
+} // namespace hs
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <stdint.h>
+
+#if defined(_MSC_VER)
+	#include <intrin.h>
+#else
+	#include <cpuid.h>
+#endif
+
+namespace hs {
+
+//-----------------------------------------------------------------------------
+// GCC and Clang only allow intrinsics of an instruction set inside functions compiled for it,
+// MSVC allows them everywhere. This lets a single binary carry all the kernels.
+#if defined(_MSC_VER)
+	#define HS_TARGET_AVX2
+	#define HS_TARGET_AVX512
+#else
+	#define HS_TARGET_AVX2 __attribute__((target("avx2")))
+	#define HS_TARGET_AVX512 __attribute__((target("avx2,avx512f,avx512bw")))
+#endif
+
+//-----------------------------------------------------------------------------
+// Portable _BitScanForward, returns false if no bit of mask is set
+inline bool bitScanForward(unsigned long* index, uint64_t mask) {
+	#if defined(_MSC_VER)
+		return _BitScanForward64(index, mask) != 0;
+	#else
+		if (mask == 0)
+			return false;
+		*index = static_cast<unsigned long>(__builtin_ctzll(mask));
+		return true;
+	#endif
+}
+
+//-----------------------------------------------------------------------------
+enum class SimdLevel : uint8_t {
+	None = 0,
+	SSE2,
+	AVX2,
+	AVX512
+};
+
+//-----------------------------------------------------------------------------
+inline void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t regs[4]) {
+	#if defined(_MSC_VER)
+		int r[4];
+		__cpuidex(r, static_cast<int>(leaf), static_cast<int>(subleaf));
+		for (int i = 0; i < 4; ++i) {
+			regs[i] = static_cast<uint32_t>(r[i]);
+		}
+	#else
+		__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+	#endif
+}
+
+//-----------------------------------------------------------------------------
+inline uint64_t xgetbv() {
+	#if defined(_MSC_VER)
+		return _xgetbv(0);
+	#else
+		uint32_t eax, edx;
+		__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		return (static_cast<uint64_t>(edx) << 32) | eax;
+	#endif
+}
+
+//-----------------------------------------------------------------------------
+// The CPU has to support the instructions and the OS has to preserve the registers (XCR0)
+inline SimdLevel detectSimdLevel() {
+	constexpr uint32_t EAX = 0, EBX = 1, ECX = 2, EDX = 3;
+
+	uint32_t regs[4];
+	cpuid(0, 0, regs);
+	const uint32_t maxLeaf = regs[EAX];
+
+	cpuid(1, 0, regs);
+	if ((regs[EDX] & (1u << 26)) == 0)
+		return SimdLevel::None;
+
+	const bool osxsave = (regs[ECX] & (1u << 27)) != 0;
+	const bool avx = (regs[ECX] & (1u << 28)) != 0;
+	if (!osxsave || !avx || maxLeaf < 7)
+		return SimdLevel::SSE2;
+
+	const uint64_t xcr0 = xgetbv();
+	// XMM and YMM state
+	if ((xcr0 & 0x6) != 0x6)
+		return SimdLevel::SSE2;
+
+	cpuid(7, 0, regs);
+	const bool avx2 = (regs[EBX] & (1u << 5)) != 0;
+	const bool avx512f = (regs[EBX] & (1u << 16)) != 0;
+	const bool avx512bw = (regs[EBX] & (1u << 30)) != 0;
+	if (!avx2)
+		return SimdLevel::SSE2;
+
+	// Opmask, ZMM0-15 upper halves and ZMM16-31 state
+	if (avx512f && avx512bw && (xcr0 & 0xE0) == 0xE0)
+		return SimdLevel::AVX512;
+
+	return SimdLevel::AVX2;
+}
+
+//-----------------------------------------------------------------------------
+// Detected once during static initialization. Until then the zero initialized
+// value reads as SimdLevel::None which selects the scalar code and is always safe.
+inline const SimdLevel g_SimdLevel = detectSimdLevel();
+
+} // namespace hs
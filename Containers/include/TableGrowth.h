@@ -0,0 +1,92 @@
+#pragma once
+
+#include "HashFunc.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace hs {
+
+//-----------------------------------------------------------------------------
+// Growth policies of LPHashSet. A policy picks the capacities a table goes through and maps a
+// hash to its home slot in a table of a given capacity. The low 8 bits of the hash are left to
+// the control byte fingerprint. minCapacity is the smallest table of the set, a power of two
+// which covers its largest SIMD group.
+
+//-----------------------------------------------------------------------------
+// Doubles the table and masks the hash. Cheapest reduction, but right after a growth
+// the table is only 40% full at the default max load factor.
+struct PowerOfTwoGrowth {
+	static constexpr bool POWER_OF_TWO = true;
+
+	//-----------------------------------------------------------------------------
+	static size_t capacityAtLeast(size_t required, size_t minCapacity) {
+		size_t capacity = minCapacity;
+		while (capacity < required) {
+			capacity <<= 1;
+		}
+		return capacity;
+	}
+	//-----------------------------------------------------------------------------
+	static size_t grow(size_t capacity, size_t) {
+		return capacity << 1;
+	}
+	//-----------------------------------------------------------------------------
+	static size_t shrink(size_t capacity, size_t) {
+		return capacity >> 1;
+	}
+	//-----------------------------------------------------------------------------
+	static size_t homeSlot(Hash_t hash, size_t capacity) {
+		return (hash >> 8) & (capacity - 1);
+	}
+	//-----------------------------------------------------------------------------
+	// Index after i in a ring of count slots or groups
+	static size_t next(size_t i, size_t count) {
+		return (i + 1) & (count - 1);
+	}
+};
+
+//-----------------------------------------------------------------------------
+// Grows by StepPercent / 100 and sizes tables in steps of GRANULARITY slots, a multiple of every
+// SIMD group, so a table overshoots the load factor by at most one step. The home slot is the
+// high half of hash * capacity (fast range), which takes the high bits of the hash and needs no
+// power of two. The hash is first multiplied by an odd constant to carry its low bits up, the
+// hasher of 32 bit integers leaves the high bits of small keys empty.
+// Grouped probing relies on power of two group counts and does not support it.
+template<unsigned StepPercent = 125>
+struct FastRangeGrowth {
+	static_assert(StepPercent > 100 && StepPercent <= 200, "Step must be in (100, 200] percent");
+
+	static constexpr bool POWER_OF_TWO = false;
+	static constexpr size_t GRANULARITY = 64;
+
+	//-----------------------------------------------------------------------------
+	static size_t capacityAtLeast(size_t required, size_t minCapacity) {
+		if (required <= minCapacity)
+			return minCapacity;
+		return (required + GRANULARITY - 1) / GRANULARITY * GRANULARITY;
+	}
+	//-----------------------------------------------------------------------------
+	static size_t grow(size_t capacity, size_t minCapacity) {
+		return capacityAtLeast(capacity + capacity * (StepPercent - 100) / 100, minCapacity);
+	}
+	//-----------------------------------------------------------------------------
+	// Rounds down, a shrink only happens below a quarter of the max load factor
+	static size_t shrink(size_t capacity, size_t minCapacity) {
+		const size_t shrunk = capacity * 100 / StepPercent / GRANULARITY * GRANULARITY;
+		return shrunk > minCapacity ? shrunk : minCapacity;
+	}
+	//-----------------------------------------------------------------------------
+	static size_t homeSlot(Hash_t hash, size_t capacity) {
+		uint64_t high = capacity;
+		uint64_t low = (hash >> 8) * 0x9e3779b97f4a7c15ull;
+		mul128(&low, &high);
+		return static_cast<size_t>(high);
+	}
+	//-----------------------------------------------------------------------------
+	static size_t next(size_t i, size_t count) {
+		return i + 1 == count ? 0 : i + 1;
+	}
+};
+
+} // namespace hs
@@ -1,11 +1,29 @@
 
 #include "HashSet.h"
+#include "IntHashSet.h"
+#include "LinearProbingHashMap.h"
 #include "LinearProbingHashSet.h"
+#include "ConcurrentLPHashSet.h"
+#include "LockFreeReadLPHashSet.h"
+#include "BlockedBloomFilter.h"
 
 #include <iostream>
 #include "gtest/gtest.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <list>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 using TestedSet = hs::LPHashSet<int, hs::LPHashSetPolicy::SSE>;
 
@@ -103,3 +121,2164 @@ TEST(HashSetBasic, Remove_ByDefault_RemovesElement) {
 	EXPECT_FALSE(set.contains(1));
 }
 
+
+//-----------------------------------------------------------------------------
+TEST(HashSetBasic, Insert_Duplicate_KeepsCount) {
+	TestedSet set;
+
+	set.insert(1);
+	set.insert(1);
+
+	EXPECT_EQ(set.count(), 1);
+}
+
+//-----------------------------------------------------------------------------
+template<class SetT>
+void insertManyAndCheck() {
+	SetT set;
+
+	constexpr int count = 10000;
+	for (int i = 0; i < count; ++i) {
+		set.insert(i);
+		set.insert(i);
+	}
+
+	EXPECT_EQ(set.count(), count);
+	for (int i = 0; i < count; ++i) {
+		EXPECT_TRUE(set.contains(i));
+	}
+	EXPECT_FALSE(set.contains(count));
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetPolicy, InsertMany_Simple_ContainsAll) {
+	insertManyAndCheck<hs::LPHashSet<int, hs::LPHashSetPolicy::Simple>>();
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetPolicy, InsertMany_SSE_ContainsAll) {
+	insertManyAndCheck<hs::LPHashSet<int, hs::LPHashSetPolicy::SSE>>();
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetPolicy, InsertMany_AVX_ContainsAll) {
+	insertManyAndCheck<hs::LPHashSet<int, hs::LPHashSetPolicy::AVX>>();
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetBasic, Insert_AfterRemove_ReusesTombstone) {
+	TestedSet set;
+
+	for (int i = 0; i < 20; ++i) {
+		set.insert(i);
+	}
+	for (int i = 0; i < 20; ++i) {
+		set.remove(i);
+	}
+	const size_t tombstones = set.tombstoneCount();
+	EXPECT_GT(tombstones, 0);
+
+	set.insert(0);
+
+	EXPECT_TRUE(set.contains(0));
+	EXPECT_LT(set.tombstoneCount(), tombstones);
+}
+
+//-----------------------------------------------------------------------------
+template<class SetT>
+void churnAndCheck(size_t maxCapacity = 256) {
+	SetT set;
+
+	constexpr int batch = 100;
+	constexpr int rounds = 1000;
+	for (int round = 0; round < rounds; ++round) {
+		for (int i = 0; i < batch; ++i) {
+			set.insert(round * batch + i);
+		}
+		if (round > 0) {
+			for (int i = 0; i < batch; ++i) {
+				set.remove((round - 1) * batch + i);
+			}
+		}
+	}
+
+	// Churn must not grow the table past what the live elements need
+	EXPECT_EQ(set.count(), batch);
+	EXPECT_LE(set.capacity(), maxCapacity);
+	for (int i = 0; i < batch; ++i) {
+		EXPECT_TRUE(set.contains((rounds - 1) * batch + i));
+		EXPECT_FALSE(set.contains((rounds - 2) * batch + i));
+	}
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetPolicy, Churn_Simple_KeepsCapacity) {
+	churnAndCheck<hs::LPHashSet<int, hs::LPHashSetPolicy::Simple>>();
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetPolicy, Churn_SSE_KeepsCapacity) {
+	churnAndCheck<hs::LPHashSet<int, hs::LPHashSetPolicy::SSE>>();
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetPolicy, Churn_AVX_KeepsCapacity) {
+	churnAndCheck<hs::LPHashSet<int, hs::LPHashSetPolicy::AVX>>();
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetPolicy, InsertMany_AVX512_ContainsAll) {
+	if (hs::g_SimdLevel < hs::SimdLevel::AVX512)
+		GTEST_SKIP() << "AVX-512BW is not supported";
+	insertManyAndCheck<hs::LPHashSet<int, hs::LPHashSetPolicy::AVX512>>();
+	churnAndCheck<hs::LPHashSet<int, hs::LPHashSetPolicy::AVX512>>();
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetPolicy, InsertMany_Auto_ContainsAll) {
+	insertManyAndCheck<hs::LPHashSet<int, hs::LPHashSetPolicy::Auto>>();
+	churnAndCheck<hs::LPHashSet<int, hs::LPHashSetPolicy::Auto>>();
+}
+
+//-----------------------------------------------------------------------------
+TEST(RobinHoodHashSet, InsertMany_ContainsAll) {
+	insertManyAndCheck<hs::HashSet<int>>();
+}
+
+//-----------------------------------------------------------------------------
+TEST(RobinHoodHashSet, Churn_KeepsCapacity) {
+	churnAndCheck<hs::HashSet<int>>();
+}
+
+//-----------------------------------------------------------------------------
+TEST(RobinHoodHashSet, Remove_InsideCluster_KeepsOthersReachable) {
+	hs::HashSet<int> set;
+
+	for (int i = 0; i < 28; ++i) {
+		set.insert(i);
+	}
+	for (int i = 0; i < 28; i += 2) {
+		set.remove(i);
+	}
+
+	EXPECT_EQ(set.count(), 14);
+	for (int i = 0; i < 28; ++i) {
+		EXPECT_EQ(set.contains(i), i % 2 == 1);
+	}
+}
+
+//-----------------------------------------------------------------------------
+template<class SetT>
+void batchLookupAndCheck() {
+	SetT set;
+
+	constexpr int count = 1000;
+	for (int i = 0; i < count; i += 2) {
+		set.insert(i);
+	}
+
+	std::vector<int> keys;
+	for (int i = 0; i < count; ++i) {
+		keys.push_back(i);
+	}
+
+	std::vector<uint64_t> bits((keys.size() + 63) / 64);
+	set.containsBatch(keys.data(), keys.size(), bits.data());
+
+	std::vector<const int*> found(keys.size());
+	set.findBatch(keys.data(), keys.size(), found.data());
+
+	for (int i = 0; i < count; ++i) {
+		const bool expected = i % 2 == 0;
+		EXPECT_EQ(((bits[i / 64] >> (i % 64)) & 1) != 0, expected);
+		EXPECT_EQ(found[i] != nullptr, expected);
+		if (found[i]) {
+			EXPECT_EQ(*found[i], i);
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetBatch, ContainsBatch_Simple_MatchesContains) {
+	batchLookupAndCheck<hs::LPHashSet<int, hs::LPHashSetPolicy::Simple>>();
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetBatch, ContainsBatch_SSE_MatchesContains) {
+	batchLookupAndCheck<hs::LPHashSet<int, hs::LPHashSetPolicy::SSE>>();
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetBatch, ContainsBatch_AVX_MatchesContains) {
+	batchLookupAndCheck<hs::LPHashSet<int, hs::LPHashSetPolicy::AVX>>();
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetBatch, ContainsBatch_Auto_MatchesContains) {
+	batchLookupAndCheck<hs::LPHashSet<int, hs::LPHashSetPolicy::Auto>>();
+}
+
+//-----------------------------------------------------------------------------
+TEST(ConcurrentHashSet, InsertMany_ContainsAll) {
+	insertManyAndCheck<hs::ConcurrentLPHashSet<int>>();
+}
+
+//-----------------------------------------------------------------------------
+TEST(ConcurrentHashSet, ParallelInsertRemove_ContainsExpected) {
+	hs::ConcurrentLPHashSet<int> set;
+
+	constexpr int threadCount = 8;
+	constexpr int perThread = 10000;
+	std::vector<std::thread> threads;
+	for (int t = 0; t < threadCount; ++t) {
+		threads.emplace_back([&set, t]() {
+			for (int i = t; i < threadCount * perThread; i += threadCount) {
+				set.insert(i);
+			}
+			// Every thread removes the odd keys it inserted
+			for (int i = t; i < threadCount * perThread; i += threadCount) {
+				if (i % 2 == 1)
+					set.remove(i);
+			}
+		});
+	}
+	for (auto& thread : threads) {
+		thread.join();
+	}
+
+	EXPECT_EQ(set.count(), threadCount * perThread / 2);
+	for (int i = 0; i < threadCount * perThread; ++i) {
+		EXPECT_EQ(set.contains(i), i % 2 == 0);
+	}
+}
+
+//-----------------------------------------------------------------------------
+TEST(LockFreeReadHashSet, InsertMany_ContainsAll) {
+	insertManyAndCheck<hs::LockFreeReadLPHashSet<int>>();
+}
+
+//-----------------------------------------------------------------------------
+TEST(LockFreeReadHashSet, Churn_KeepsCapacity) {
+	// Removed slots are not reused before a rehash so the set needs more headroom
+	churnAndCheck<hs::LockFreeReadLPHashSet<int>>(512);
+}
+
+//-----------------------------------------------------------------------------
+TEST(LockFreeReadHashSet, ReadersDuringRehash_SeeInsertedKeys) {
+	hs::LockFreeReadLPHashSet<int> set;
+
+	constexpr int count = 100000;
+	std::atomic<int> inserted{ 0 };
+	std::atomic<bool> failed{ false };
+
+	std::vector<std::thread> readers;
+	for (int t = 0; t < 4; ++t) {
+		readers.emplace_back([&set, &inserted, &failed]() {
+			while (inserted.load() < count) {
+				// Everything below `inserted` was inserted before we read it
+				const int upTo = inserted.load();
+				for (int i = upTo > 64 ? upTo - 64 : 0; i < upTo; ++i) {
+					if (!set.contains(i))
+						failed = true;
+				}
+				if (set.contains(count + upTo))
+					failed = true;
+			}
+		});
+	}
+
+	for (int i = 0; i < count; ++i) {
+		set.insert(i);
+		inserted.store(i + 1);
+	}
+	for (auto& reader : readers) {
+		reader.join();
+	}
+
+	EXPECT_FALSE(failed);
+	EXPECT_EQ(set.count(), count);
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetAllocator, ArenaAllocator_InsertRemove_Works) {
+	hs::MonotonicArena arena;
+	{
+		hs::LPHashSet<int, hs::LPHashSetPolicy::AVX, hs::Hasher<int>, std::equal_to<>, hs::ArenaAllocator> set{ hs::ArenaAllocator(arena) };
+		for (int i = 0; i < 1000; ++i) {
+			set.insert(i);
+		}
+		set.remove(10);
+
+		EXPECT_EQ(set.count(), 999);
+		EXPECT_TRUE(set.contains(999));
+		EXPECT_FALSE(set.contains(10));
+	}
+	arena.release();
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetAllocator, HugePageAllocator_LargeSet_ContainsAll) {
+	hs::LPHashSet<int, hs::LPHashSetPolicy::Auto, hs::Hasher<int>, std::equal_to<>, hs::HugePageAllocator> set;
+
+	// Large enough for the data array to take the huge page path
+	constexpr int count = 1 << 20;
+	for (int i = 0; i < count; ++i) {
+		set.insert(i);
+	}
+
+	EXPECT_EQ(set.count(), count);
+	for (int i = 0; i < count; i += 97) {
+		EXPECT_TRUE(set.contains(i));
+	}
+	EXPECT_FALSE(set.contains(count));
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetIncrementalRehash, InsertRemoveDuringMigration_Works) {
+	hs::LPHashSet<int, hs::LPHashSetPolicy::Auto> set;
+	set.setIncrementalRehash(true);
+
+	bool sawRehashing = false;
+	constexpr int count = 20000;
+	for (int i = 0; i < count; ++i) {
+		set.insert(i);
+		// Duplicates must be found in whichever table holds the key
+		set.insert(i / 2);
+		if (set.isRehashing()) {
+			sawRehashing = true;
+			set.remove(i / 3);
+			EXPECT_TRUE(set.contains(i));
+			EXPECT_FALSE(set.contains(i / 3));
+			set.insert(i / 3);
+		}
+	}
+
+	EXPECT_TRUE(sawRehashing);
+	EXPECT_EQ(set.count(), count);
+	for (int i = 0; i < count; ++i) {
+		EXPECT_TRUE(set.contains(i));
+	}
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetIncrementalRehash, Disable_FinishesMigration) {
+	hs::LPHashSet<int, hs::LPHashSetPolicy::SSE> set;
+	set.setIncrementalRehash(true);
+
+	int i = 0;
+	while (!set.isRehashing()) {
+		set.insert(i++);
+	}
+	set.setIncrementalRehash(false);
+
+	EXPECT_FALSE(set.isRehashing());
+	for (int j = 0; j < i; ++j) {
+		EXPECT_TRUE(set.contains(j));
+	}
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetCapacity, Reserve_ThenInsert_DoesNotRehash) {
+	TestedSet set;
+	set.reserve(1000);
+	const size_t reservedCapacity = set.capacity();
+
+	for (int i = 0; i < 1000; ++i) {
+		set.insert(i);
+	}
+
+	EXPECT_EQ(set.capacity(), reservedCapacity);
+	EXPECT_GE(reservedCapacity * set.maxLoadFactor(), 1000);
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetCapacity, ConstructWithCount_FitsWithoutRehash) {
+	TestedSet set(5000);
+	const size_t initialCapacity = set.capacity();
+
+	for (int i = 0; i < 5000; ++i) {
+		set.insert(i);
+	}
+
+	EXPECT_EQ(set.capacity(), initialCapacity);
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetCapacity, ShrinkToFit_AfterRemove_ReducesCapacity) {
+	TestedSet set;
+	for (int i = 0; i < 10000; ++i) {
+		set.insert(i);
+	}
+	for (int i = 10; i < 10000; ++i) {
+		set.remove(i);
+	}
+
+	const size_t peakCapacity = set.capacity();
+	set.shrinkToFit();
+
+	EXPECT_LT(set.capacity(), peakCapacity);
+	EXPECT_EQ(set.tombstoneCount(), 0);
+	for (int i = 0; i < 10; ++i) {
+		EXPECT_TRUE(set.contains(i));
+	}
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetCapacity, MinLoadFactor_RemoveMany_Shrinks) {
+	TestedSet set;
+	set.setMinLoadFactor(0.1f);
+	for (int i = 0; i < 10000; ++i) {
+		set.insert(i);
+	}
+	const size_t peakCapacity = set.capacity();
+
+	for (int i = 0; i < 9990; ++i) {
+		set.remove(i);
+	}
+
+	EXPECT_LE(set.capacity(), peakCapacity / 64);
+	for (int i = 9990; i < 10000; ++i) {
+		EXPECT_TRUE(set.contains(i));
+	}
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetCapacity, MinLoadFactor_IncrementalRehash_ShrinksWithoutStall) {
+	TestedSet set;
+	set.setMinLoadFactor(0.1f);
+	set.setIncrementalRehash(true);
+	for (int i = 0; i < 10000; ++i) {
+		set.insert(i);
+	}
+	// Finishes the migration of the last growth
+	set.setIncrementalRehash(false);
+	set.setIncrementalRehash(true);
+	const size_t peakCapacity = set.capacity();
+
+	// A remove which starts a shrink leaves the elements to the following operations
+	size_t shrinks = 0;
+	for (int i = 0; i < 9990; ++i) {
+		const size_t capacity = set.capacity();
+		set.remove(i);
+		if (set.capacity() < capacity) {
+			EXPECT_TRUE(set.isRehashing());
+			++shrinks;
+		}
+		EXPECT_FALSE(set.contains(i));
+		EXPECT_TRUE(set.contains(i + 1));
+	}
+
+	EXPECT_GT(shrinks, 1u);
+	// Every shrink waits for the previous migration, so the table lags behind the eager one
+	EXPECT_LE(set.capacity(), peakCapacity / 8);
+	EXPECT_EQ(set.count(), 10u);
+	for (int i = 9990; i < 10000; ++i) {
+		EXPECT_TRUE(set.contains(i));
+	}
+	EXPECT_EQ(static_cast<size_t>(std::distance(set.begin(), set.end())), 10u);
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetCapacity, LowerMaxLoadFactor_GrowsTable) {
+	TestedSet set;
+	for (int i = 0; i < 100; ++i) {
+		set.insert(i);
+	}
+	set.setMaxLoadFactor(0.25f);
+
+	EXPECT_LE(static_cast<float>(set.count()) / set.capacity(), 0.25f);
+	for (int i = 0; i < 100; ++i) {
+		EXPECT_TRUE(set.contains(i));
+	}
+}
+
+//-----------------------------------------------------------------------------
+template<class SetT>
+void stringKeysAndCheck() {
+	SetT set;
+	for (int i = 0; i < 2000; ++i) {
+		set.insert("key_" + std::to_string(i));
+	}
+	for (int i = 0; i < 2000; i += 2) {
+		set.remove("key_" + std::to_string(i));
+	}
+
+	EXPECT_EQ(set.count(), 1000);
+	for (int i = 0; i < 2000; ++i) {
+		EXPECT_EQ(set.contains("key_" + std::to_string(i)), i % 2 == 1);
+	}
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetStringKeys, InsertRemove_Simple_Works) {
+	stringKeysAndCheck<hs::LPHashSet<std::string, hs::LPHashSetPolicy::Simple>>();
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetStringKeys, InsertRemove_Auto_Works) {
+	stringKeysAndCheck<hs::LPHashSet<std::string, hs::LPHashSetPolicy::Auto>>();
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetStringKeys, InsertRemove_RobinHood_Works) {
+	stringKeysAndCheck<hs::HashSet<std::string>>();
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetStringKeys, ContainsStringView_OnInserted_ReturnsTrue) {
+	hs::LPHashSet<std::string, hs::LPHashSetPolicy::Auto> set;
+	// Longer than the small string buffer so the stored keys live on the heap
+	const std::string prefix(40, 'x');
+	for (int i = 0; i < 100; ++i) {
+		set.insert(prefix + std::to_string(i));
+	}
+
+	const std::string probe = prefix + "42";
+	EXPECT_TRUE(set.contains(std::string_view(probe)));
+	EXPECT_FALSE(set.contains(std::string_view(probe).substr(0, 40)));
+	EXPECT_FALSE(set.contains("literal"));
+
+	set.remove(std::string_view(probe));
+	EXPECT_FALSE(set.contains(probe));
+	EXPECT_EQ(set.count(), 99);
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetStringKeys, SeededHasher_ChangesHashButNotContents) {
+	const hs::Hasher<std::string> hasher1(1);
+	const hs::Hasher<std::string> hasher2(2);
+	EXPECT_NE(hasher1("key"), hasher2("key"));
+
+	hs::LPHashSet<std::string, hs::LPHashSetPolicy::SSE> set(0, hasher2);
+	for (int i = 0; i < 500; ++i) {
+		set.insert(std::to_string(i));
+	}
+	for (int i = 0; i < 500; ++i) {
+		EXPECT_TRUE(set.contains(std::to_string(i)));
+	}
+	EXPECT_FALSE(set.contains("500"));
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetStringKeys, HashBytes_AllLengths_DependOnEveryByte) {
+	// Covers the short, 16 byte and 48 byte paths of the hash
+	std::string key(100, 'a');
+	for (size_t length = 0; length <= key.size(); ++length) {
+		const hs::Hash_t hash = hs::hashBytes(key.data(), length);
+		for (size_t i = 0; i < length; ++i) {
+			std::string changed = key.substr(0, length);
+			changed[i] = 'b';
+			EXPECT_NE(hs::hashBytes(changed.data(), length), hash);
+		}
+		if (length > 0) {
+			EXPECT_NE(hs::hashBytes(key.data(), length - 1), hash);
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+namespace {
+	hs::Hash_t moduloHash(const int& key) {
+		return static_cast<hs::Hash_t>(key) << 8;
+	}
+
+	// Stateful equality, matches keys in the same residue class
+	struct ModuloEqual {
+		int modulo_;
+		bool operator()(int a, int b) const {
+			return a % modulo_ == b % modulo_;
+		}
+	};
+
+	hs::Hash_t moduloClassHash(const int& key) {
+		return static_cast<hs::Hash_t>(key % 10) << 8;
+	}
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetFunctors, FuncHasher_PlainFunction_Works) {
+	hs::LPHashSet<int, hs::LPHashSetPolicy::AVX, hs::FuncHasher<int, moduloHash>> set;
+	for (int i = 0; i < 1000; ++i) {
+		set.insert(i);
+	}
+
+	EXPECT_EQ(set.count(), 1000);
+	EXPECT_TRUE(set.contains(999));
+	EXPECT_FALSE(set.contains(1000));
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetFunctors, StatefulEqual_IsUsedForComparisons) {
+	using SetT = hs::LPHashSet<int, hs::LPHashSetPolicy::SSE, hs::FuncHasher<int, moduloClassHash>, ModuloEqual>;
+	SetT set(0, {}, ModuloEqual{ 10 });
+	for (int i = 0; i < 100; ++i) {
+		set.insert(i);
+	}
+
+	EXPECT_EQ(set.count(), 10);
+	EXPECT_TRUE(set.contains(12345));
+}
+
+//-----------------------------------------------------------------------------
+template<class TKey, hs::LPHashSetPolicy Policy>
+using StoredHashSet = hs::LPHashSet<TKey, Policy, hs::Hasher<TKey>, std::equal_to<>, hs::AlignedAllocator, true>;
+
+//-----------------------------------------------------------------------------
+TEST(HashSetStoredHash, InsertMany_ContainsAll) {
+	insertManyAndCheck<StoredHashSet<int, hs::LPHashSetPolicy::Simple>>();
+	insertManyAndCheck<StoredHashSet<int, hs::LPHashSetPolicy::Auto>>();
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetStoredHash, Churn_KeepsCapacity) {
+	churnAndCheck<StoredHashSet<int, hs::LPHashSetPolicy::SSE>>();
+	churnAndCheck<StoredHashSet<int, hs::LPHashSetPolicy::Auto>>();
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetStoredHash, StringKeys_Works) {
+	stringKeysAndCheck<StoredHashSet<std::string, hs::LPHashSetPolicy::Auto>>();
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetStoredHash, ContainsNotInserted_SkipsKeyCompares) {
+	using StringHasher = hs::Hasher<std::string>;
+	hs::LPHashSet<std::string, hs::LPHashSetPolicy::SSE, StringHasher, std::equal_to<>, hs::AlignedAllocator, false, hs::ProbeStats> plainSet;
+	hs::LPHashSet<std::string, hs::LPHashSetPolicy::SSE, StringHasher, std::equal_to<>, hs::AlignedAllocator, true, hs::ProbeStats> storedSet;
+	for (int i = 0; i < 10000; ++i) {
+		plainSet.insert(std::to_string(i));
+		storedSet.insert(std::to_string(i));
+	}
+
+	plainSet.resetStats();
+	storedSet.resetStats();
+	for (int i = 10000; i < 20000; ++i) {
+		EXPECT_FALSE(plainSet.contains(std::to_string(i)));
+		EXPECT_FALSE(storedSet.contains(std::to_string(i)));
+	}
+
+	// 7 bit fingerprints collide now and then, full hashes practically never
+	EXPECT_GT(plainSet.stats().keyCompares, 0);
+	EXPECT_EQ(storedSet.stats().keyCompares, 0);
+	EXPECT_GT(storedSet.stats().fingerprintFalsePositives, 0);
+}
+
+//-----------------------------------------------------------------------------
+TEST(IntHashSet, InsertMany_AllPolicies_ContainsAll) {
+	insertManyAndCheck<hs::IntHashSet<int, hs::LPHashSetPolicy::Simple>>();
+	insertManyAndCheck<hs::IntHashSet<int, hs::LPHashSetPolicy::SSE>>();
+	insertManyAndCheck<hs::IntHashSet<int, hs::LPHashSetPolicy::AVX>>();
+	insertManyAndCheck<hs::IntHashSet<int, hs::LPHashSetPolicy::AVX512>>();
+	insertManyAndCheck<hs::IntHashSet<int, hs::LPHashSetPolicy::Auto>>();
+}
+
+//-----------------------------------------------------------------------------
+TEST(IntHashSet, Churn_AllPolicies_KeepsCapacity) {
+	churnAndCheck<hs::IntHashSet<int, hs::LPHashSetPolicy::Simple>>();
+	churnAndCheck<hs::IntHashSet<int, hs::LPHashSetPolicy::SSE>>();
+	churnAndCheck<hs::IntHashSet<int, hs::LPHashSetPolicy::AVX>>();
+	churnAndCheck<hs::IntHashSet<int, hs::LPHashSetPolicy::AVX512>>();
+}
+
+//-----------------------------------------------------------------------------
+TEST(IntHashSet, SixtyFourBitKeys_Works) {
+	hs::IntHashSet<uint64_t, hs::LPHashSetPolicy::SSE> sseSet;
+	hs::IntHashSet<uint64_t, hs::LPHashSetPolicy::Auto> autoSet;
+	for (uint64_t i = 0; i < 5000; ++i) {
+		// Keys which differ only in the upper half catch compares of the low 32 bits only
+		sseSet.insert(i << 32);
+		autoSet.insert(i << 32);
+	}
+
+	EXPECT_EQ(sseSet.count(), 5000);
+	EXPECT_EQ(autoSet.count(), 5000);
+	for (uint64_t i = 0; i < 5000; ++i) {
+		EXPECT_TRUE(sseSet.contains(i << 32));
+		EXPECT_TRUE(autoSet.contains(i << 32));
+		EXPECT_FALSE(sseSet.contains((i << 32) + 1));
+		EXPECT_FALSE(autoSet.contains((i << 32) + 1));
+	}
+}
+
+//-----------------------------------------------------------------------------
+TEST(IntHashSet, SentinelValues_CanBeStored) {
+	hs::IntHashSet<uint32_t> set;
+	const uint32_t maxValue = ~0u;
+
+	set.insert(maxValue);
+	set.insert(maxValue - 1);
+	set.insert(5);
+	EXPECT_EQ(set.count(), 3);
+	EXPECT_TRUE(set.contains(maxValue));
+	EXPECT_TRUE(set.contains(maxValue - 1));
+
+	set.remove(maxValue);
+	EXPECT_FALSE(set.contains(maxValue));
+	EXPECT_TRUE(set.contains(maxValue - 1));
+	EXPECT_TRUE(set.contains(5));
+	EXPECT_EQ(set.count(), 2);
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetIteration, RangeFor_VisitsEveryElementOnce) {
+	hs::LPHashSet<int, hs::LPHashSetPolicy::Auto> set;
+	for (int i = 0; i < 5000; ++i) {
+		set.insert(i * 3);
+	}
+	for (int i = 0; i < 5000; i += 2) {
+		set.remove(i * 3);
+	}
+
+	std::unordered_set<int> visited;
+	for (const int key : set) {
+		EXPECT_EQ(key % 6, 3);
+		EXPECT_TRUE(visited.insert(key).second);
+	}
+	EXPECT_EQ(visited.size(), set.count());
+	EXPECT_EQ(std::distance(set.begin(), set.end()), static_cast<ptrdiff_t>(set.count()));
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetIteration, EmptySet_BeginEqualsEnd) {
+	TestedSet set;
+	EXPECT_TRUE(set.begin() == set.end());
+
+	set.insert(1);
+	set.remove(1);
+	EXPECT_TRUE(set.begin() == set.end());
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetIteration, DuringIncrementalRehash_CoversBothTables) {
+	hs::LPHashSet<int, hs::LPHashSetPolicy::SSE> set;
+	set.setIncrementalRehash(true);
+
+	int inserted = 0;
+	while (!set.isRehashing()) {
+		set.insert(inserted++);
+	}
+
+	size_t iterated = 0;
+	for (auto it = set.begin(); it != set.end(); ++it) {
+		EXPECT_LT(*it, inserted);
+		++iterated;
+	}
+	size_t visited = 0;
+	set.forEach([&](int) { ++visited; });
+
+	EXPECT_EQ(iterated, static_cast<size_t>(inserted));
+	EXPECT_EQ(visited, static_cast<size_t>(inserted));
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetIteration, ForEach_SumsAllElements) {
+	hs::LPHashSet<int, hs::LPHashSetPolicy::Simple> set;
+	int64_t expected = 0;
+	for (int i = 0; i < 10000; ++i) {
+		set.insert(i);
+		expected += i;
+	}
+
+	int64_t sum = 0;
+	set.forEach([&](int key) { sum += key; });
+
+	EXPECT_EQ(sum, expected);
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetIteration, EraseIf_RemovesMatching) {
+	hs::LPHashSet<int, hs::LPHashSetPolicy::Auto> set;
+	for (int i = 0; i < 10000; ++i) {
+		set.insert(i);
+	}
+
+	const size_t erased = set.eraseIf([](int key) { return key % 3 != 0; });
+
+	EXPECT_EQ(erased, 6666);
+	EXPECT_EQ(set.count(), 3334);
+	EXPECT_LE(static_cast<float>(set.tombstoneCount()) / set.capacity(), 0.125f);
+	for (int i = 0; i < 10000; ++i) {
+		EXPECT_EQ(set.contains(i), i % 3 == 0);
+	}
+
+	// The table must stay fully usable afterwards
+	for (int i = 0; i < 10000; ++i) {
+		set.insert(i);
+	}
+	EXPECT_EQ(set.count(), 10000);
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetIteration, EraseIf_StringKeys_DestroysErased) {
+	hs::LPHashSet<std::string, hs::LPHashSetPolicy::SSE> set;
+	for (int i = 0; i < 1000; ++i) {
+		set.insert(std::string(32, 'k') + std::to_string(i));
+	}
+
+	const size_t erased = set.eraseIf([](const std::string& key) { return key.back() == '7'; });
+
+	EXPECT_EQ(erased, 100);
+	EXPECT_EQ(set.count(), 900);
+	EXPECT_FALSE(set.contains(std::string(32, 'k') + "17"));
+	EXPECT_TRUE(set.contains(std::string(32, 'k') + "18"));
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetBulkInsert, RangeConstructor_WithDuplicates_SizesOnce) {
+	std::vector<int> keys;
+	for (int i = 0; i < 10000; ++i) {
+		keys.push_back(i % 7000);
+	}
+
+	hs::LPHashSet<int, hs::LPHashSetPolicy::Auto> set(keys.begin(), keys.end());
+
+	EXPECT_EQ(set.count(), 7000);
+	EXPECT_LE(set.capacity(), 16384);
+	for (int i = 0; i < 7000; ++i) {
+		EXPECT_TRUE(set.contains(i));
+	}
+	EXPECT_FALSE(set.contains(7000));
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetBulkInsert, InsertRange_InputAndForwardIterators_Works) {
+	TestedSet set;
+	set.insert(-1);
+
+	std::istringstream stream("1 2 3 2 1");
+	set.insert(std::istream_iterator<int>(stream), std::istream_iterator<int>());
+	const std::list<int> list = { 3, 4, 5 };
+	set.insert(list.begin(), list.end());
+
+	EXPECT_EQ(set.count(), 6);
+	for (int i = -1; i <= 5; ++i) {
+		EXPECT_EQ(set.contains(i), i != 0);
+	}
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetBulkInsert, ParallelBuild_MatchesSerialBuild) {
+	std::vector<int> keys;
+	for (int i = 0; i < 300000; ++i) {
+		keys.push_back((i * 7) % 250000);
+	}
+
+	hs::LPHashSet<int, hs::LPHashSetPolicy::Auto> serial(keys.begin(), keys.end());
+	hs::LPHashSet<int, hs::LPHashSetPolicy::Auto> parallel(keys.begin(), keys.end(), 4);
+
+	EXPECT_EQ(parallel.count(), serial.count());
+	EXPECT_EQ(parallel.capacity(), serial.capacity());
+	for (int i = 0; i < 250000; ++i) {
+		EXPECT_TRUE(parallel.contains(i));
+	}
+	EXPECT_FALSE(parallel.contains(250000));
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetBulkInsert, ParallelBuild_IntoNonEmptySet_Works) {
+	StoredHashSet<int, hs::LPHashSetPolicy::SSE> set;
+	for (int i = 0; i < 50000; ++i) {
+		set.insert(i);
+	}
+	// Leaves tombstones behind
+	for (int i = 0; i < 50000; i += 3) {
+		set.remove(i);
+	}
+
+	std::vector<int> keys;
+	for (int i = 25000; i < 200000; ++i) {
+		keys.push_back(i);
+	}
+	set.insert(keys.begin(), keys.end(), 3);
+
+	EXPECT_EQ(set.count(), 200000 - (25000 + 2) / 3);
+	for (int i = 0; i < 200000; ++i) {
+		EXPECT_EQ(set.contains(i), i >= 25000 || i % 3 != 0);
+	}
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetBulkInsert, ParallelBuild_StringKeys_Works) {
+	std::vector<std::string> keys;
+	for (int i = 0; i < 100000; ++i) {
+		keys.push_back("key_" + std::to_string(i % 80000));
+	}
+
+	hs::LPHashSet<std::string, hs::LPHashSetPolicy::Auto> set(keys.begin(), keys.end(), 4);
+
+	EXPECT_EQ(set.count(), 80000);
+	for (int i = 0; i < 80000; ++i) {
+		EXPECT_TRUE(set.contains("key_" + std::to_string(i)));
+	}
+}
+
+//-----------------------------------------------------------------------------
+// a holds the multiples of 2 below 2 * aCount, b the multiples of 3 below 3 * bCount
+template<class SetT>
+void setAlgebraAndCheck(int aCount, int bCount) {
+	SetT a;
+	SetT b;
+	for (int i = 0; i < aCount; ++i) {
+		a.insert(2 * i);
+	}
+	for (int i = 0; i < bCount; ++i) {
+		b.insert(3 * i);
+	}
+
+	const int limit = 3 * (aCount > bCount ? aCount : bCount);
+	auto inA = [&](int key) { return key % 2 == 0 && key < 2 * aCount; };
+	auto inB = [&](int key) { return key % 3 == 0 && key < 3 * bCount; };
+	auto check = [&](const SetT& set, auto&& expected) {
+		size_t expectedCount = 0;
+		for (int key = 0; key < limit; ++key) {
+			const bool expect = expected(key);
+			expectedCount += expect;
+			ASSERT_EQ(set.contains(key), expect) << key;
+		}
+		ASSERT_EQ(set.count(), expectedCount);
+	};
+
+	size_t common = 0;
+	for (int key = 0; key < limit; ++key) {
+		common += inA(key) && inB(key);
+	}
+	EXPECT_EQ(a.intersectionCount(b), common);
+	EXPECT_EQ(b.intersectionCount(a), common);
+
+	check(a.intersect(b), [&](int key) { return inA(key) && inB(key); });
+	check(b.intersect(a), [&](int key) { return inA(key) && inB(key); });
+	check(a.unite(b), [&](int key) { return inA(key) || inB(key); });
+	check(b.unite(a), [&](int key) { return inA(key) || inB(key); });
+	check(a.difference(b), [&](int key) { return inA(key) && !inB(key); });
+	check(b.difference(a), [&](int key) { return inB(key) && !inA(key); });
+
+	SetT intersected = a.unite(SetT());
+	intersected.intersectWith(b);
+	check(intersected, [&](int key) { return inA(key) && inB(key); });
+
+	SetT united = a.unite(SetT());
+	united.uniteWith(b);
+	check(united, [&](int key) { return inA(key) || inB(key); });
+
+	SetT subtracted = a.unite(SetT());
+	subtracted.subtract(b);
+	check(subtracted, [&](int key) { return inA(key) && !inB(key); });
+
+	subtracted = b.unite(SetT());
+	subtracted.subtract(a);
+	check(subtracted, [&](int key) { return inB(key) && !inA(key); });
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetAlgebra, EqualSizes_MatchesReference) {
+	setAlgebraAndCheck<hs::LPHashSet<int, hs::LPHashSetPolicy::Simple>>(3000, 3000);
+	setAlgebraAndCheck<hs::LPHashSet<int, hs::LPHashSetPolicy::Auto>>(3000, 3000);
+	setAlgebraAndCheck<StoredHashSet<int, hs::LPHashSetPolicy::SSE>>(3000, 3000);
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetAlgebra, SkewedSizes_MatchesReference) {
+	setAlgebraAndCheck<hs::LPHashSet<int, hs::LPHashSetPolicy::Auto>>(20000, 50);
+	setAlgebraAndCheck<hs::LPHashSet<int, hs::LPHashSetPolicy::Auto>>(50, 20000);
+	setAlgebraAndCheck<StoredHashSet<int, hs::LPHashSetPolicy::Auto>>(20000, 50);
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetAlgebra, EmptyAndSelf_Works) {
+	hs::LPHashSet<int, hs::LPHashSetPolicy::Auto> set;
+	const hs::LPHashSet<int, hs::LPHashSetPolicy::Auto> empty;
+	for (int i = 0; i < 100; ++i) {
+		set.insert(i);
+	}
+
+	EXPECT_EQ(set.intersect(empty).count(), 0);
+	EXPECT_EQ(set.unite(empty).count(), 100);
+	EXPECT_EQ(set.difference(empty).count(), 100);
+	EXPECT_EQ(empty.difference(set).count(), 0);
+	EXPECT_EQ(set.intersectionCount(set), 100);
+
+	set.uniteWith(set);
+	set.intersectWith(set);
+	EXPECT_EQ(set.count(), 100);
+	set.subtract(set);
+	EXPECT_EQ(set.count(), 0);
+	EXPECT_FALSE(set.contains(0));
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetAlgebra, DifferentSeeds_RehashesKeys) {
+	using SeededSet = hs::LPHashSet<std::string, hs::LPHashSetPolicy::Auto>;
+	SeededSet a(0, hs::Hasher<std::string>(1));
+	SeededSet b(0, hs::Hasher<std::string>(2));
+	for (int i = 0; i < 2000; ++i) {
+		a.insert("key_" + std::to_string(i));
+		b.insert("key_" + std::to_string(i + 1000));
+	}
+
+	EXPECT_EQ(a.intersectionCount(b), 1000);
+
+	const SeededSet united = b.unite(a);
+	EXPECT_EQ(united.count(), 3000);
+	for (int i = 0; i < 3000; ++i) {
+		EXPECT_TRUE(united.contains("key_" + std::to_string(i)));
+	}
+
+	a.subtract(b);
+	EXPECT_EQ(a.count(), 1000);
+	EXPECT_TRUE(a.contains("key_999"));
+	EXPECT_FALSE(a.contains("key_1000"));
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetAlgebra, DuringIncrementalRehash_SeesBothTables) {
+	hs::LPHashSet<int, hs::LPHashSetPolicy::SSE> a;
+	a.setIncrementalRehash(true);
+	int inserted = 0;
+	while (!a.isRehashing()) {
+		a.insert(inserted++);
+	}
+
+	hs::LPHashSet<int, hs::LPHashSetPolicy::SSE> b;
+	for (int i = 0; i < inserted; i += 2) {
+		b.insert(i);
+	}
+
+	EXPECT_EQ(a.intersectionCount(b), static_cast<size_t>((inserted + 1) / 2));
+	EXPECT_EQ(a.difference(b).count(), static_cast<size_t>(inserted / 2));
+	EXPECT_EQ(b.difference(a).count(), 0);
+	EXPECT_EQ(b.unite(a).count(), static_cast<size_t>(inserted));
+	EXPECT_TRUE(a.isRehashing());
+}
+
+//-----------------------------------------------------------------------------
+static std::string tempPath(const char* name) {
+	return testing::TempDir() + name;
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetFile, SaveLoad_RoundTrip_ServesLookups) {
+	const std::string path = tempPath("hs_roundtrip.bin");
+	{
+		hs::LPHashSet<uint64_t, hs::LPHashSetPolicy::Auto> set;
+		for (uint64_t i = 0; i < 100000; ++i) {
+			set.insert(i * 7);
+		}
+		for (uint64_t i = 0; i < 100000; i += 5) {
+			set.remove(i * 7);
+		}
+		set.save(path.c_str());
+	}
+
+	auto loaded = hs::LPHashSet<uint64_t, hs::LPHashSetPolicy::Auto>::load(path.c_str());
+	EXPECT_EQ(loaded.count(), 80000);
+	for (uint64_t i = 0; i < 100000; ++i) {
+		EXPECT_EQ(loaded.contains(i * 7), i % 5 != 0);
+	}
+	EXPECT_EQ(std::distance(loaded.begin(), loaded.end()), 80000);
+
+	// Writes are private to the set and a rehash moves it off the mapping
+	for (uint64_t i = 0; i < 200000; ++i) {
+		loaded.insert(i * 7 + 1);
+	}
+	EXPECT_EQ(loaded.count(), 280000);
+	EXPECT_TRUE(loaded.contains(7));
+
+	auto reloaded = hs::LPHashSet<uint64_t, hs::LPHashSetPolicy::SSE>::load(path.c_str());
+	EXPECT_EQ(reloaded.count(), 80000);
+	EXPECT_FALSE(reloaded.contains(1));
+	reloaded.remove(7);
+	EXPECT_FALSE(reloaded.contains(7));
+
+	std::remove(path.c_str());
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetFile, SaveDuringIncrementalRehash_StoresAllElements) {
+	const std::string path = tempPath("hs_incremental.bin");
+	StoredHashSet<int, hs::LPHashSetPolicy::SSE> set;
+	set.setIncrementalRehash(true);
+	int inserted = 0;
+	while (!set.isRehashing()) {
+		set.insert(inserted++);
+	}
+	set.save(path.c_str());
+	EXPECT_TRUE(set.isRehashing());
+
+	auto loaded = StoredHashSet<int, hs::LPHashSetPolicy::Auto>::load(path.c_str());
+	EXPECT_EQ(loaded.count(), static_cast<size_t>(inserted));
+	for (int i = 0; i < inserted; ++i) {
+		EXPECT_TRUE(loaded.contains(i));
+	}
+
+	std::remove(path.c_str());
+}
+
+//-----------------------------------------------------------------------------
+static hs::Hash_t otherIntHash(const int& key) {
+	return static_cast<hs::Hash_t>(key) * 0x9E3779B97F4A7C15ull;
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetFile, Load_IncompatibleFile_Throws) {
+	const std::string path = tempPath("hs_incompatible.bin");
+	hs::LPHashSet<int, hs::LPHashSetPolicy::Auto> set;
+	for (int i = 0; i < 100; ++i) {
+		set.insert(i);
+	}
+	set.save(path.c_str());
+
+	using OtherHashSet = hs::LPHashSet<int, hs::LPHashSetPolicy::Auto, hs::FuncHasher<int, otherIntHash>>;
+	EXPECT_THROW(OtherHashSet::load(path.c_str()), std::runtime_error);
+	EXPECT_THROW((hs::LPHashSet<uint64_t, hs::LPHashSetPolicy::Auto>::load(path.c_str())), std::runtime_error);
+	EXPECT_THROW((StoredHashSet<int, hs::LPHashSetPolicy::Auto>::load(path.c_str())), std::runtime_error);
+
+	std::ofstream(path, std::ios::binary) << "not a hash set";
+	EXPECT_THROW((hs::LPHashSet<int, hs::LPHashSetPolicy::Auto>::load(path.c_str())), std::runtime_error);
+
+	std::remove(path.c_str());
+	EXPECT_THROW((hs::LPHashSet<int, hs::LPHashSetPolicy::Auto>::load(path.c_str())), std::system_error);
+}
+
+//-----------------------------------------------------------------------------
+template<hs::LPHashSetPolicy Policy>
+using StatsSet = hs::LPHashSet<int, Policy, hs::Hasher<int>, std::equal_to<>, hs::AlignedAllocator, false, hs::ProbeStats>;
+
+//-----------------------------------------------------------------------------
+template<class SetT>
+void lookupStatsAndCheck() {
+	SetT set;
+	for (int i = 0; i < 1000; ++i) {
+		set.insert(i);
+	}
+	EXPECT_GT(set.stats().rehashes, 0u);
+
+	set.resetStats();
+	for (int i = 0; i < 2000; ++i) {
+		set.contains(i);
+	}
+
+	const hs::HashSetStats stats = set.stats();
+	EXPECT_EQ(stats.lookups, 2000u);
+	EXPECT_EQ(stats.hits, 1000u);
+	EXPECT_EQ(stats.misses(), 1000u);
+	EXPECT_EQ(stats.rehashes, 0u);
+	EXPECT_GE(stats.probeLengthSum, stats.lookups);
+
+	uint64_t histogramTotal = 0;
+	for (const uint64_t bucket : stats.probeLengths) {
+		histogramTotal += bucket;
+	}
+	EXPECT_EQ(histogramTotal, stats.lookups);
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetStats, ProbeStats_AllPolicies_CountsLookups) {
+	lookupStatsAndCheck<StatsSet<hs::LPHashSetPolicy::Simple>>();
+	lookupStatsAndCheck<StatsSet<hs::LPHashSetPolicy::SSE>>();
+	lookupStatsAndCheck<StatsSet<hs::LPHashSetPolicy::Auto>>();
+	lookupStatsAndCheck<StatsSet<hs::LPHashSetPolicy::Grouped>>();
+	lookupStatsAndCheck<hs::IntHashSet<int, hs::LPHashSetPolicy::Auto, hs::Hasher<int>, hs::AlignedAllocator, hs::ProbeStats>>();
+	lookupStatsAndCheck<hs::HashSet<int, hs::Hasher<int>, std::equal_to<>, hs::ProbeStats>>();
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetStats, NoStats_CountersStayZero) {
+	TestedSet set;
+	for (int i = 0; i < 1000; ++i) {
+		set.insert(i);
+		set.contains(i);
+	}
+
+	const hs::HashSetStats stats = set.stats();
+	EXPECT_EQ(stats.lookups, 0u);
+	EXPECT_EQ(stats.keyCompares, 0u);
+	EXPECT_EQ(stats.rehashes, 0u);
+	EXPECT_EQ(stats.count, set.count());
+	EXPECT_EQ(stats.capacity, set.capacity());
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetStats, TableShape_MatchesTable) {
+	StatsSet<hs::LPHashSetPolicy::Auto> set;
+	for (int i = 0; i < 1000; ++i) {
+		set.insert(i);
+	}
+	for (int i = 0; i < 1000; i += 3) {
+		set.remove(i);
+	}
+
+	const hs::HashSetStats stats = set.stats();
+	EXPECT_EQ(stats.count, set.count());
+	EXPECT_EQ(stats.tombstones, set.tombstoneCount());
+	EXPECT_DOUBLE_EQ(stats.tombstoneRatio(), static_cast<double>(set.tombstoneCount()) / set.capacity());
+
+	// Every occupied slot is in some cluster, the longest one bounds the rest
+	uint64_t clusters = 0;
+	for (const uint64_t bucket : stats.clusterLengths) {
+		clusters += bucket;
+	}
+	EXPECT_GT(clusters, 0u);
+	EXPECT_LE(clusters, stats.count + stats.tombstones);
+	EXPECT_GE(stats.maxClusterLength * clusters, stats.count + stats.tombstones);
+
+	// Fast range capacities are no powers of two. Without tombstones the occupied slots of a linear
+	// probing table do not depend on the insert order, so placing the keys again reproduces them.
+	using Growth = hs::FastRangeGrowth<125>;
+	using FastRangeStatsSet = hs::LPHashSet<int, hs::LPHashSetPolicy::SSE, hs::Hasher<int>, std::equal_to<>, hs::AlignedAllocator, false, hs::ProbeStats, Growth>;
+
+	for (const int count : { 1000, 5000 }) {
+		FastRangeStatsSet set;
+		for (int i = 0; i < count; ++i) {
+			set.insert(i * 7);
+		}
+		const size_t capacity = set.capacity();
+		EXPECT_NE(capacity & (capacity - 1), 0u);
+
+		std::vector<bool> occupied(capacity);
+		for (int i = 0; i < count; ++i) {
+			size_t slot = Growth::homeSlot(hs::Hasher<int>()(i * 7), capacity);
+			while (occupied[slot]) {
+				slot = Growth::next(slot, capacity);
+			}
+			occupied[slot] = true;
+		}
+
+		// Clusters between empty slots, one wrapping around the end joins the run at the start
+		hs::HashSetStats expected;
+		size_t first = 0;
+		while (occupied[first]) {
+			++first;
+		}
+		size_t length = 0;
+		for (size_t n = 1; n <= capacity; ++n) {
+			if (occupied[(first + n) % capacity]) {
+				++length;
+			} else if (length > 0) {
+				++expected.clusterLengths[hs::HashSetStats::histogramBucket(length)];
+				expected.maxClusterLength = std::max(expected.maxClusterLength, length);
+				length = 0;
+			}
+		}
+
+		const hs::HashSetStats fastRangeStats = set.stats();
+		EXPECT_EQ(fastRangeStats.maxClusterLength, expected.maxClusterLength);
+		for (size_t b = 0; b < hs::HashSetStats::HISTOGRAM_BUCKETS; ++b) {
+			EXPECT_EQ(fastRangeStats.clusterLengths[b], expected.clusterLengths[b]);
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetStats, ConcurrentLookups_CountsAll) {
+	StatsSet<hs::LPHashSetPolicy::Auto> set;
+	for (int i = 0; i < 1000; ++i) {
+		set.insert(i);
+	}
+	set.resetStats();
+
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; ++t) {
+		threads.emplace_back([&set]() {
+			for (int i = 0; i < 1000; ++i) {
+				set.contains(i);
+			}
+		});
+	}
+	for (auto& thread : threads) {
+		thread.join();
+	}
+
+	EXPECT_EQ(set.stats().lookups, 4000u);
+	EXPECT_EQ(set.stats().hits, 4000u);
+}
+
+//-----------------------------------------------------------------------------
+using GroupedSet = hs::LPHashSet<int, hs::LPHashSetPolicy::Grouped>;
+
+//-----------------------------------------------------------------------------
+TEST(HashSetGrouped, InsertMany_ContainsAll) {
+	insertManyAndCheck<GroupedSet>();
+	churnAndCheck<GroupedSet>();
+	churnAndCheck<StoredHashSet<int, hs::LPHashSetPolicy::Grouped>>();
+	batchLookupAndCheck<GroupedSet>();
+	stringKeysAndCheck<hs::LPHashSet<std::string, hs::LPHashSetPolicy::Grouped>>();
+
+	// Builds serially, the regions of the parallel build need linear probes
+	std::vector<int> keys(100000);
+	for (int i = 0; i < static_cast<int>(keys.size()); ++i) {
+		keys[i] = i * 3;
+	}
+	const GroupedSet built(keys.begin(), keys.end(), 4);
+	EXPECT_EQ(built.count(), keys.size());
+	for (const int key : keys) {
+		EXPECT_TRUE(built.contains(key));
+		EXPECT_FALSE(built.contains(key + 1));
+	}
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetGrouped, SetAlgebraAndEraseIf_MatchReference) {
+	setAlgebraAndCheck<GroupedSet>(3000, 3000);
+	setAlgebraAndCheck<GroupedSet>(20000, 50);
+
+	GroupedSet set;
+	for (int i = 0; i < 10000; ++i) {
+		set.insert(i);
+	}
+	EXPECT_EQ(set.eraseIf([](int key) { return key % 3 != 0; }), 6666u);
+	EXPECT_EQ(set.count(), 3334u);
+	for (int i = 0; i < 10000; ++i) {
+		EXPECT_EQ(set.contains(i), i % 3 == 0);
+	}
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetGrouped, InsertRemoveDuringMigration_Works) {
+	GroupedSet set;
+	set.setIncrementalRehash(true);
+
+	bool sawRehashing = false;
+	constexpr int count = 20000;
+	for (int i = 0; i < count; ++i) {
+		set.insert(i);
+		set.insert(i / 2);
+		if (set.isRehashing()) {
+			sawRehashing = true;
+			set.remove(i / 3);
+			EXPECT_TRUE(set.contains(i));
+			EXPECT_FALSE(set.contains(i / 3));
+			set.insert(i / 3);
+		}
+	}
+
+	EXPECT_TRUE(sawRehashing);
+	EXPECT_EQ(set.count(), count);
+	for (int i = 0; i < count; ++i) {
+		EXPECT_TRUE(set.contains(i));
+	}
+}
+
+//-----------------------------------------------------------------------------
+static hs::Hash_t sameHomeHash(const int& key) {
+	// Home slot 0 for every key below 256, only the fingerprints differ
+	return static_cast<hs::Hash_t>(key) & 0xFF;
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetGrouped, SameHomeGroup_ProbesLeaveIt) {
+	hs::LPHashSet<int, hs::LPHashSetPolicy::Grouped, hs::FuncHasher<int, sameHomeHash>, std::equal_to<>, hs::AlignedAllocator, false, hs::ProbeStats> set;
+	for (int i = 0; i < 200; ++i) {
+		set.insert(i);
+	}
+	for (int i = 0; i < 200; i += 2) {
+		set.remove(i);
+	}
+	for (int i = 0; i < 200; i += 4) {
+		set.insert(i);
+	}
+
+	EXPECT_EQ(set.count(), 150u);
+	for (int i = 0; i < 250; ++i) {
+		EXPECT_EQ(set.contains(i), i < 200 && (i % 2 == 1 || i % 4 == 0));
+	}
+
+	// Triangular steps spread the keys over several groups which are not all adjacent
+	const hs::HashSetStats stats = set.stats();
+	EXPECT_EQ(stats.lookups, 250u);
+	EXPECT_GT(stats.meanProbeLength(), 16.0);
+	EXPECT_LT(stats.maxClusterLength, set.count() + stats.tombstones);
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetGrouped, SaveLoad_RequiresSameProbing) {
+	const std::string path = tempPath("hs_grouped.bin");
+	{
+		GroupedSet set;
+		for (int i = 0; i < 5000; ++i) {
+			set.insert(i);
+		}
+		set.save(path.c_str());
+	}
+
+	{
+		GroupedSet loaded = GroupedSet::load(path.c_str());
+		EXPECT_EQ(loaded.count(), 5000u);
+		for (int i = 0; i < 6000; ++i) {
+			EXPECT_EQ(loaded.contains(i), i < 5000);
+		}
+	}
+	EXPECT_THROW((hs::LPHashSet<int, hs::LPHashSetPolicy::Auto>::load(path.c_str())), std::runtime_error);
+
+	{
+		hs::LPHashSet<int, hs::LPHashSetPolicy::SSE> linear;
+		linear.insert(1);
+		linear.save(path.c_str());
+	}
+	EXPECT_THROW(GroupedSet::load(path.c_str()), std::runtime_error);
+
+	std::remove(path.c_str());
+}
+
+//-----------------------------------------------------------------------------
+TEST(BloomFilter, Inserted_AlwaysMayContain) {
+	hs::BlockedBloomFilter<uint64_t> filter(10000);
+	for (uint64_t i = 0; i < 10000; ++i) {
+		filter.insert(i * 13);
+	}
+	for (uint64_t i = 0; i < 10000; ++i) {
+		EXPECT_TRUE(filter.mayContain(i * 13));
+	}
+
+	filter.clear();
+	EXPECT_FALSE(filter.mayContain(13));
+	EXPECT_EQ(filter.falsePositiveRate(), 0.0);
+}
+
+//-----------------------------------------------------------------------------
+TEST(BloomFilter, FalsePositiveRate_AroundOnePercent) {
+	constexpr uint64_t count = 100000;
+	hs::BlockedBloomFilter<uint64_t> filter(count);
+	EXPECT_LE(filter.sizeInBytes(), count * 10 / 8 + 64);
+	for (uint64_t i = 0; i < count; ++i) {
+		filter.insert(i);
+	}
+
+	size_t passed = 0;
+	for (uint64_t i = count; i < 11 * count; ++i) {
+		passed += filter.mayContain(i);
+	}
+	const double measured = static_cast<double>(passed) / (10 * count);
+	EXPECT_LT(measured, 0.02);
+	EXPECT_GT(measured, 0.002);
+	EXPECT_NEAR(filter.falsePositiveRate(), measured, 0.003);
+}
+
+//-----------------------------------------------------------------------------
+// The hasher of 32 bit integers barely touches the high half of the hash for dense keys
+template<class TKey>
+void testDenseKeysFalsePositiveRate() {
+	constexpr TKey count = 1000000;
+	hs::BlockedBloomFilter<TKey> filter(count);
+	for (TKey i = 0; i < count; ++i) {
+		filter.insert(i);
+	}
+
+	size_t passed = 0;
+	for (TKey i = count; i < 2 * count; ++i) {
+		passed += filter.mayContain(i);
+	}
+	const double measured = static_cast<double>(passed) / count;
+	EXPECT_LT(measured, 0.02);
+	EXPECT_NEAR(filter.falsePositiveRate(), measured, 0.003);
+}
+
+//-----------------------------------------------------------------------------
+TEST(BloomFilter, DenseIntKeys_FalsePositiveRateAroundOnePercent) {
+	testDenseKeysFalsePositiveRate<uint32_t>();
+	testDenseKeysFalsePositiveRate<int>();
+
+	// The filtered set hashes its keys for the filter the same way
+	constexpr uint32_t count = 1000000;
+	hs::BloomFilteredLPHashSet<uint32_t> set(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		set.insert(i);
+	}
+	size_t passed = 0;
+	for (uint32_t i = count; i < 2 * count; ++i) {
+		passed += set.filter().mayContain(i);
+	}
+	EXPECT_LT(static_cast<double>(passed) / count, 0.02);
+}
+
+//-----------------------------------------------------------------------------
+TEST(BloomFilter, Batch_MatchesSingleQueries) {
+	hs::BlockedBloomFilter<int> filter(500);
+	for (int i = 0; i < 1000; i += 2) {
+		filter.insert(i);
+	}
+
+	std::vector<int> keys;
+	for (int i = 0; i < 1000; ++i) {
+		keys.push_back(i);
+	}
+	std::vector<uint64_t> bits((keys.size() + 63) / 64);
+	filter.mayContainBatch(keys.data(), keys.size(), bits.data());
+	for (int i = 0; i < 1000; ++i) {
+		EXPECT_EQ(((bits[i / 64] >> (i % 64)) & 1) != 0, filter.mayContain(i));
+	}
+}
+
+//-----------------------------------------------------------------------------
+TEST(BloomFilter, FilteredSet_MatchesReference) {
+	hs::BloomFilteredLPHashSet<int> set;
+	std::unordered_set<int> reference;
+	std::mt19937 random(7);
+	for (int i = 0; i < 50000; ++i) {
+		const int key = static_cast<int>(random() % 20000);
+		if (random() % 3 == 0) {
+			set.remove(key);
+			reference.erase(key);
+		} else {
+			set.insert(key);
+			reference.insert(key);
+		}
+	}
+
+	EXPECT_EQ(set.count(), reference.size());
+	std::vector<int> keys;
+	for (int i = 0; i < 25000; ++i) {
+		keys.push_back(i);
+		EXPECT_EQ(set.contains(i), reference.count(i) != 0);
+	}
+
+	std::vector<uint64_t> bits((keys.size() + 63) / 64);
+	set.containsBatch(keys.data(), keys.size(), bits.data());
+	for (int i = 0; i < 25000; ++i) {
+		EXPECT_EQ(((bits[i / 64] >> (i % 64)) & 1) != 0, reference.count(i) != 0);
+	}
+	// Rebuilds keep the filter sized for the set
+	EXPECT_LT(set.filter().falsePositiveRate(), 0.02);
+}
+
+//-----------------------------------------------------------------------------
+TEST(BloomFilter, FilteredSet_StringKeys_Works) {
+	hs::BloomFilteredLPHashSet<std::string> set(100);
+	for (int i = 0; i < 2000; ++i) {
+		set.insert("key_" + std::to_string(i));
+	}
+
+	std::vector<std::string> keys;
+	for (int i = 0; i < 4000; ++i) {
+		keys.push_back("key_" + std::to_string(i));
+	}
+	std::vector<uint64_t> bits((keys.size() + 63) / 64);
+	set.containsBatch(keys.data(), keys.size(), bits.data());
+	for (int i = 0; i < 4000; ++i) {
+		EXPECT_EQ(((bits[i / 64] >> (i % 64)) & 1) != 0, i < 2000);
+		EXPECT_EQ(set.contains(keys[i]), i < 2000);
+	}
+}
+
+//-----------------------------------------------------------------------------
+namespace {
+	// Counts live objects and copies, so tests can check every element is destroyed exactly once.
+	// Constructing from a negative value throws.
+	struct TrackedKey {
+		static inline int live_ = 0;
+		static inline int copies_ = 0;
+		int value_;
+
+		explicit TrackedKey(int value)
+			: value_(value)
+		{
+			if (value < 0)
+				throw std::invalid_argument("Negative key");
+			++live_;
+		}
+		TrackedKey(const TrackedKey& other) : value_(other.value_) { ++live_; ++copies_; }
+		TrackedKey(TrackedKey&& other) noexcept : value_(other.value_) { ++live_; }
+		TrackedKey& operator=(const TrackedKey& other) { value_ = other.value_; ++copies_; return *this; }
+		TrackedKey& operator=(TrackedKey&& other) noexcept { value_ = other.value_; return *this; }
+		~TrackedKey() { --live_; }
+
+		friend bool operator==(const TrackedKey& a, const TrackedKey& b) { return a.value_ == b.value_; }
+		friend bool operator==(const TrackedKey& a, int b) { return a.value_ == b; }
+	};
+
+	// Transparent, so the sets look TrackedKey up by its int value
+	struct TrackedHasher {
+		using is_transparent = void;
+		hs::Hash_t operator()(int value) const { return hs::Hasher<int>()(value); }
+		hs::Hash_t operator()(const TrackedKey& key) const { return (*this)(key.value_); }
+	};
+
+	// Owns heap memory through a plain pointer, so it may be moved with memcpy
+	struct IntBoxHasher {
+		using is_transparent = void;
+		hs::Hash_t operator()(int value) const { return hs::Hasher<int>()(value); }
+		hs::Hash_t operator()(const std::unique_ptr<int>& box) const { return (*this)(*box); }
+	};
+
+	struct IntBoxEqual {
+		using is_transparent = void;
+		bool operator()(const std::unique_ptr<int>& a, const std::unique_ptr<int>& b) const { return *a == *b; }
+		bool operator()(const std::unique_ptr<int>& a, int b) const { return *a == b; }
+	};
+}
+
+namespace hs {
+	template<>
+	struct IsTriviallyRelocatable<std::unique_ptr<int>> : std::true_type {};
+}
+
+//-----------------------------------------------------------------------------
+template<class SetT>
+void testTrackedLifetime() {
+	TrackedKey::live_ = 0;
+	TrackedKey::copies_ = 0;
+	{
+		SetT set;
+		for (int i = 0; i < 2000; ++i) {
+			set.insert(TrackedKey(i));
+		}
+		// Growing moves the elements, inserting temporaries never copies them
+		EXPECT_EQ(TrackedKey::copies_, 0);
+		EXPECT_EQ(TrackedKey::live_, 2000);
+
+		// Duplicates are dropped without constructing an element
+		const TrackedKey duplicate(7);
+		set.insert(duplicate);
+		EXPECT_EQ(TrackedKey::copies_, 0);
+
+		for (int round = 0; round < 20; ++round) {
+			for (int i = 0; i < 1000; ++i) {
+				set.remove(i + round * 1000);
+				EXPECT_TRUE(set.tryEmplace(i + (round + 2) * 1000));
+			}
+		}
+		EXPECT_EQ(set.count(), 2000);
+		EXPECT_EQ(TrackedKey::live_, 2001);
+		EXPECT_TRUE(set.contains(21000));
+		EXPECT_FALSE(set.contains(0));
+		set.shrinkToFit();
+		EXPECT_TRUE(set.contains(21999));
+
+		SetT moved(std::move(set));
+		EXPECT_EQ(set.count(), 0);
+		EXPECT_FALSE(set.contains(21000));
+		EXPECT_EQ(moved.count(), 2000);
+		EXPECT_EQ(TrackedKey::live_, 2001);
+
+		// The moved-from set stays usable
+		set.emplace(5);
+		EXPECT_TRUE(set.contains(5));
+		moved = std::move(set);
+		EXPECT_TRUE(moved.contains(5));
+	}
+	EXPECT_EQ(TrackedKey::live_, 0);
+	EXPECT_EQ(TrackedKey::copies_, 0);
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetLifetime, InsertRemoveRehash_DestroysEveryElement) {
+	testTrackedLifetime<hs::LPHashSet<TrackedKey, hs::LPHashSetPolicy::Simple, TrackedHasher>>();
+	testTrackedLifetime<hs::LPHashSet<TrackedKey, hs::LPHashSetPolicy::Auto, TrackedHasher>>();
+	testTrackedLifetime<hs::LPHashSet<TrackedKey, hs::LPHashSetPolicy::Grouped, TrackedHasher>>();
+	testTrackedLifetime<hs::LPHashSet<TrackedKey, hs::LPHashSetPolicy::SSE, TrackedHasher, std::equal_to<>, hs::AlignedAllocator, true>>();
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetLifetime, IncrementalRehash_DestroysEveryElement) {
+	TrackedKey::live_ = 0;
+	{
+		hs::LPHashSet<TrackedKey, hs::LPHashSetPolicy::Auto, TrackedHasher> set;
+		set.setIncrementalRehash(true);
+		bool migrated = false;
+		for (int i = 0; i < 3000; ++i) {
+			set.emplace(i);
+			if (i % 3 == 0)
+				set.remove(i / 2);
+			migrated |= set.isRehashing();
+		}
+		EXPECT_TRUE(migrated);
+		EXPECT_EQ(static_cast<size_t>(TrackedKey::live_), set.count());
+	}
+	EXPECT_EQ(TrackedKey::live_, 0);
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetLifetime, ThrowingConstructor_LeavesSetConsistent) {
+	TrackedKey::live_ = 0;
+	{
+		hs::LPHashSet<TrackedKey, hs::LPHashSetPolicy::Auto, TrackedHasher> set;
+		for (int i = 0; i < 100; ++i) {
+			set.emplace(i);
+		}
+
+		EXPECT_THROW(set.tryEmplace(-1), std::invalid_argument);
+		EXPECT_EQ(set.count(), 100);
+		EXPECT_FALSE(set.contains(-1));
+		EXPECT_EQ(TrackedKey::live_, 100);
+
+		for (int i = 100; i < 1000; ++i) {
+			set.emplace(i);
+		}
+		EXPECT_EQ(set.count(), 1000);
+		EXPECT_TRUE(set.contains(999));
+	}
+	EXPECT_EQ(TrackedKey::live_, 0);
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetLifetime, MoveOnlyRelocatableKeys_Work) {
+	hs::LPHashSet<std::unique_ptr<int>, hs::LPHashSetPolicy::Auto, IntBoxHasher, IntBoxEqual> set;
+	for (int i = 0; i < 5000; ++i) {
+		set.insert(std::make_unique<int>(i));
+	}
+	// Rejected keys are not moved from
+	auto duplicate = std::make_unique<int>(42);
+	set.insert(std::move(duplicate));
+	EXPECT_NE(duplicate, nullptr);
+
+	for (int i = 0; i < 5000; i += 2) {
+		set.remove(i);
+	}
+	for (int i = 5000; i < 8000; ++i) {
+		set.emplace(new int(i));
+	}
+	set.shrinkToFit();
+
+	EXPECT_EQ(set.count(), 5500);
+	for (int i = 0; i < 8000; ++i) {
+		EXPECT_EQ(set.contains(i), i >= 5000 || i % 2 == 1);
+	}
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetLifetime, TryEmplaceStringView_ConstructsOnlyIfAbsent) {
+	hs::LPHashSet<std::string, hs::LPHashSetPolicy::Auto> set;
+	const std::string buffer = "alpha beta gamma alpha";
+	EXPECT_TRUE(set.tryEmplace(std::string_view(buffer).substr(0, 5)));
+	EXPECT_TRUE(set.tryEmplace(std::string_view(buffer).substr(6, 4)));
+	EXPECT_FALSE(set.tryEmplace(std::string_view(buffer).substr(17, 5)));
+	EXPECT_TRUE(set.emplace(3, 'x'));
+	EXPECT_FALSE(set.emplace("beta"));
+
+	std::vector<std::string> source = { "gamma", "delta", "alpha" };
+	set.insert(std::make_move_iterator(source.begin()), std::make_move_iterator(source.end()));
+	// Inserted strings are moved from, the duplicate is left as is
+	EXPECT_EQ(source[2], "alpha");
+
+	EXPECT_EQ(set.count(), 5);
+	EXPECT_TRUE(set.contains("xxx"));
+	EXPECT_TRUE(set.contains("delta"));
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetLifetime, DefaultAndMovedFromSets_WorkWithoutArrays) {
+	using SetT = hs::LPHashSet<int, hs::LPHashSetPolicy::AVX512>;
+	SetT full;
+	for (int i = 0; i < 1000; ++i) {
+		full.insert(i);
+	}
+	SetT empty;
+	EXPECT_EQ(empty.begin(), empty.end());
+	EXPECT_EQ(empty.intersectionCount(full), 0);
+	EXPECT_EQ(full.unite(empty).count(), 1000);
+	EXPECT_EQ(empty.unite(full).count(), 1000);
+	EXPECT_EQ(empty.difference(full).count(), 0);
+
+	const int keys[] = { 1, 2, 3 };
+	uint64_t bits = ~0ull;
+	empty.containsBatch(keys, 3, &bits);
+	EXPECT_EQ(bits, 0);
+
+	SetT moved(std::move(full));
+	EXPECT_EQ(full.count(), 0);
+	full.reserve(10);
+	full.insert(keys, keys + 3);
+	EXPECT_EQ(full.count(), 3);
+	full.swap(moved);
+	EXPECT_EQ(full.count(), 1000);
+	EXPECT_EQ(moved.count(), 3);
+}
+
+//-----------------------------------------------------------------------------
+template<hs::LPHashSetPolicy Policy, bool StoreHash = false, unsigned StepPercent = 125>
+using FastRangeSet = hs::LPHashSet<int, Policy, hs::Hasher<int>, std::equal_to<>, hs::AlignedAllocator, StoreHash,
+	hs::NoStats, hs::FastRangeGrowth<StepPercent>>;
+
+//-----------------------------------------------------------------------------
+TEST(HashSetFastRange, InsertMany_AllPolicies_ContainsAll) {
+	insertManyAndCheck<FastRangeSet<hs::LPHashSetPolicy::Simple>>();
+	insertManyAndCheck<FastRangeSet<hs::LPHashSetPolicy::SSE>>();
+	insertManyAndCheck<FastRangeSet<hs::LPHashSetPolicy::AVX>>();
+	insertManyAndCheck<FastRangeSet<hs::LPHashSetPolicy::AVX512>>();
+	insertManyAndCheck<FastRangeSet<hs::LPHashSetPolicy::Auto, true, 150>>();
+	churnAndCheck<FastRangeSet<hs::LPHashSetPolicy::SSE>>();
+	churnAndCheck<FastRangeSet<hs::LPHashSetPolicy::Auto, true>>();
+	batchLookupAndCheck<FastRangeSet<hs::LPHashSetPolicy::Auto>>();
+	setAlgebraAndCheck<FastRangeSet<hs::LPHashSetPolicy::AVX>>(3000, 3000);
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetFastRange, Grow_StepsBelowDoubling) {
+	FastRangeSet<hs::LPHashSetPolicy::Auto> set;
+	size_t capacity = set.capacity();
+	bool nonPowerOfTwo = false;
+	for (int i = 0; i < 100000; ++i) {
+		set.insert(i);
+		if (set.capacity() != capacity) {
+			EXPECT_EQ(set.capacity() % 64, 0u);
+			EXPECT_LE(set.capacity(), capacity * 5 / 4 + 64);
+			nonPowerOfTwo |= (set.capacity() & (set.capacity() - 1)) != 0;
+			capacity = set.capacity();
+		}
+	}
+	EXPECT_TRUE(nonPowerOfTwo);
+
+	// Reserve sizes to the granularity, not to the next power of two
+	FastRangeSet<hs::LPHashSetPolicy::SSE> reserved;
+	reserved.reserve(100000);
+	EXPECT_LT(reserved.capacity(), 131072u);
+	EXPECT_GE(reserved.capacity() * 4 / 5, 100000u);
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetFastRange, IncrementalRehash_KeepsAllElements) {
+	FastRangeSet<hs::LPHashSetPolicy::Auto, true> set;
+	set.setIncrementalRehash(true);
+	bool migrated = false;
+	for (int i = 0; i < 50000; ++i) {
+		set.insert(i);
+		migrated |= set.isRehashing();
+		if (i % 4 == 1)
+			set.remove(i - 1);
+	}
+	EXPECT_TRUE(migrated);
+	EXPECT_EQ(set.count(), 37500u);
+	for (int i = 0; i < 50000; ++i) {
+		EXPECT_EQ(set.contains(i), i % 4 != 0);
+	}
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetFastRange, ParallelBuild_MatchesSerialBuild) {
+	std::vector<int> keys(250000);
+	for (int i = 0; i < static_cast<int>(keys.size()); ++i) {
+		keys[i] = i;
+	}
+
+	FastRangeSet<hs::LPHashSetPolicy::Auto> serial(keys.begin(), keys.end());
+	FastRangeSet<hs::LPHashSetPolicy::Auto> parallel(keys.begin(), keys.end(), 4);
+	EXPECT_EQ(parallel.count(), serial.count());
+	EXPECT_EQ(parallel.capacity(), serial.capacity());
+	for (int i = 0; i < 250000; ++i) {
+		EXPECT_TRUE(parallel.contains(i));
+	}
+	EXPECT_FALSE(parallel.contains(250000));
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetFastRange, SaveLoad_RequiresSameGrowth) {
+	const std::string path = tempPath("hs_fast_range.bin");
+	{
+		FastRangeSet<hs::LPHashSetPolicy::Auto> set;
+		for (int i = 0; i < 30000; ++i) {
+			set.insert(i);
+		}
+		set.save(path.c_str());
+	}
+
+	auto loaded = FastRangeSet<hs::LPHashSetPolicy::SSE>::load(path.c_str());
+	EXPECT_EQ(loaded.count(), 30000u);
+	for (int i = 0; i < 30000; ++i) {
+		EXPECT_TRUE(loaded.contains(i));
+	}
+	EXPECT_FALSE(loaded.contains(30000));
+	EXPECT_THROW((hs::LPHashSet<int, hs::LPHashSetPolicy::Auto>::load(path.c_str())), std::runtime_error);
+
+	std::remove(path.c_str());
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetFastRange, SmallIntegerKeys_SpreadOverTable) {
+	// Small keys leave the high bits of the 32 bit integer hash empty
+	hs::LPHashSet<int, hs::LPHashSetPolicy::Simple, hs::Hasher<int>, std::equal_to<>, hs::AlignedAllocator, false,
+		hs::ProbeStats, hs::FastRangeGrowth<>> set;
+	for (int i = 0; i < 20000; ++i) {
+		set.insert(i);
+	}
+
+	set.resetStats();
+	for (int i = 0; i < 20000; ++i) {
+		EXPECT_TRUE(set.contains(i));
+	}
+	EXPECT_LT(set.stats().probeLengthSum, 20000u * 8);
+}
+
+//-----------------------------------------------------------------------------
+template<class SetT, class TMakeKey>
+void parallelRehashAndCheck(TMakeKey&& makeKey, int count) {
+	SetT set;
+	set.setRehashThreadCount(4);
+	for (int i = 0; i < count; ++i) {
+		set.insert(makeKey(i));
+	}
+	EXPECT_EQ(set.count(), static_cast<size_t>(count));
+
+	// Growth, reserve and shrink all rehash above the threshold
+	set.reserve(4 * static_cast<size_t>(count));
+	for (int i = 0; i < count; i += 2) {
+		set.remove(makeKey(i));
+	}
+	set.shrinkToFit();
+
+	EXPECT_EQ(set.count(), static_cast<size_t>(count / 2));
+	EXPECT_EQ(set.tombstoneCount(), 0u);
+	for (int i = 0; i < count; ++i) {
+		EXPECT_EQ(set.contains(makeKey(i)), i % 2 != 0);
+	}
+	EXPECT_EQ(static_cast<size_t>(std::distance(set.begin(), set.end())), set.count());
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetParallelRehash, AllPolicies_KeepAllElements) {
+	auto intKey = [](int i) { return i * 7; };
+	parallelRehashAndCheck<hs::LPHashSet<int, hs::LPHashSetPolicy::Simple>>(intKey, 600000);
+	parallelRehashAndCheck<hs::LPHashSet<int, hs::LPHashSetPolicy::Auto>>(intKey, 600000);
+	parallelRehashAndCheck<StoredHashSet<int, hs::LPHashSetPolicy::SSE>>(intKey, 600000);
+	parallelRehashAndCheck<FastRangeSet<hs::LPHashSetPolicy::AVX>>(intKey, 600000);
+	parallelRehashAndCheck<GroupedSet>(intKey, 300000);
+	auto stringKey = [](int i) { return "key number " + std::to_string(i); };
+	parallelRehashAndCheck<StoredHashSet<std::string, hs::LPHashSetPolicy::Auto>>(stringKey, 300000);
+	parallelRehashAndCheck<hs::LPHashSet<std::string, hs::LPHashSetPolicy::Auto>>(stringKey, 300000);
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashSetParallelRehash, ReserveWithThreads_MatchesSerialTable) {
+	hs::LPHashSet<int, hs::LPHashSetPolicy::Auto> serial;
+	hs::LPHashSet<int, hs::LPHashSetPolicy::Auto> parallel;
+	for (int i = 0; i < 500000; ++i) {
+		serial.insert(i);
+		parallel.insert(i);
+	}
+	serial.reserve(2000000);
+	parallel.reserve(2000000, 8);
+	EXPECT_EQ(parallel.rehashThreadCount(), 1u);
+	EXPECT_EQ(parallel.capacity(), serial.capacity());
+	EXPECT_EQ(parallel.count(), serial.count());
+	for (int i = 0; i < 500000; ++i) {
+		EXPECT_TRUE(parallel.contains(i));
+	}
+	EXPECT_FALSE(parallel.contains(500000));
+
+	// Threads may place colliding elements in another order, never into other probe runs
+	std::vector<int> serialKeys(serial.begin(), serial.end());
+	std::vector<int> parallelKeys(parallel.begin(), parallel.end());
+	std::sort(serialKeys.begin(), serialKeys.end());
+	std::sort(parallelKeys.begin(), parallelKeys.end());
+	EXPECT_EQ(parallelKeys, serialKeys);
+}
+
+//-----------------------------------------------------------------------------
+template<hs::LPHashSetPolicy Policy, bool SeparateValues, class TGrowth = hs::PowerOfTwoGrowth>
+using IntMap = hs::LPHashMap<int, int64_t, Policy, hs::Hasher<int>, std::equal_to<>, hs::AlignedAllocator, SeparateValues, hs::NoStats, TGrowth>;
+
+//-----------------------------------------------------------------------------
+template<class MapT>
+void testMapMatchesReference(bool incremental) {
+	MapT map;
+	map.setIncrementalRehash(incremental);
+	std::unordered_map<int, int64_t> reference;
+	std::mt19937 rng(1234);
+	std::uniform_int_distribution<int> keys(0, 20000);
+
+	for (int i = 0; i < 100000; ++i) {
+		const int key = keys(rng);
+		switch (i % 5) {
+		case 0:
+			map[key] += i;
+			reference[key] += i;
+			break;
+		case 1:
+			EXPECT_EQ(map.insertOrAssign(key, i), reference.find(key) == reference.end());
+			reference[key] = i;
+			break;
+		case 2:
+			EXPECT_EQ(map.tryEmplace(key, i), reference.emplace(key, i).second);
+			break;
+		case 3:
+			map.remove(key);
+			reference.erase(key);
+			break;
+		default:
+			map.accumulate(key, 3);
+			reference[key] += 3;
+			break;
+		}
+	}
+
+	EXPECT_EQ(map.count(), reference.size());
+	for (int key = 0; key <= 20000; ++key) {
+		const auto it = reference.find(key);
+		const int64_t* value = map.find(key);
+		ASSERT_EQ(value != nullptr, it != reference.end());
+		if (value) {
+			EXPECT_EQ(*value, it->second);
+		}
+	}
+
+	size_t visited = 0;
+	for (auto [key, value] : map) {
+		EXPECT_EQ(value, reference[key]);
+		++visited;
+	}
+	EXPECT_EQ(visited, reference.size());
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashMap, InlineValues_AllPolicies_MatchReference) {
+	testMapMatchesReference<IntMap<hs::LPHashSetPolicy::Simple, false>>(false);
+	testMapMatchesReference<IntMap<hs::LPHashSetPolicy::Auto, false>>(false);
+	testMapMatchesReference<IntMap<hs::LPHashSetPolicy::Grouped, false>>(false);
+	testMapMatchesReference<IntMap<hs::LPHashSetPolicy::AVX, false, hs::FastRangeGrowth<>>>(false);
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashMap, SeparateValues_AllPolicies_MatchReference) {
+	testMapMatchesReference<IntMap<hs::LPHashSetPolicy::Simple, true>>(false);
+	testMapMatchesReference<IntMap<hs::LPHashSetPolicy::SSE, true>>(false);
+	testMapMatchesReference<IntMap<hs::LPHashSetPolicy::Grouped, true>>(false);
+	testMapMatchesReference<IntMap<hs::LPHashSetPolicy::Auto, true, hs::FastRangeGrowth<>>>(false);
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashMap, IncrementalRehash_MatchesReference) {
+	testMapMatchesReference<IntMap<hs::LPHashSetPolicy::Auto, false>>(true);
+	testMapMatchesReference<IntMap<hs::LPHashSetPolicy::Auto, true>>(true);
+	testMapMatchesReference<IntMap<hs::LPHashSetPolicy::Grouped, true>>(true);
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashMap, StringKeys_LookupByStringView) {
+	hs::LPHashMap<std::string, std::string> map;
+	for (int i = 0; i < 1000; ++i) {
+		map["key " + std::to_string(i)] = "value " + std::to_string(i);
+	}
+	map["key 5"] += "!";
+
+	EXPECT_EQ(map.count(), 1000u);
+	const std::string_view key = "key 5";
+	ASSERT_NE(map.find(key), nullptr);
+	EXPECT_EQ(*map.find(key), "value 5!");
+	EXPECT_TRUE(map.contains(std::string_view("key 999")));
+	EXPECT_FALSE(map.contains(std::string_view("key 1000")));
+
+	// A literal is only turned into a key when it is inserted
+	EXPECT_EQ(map["key 7"], "value 7");
+	EXPECT_TRUE(map.tryEmplace("key 1000", 3, 'x'));
+	EXPECT_EQ(*map.find(std::string_view("key 1000")), "xxx");
+
+	map.remove(key);
+	EXPECT_FALSE(map.contains(key));
+	EXPECT_EQ(map.count(), 1000u);
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashMap, CountAndSumBatches_MatchReference) {
+	std::mt19937 rng(99);
+	std::geometric_distribution<int> groups(0.001);
+	std::vector<int> keys(100000);
+	std::vector<int64_t> amounts(keys.size());
+	for (size_t i = 0; i < keys.size(); ++i) {
+		keys[i] = groups(rng);
+		amounts[i] = static_cast<int64_t>(rng() % 1000) - 500;
+	}
+
+	std::unordered_map<int, uint64_t> referenceCounts;
+	std::unordered_map<int, int64_t> referenceSums;
+	for (size_t i = 0; i < keys.size(); ++i) {
+		++referenceCounts[keys[i]];
+		referenceSums[keys[i]] += amounts[i];
+	}
+
+	hs::LPHashCounter<int> counts;
+	IntMap<hs::LPHashSetPolicy::Auto, true> sums;
+	// Uneven batch sizes end windows in the middle
+	for (size_t begin = 0; begin < keys.size(); begin += 777) {
+		const size_t size = std::min<size_t>(777, keys.size() - begin);
+		counts.countBatch(keys.data() + begin, size);
+		sums.accumulateBatch(keys.data() + begin, amounts.data() + begin, size);
+	}
+
+	EXPECT_EQ(counts.count(), referenceCounts.size());
+	EXPECT_EQ(sums.count(), referenceSums.size());
+	counts.forEach([&](int key, uint64_t count) { EXPECT_EQ(count, referenceCounts[key]); });
+	sums.forEach([&](int key, int64_t sum) { EXPECT_EQ(sum, referenceSums[key]); });
+
+	// HAVING count > 100
+	const size_t small = std::count_if(referenceCounts.begin(), referenceCounts.end(), [](const auto& group) { return group.second <= 100; });
+	EXPECT_EQ(counts.eraseIf([](int, uint64_t count) { return count <= 100; }), small);
+	EXPECT_EQ(counts.count(), referenceCounts.size() - small);
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashMap, Upsert_InsertsOrUpdates) {
+	hs::LPHashMap<int, std::vector<int>> map;
+	for (int i = 0; i < 300; ++i) {
+		const bool inserted = map.upsert(i % 100, [&](std::vector<int>& values) { values.push_back(i); });
+		EXPECT_EQ(inserted, i < 100);
+	}
+	EXPECT_EQ(map.count(), 100u);
+	EXPECT_EQ(*map.find(42), (std::vector<int>{ 42, 142, 242 }));
+
+	const auto& constMap = map;
+	size_t total = 0;
+	constMap.forEach([&](int, const std::vector<int>& values) { total += values.size(); });
+	EXPECT_EQ(total, 300u);
+	for (auto [key, values] : constMap) {
+		EXPECT_EQ(values.front(), key);
+	}
+}
+
+//-----------------------------------------------------------------------------
+template<class MapT>
+void testTrackedValues() {
+	TrackedKey::live_ = 0;
+	TrackedKey::copies_ = 0;
+	{
+		MapT map;
+		map.setIncrementalRehash(true);
+		for (int i = 0; i < 3000; ++i) {
+			map.tryEmplace(TrackedKey(i), i);
+			if (i % 3 == 0)
+				map.remove(i / 2);
+		}
+		// Keys and values are both TrackedKey, moves through rehashes and migrations never copy
+		EXPECT_EQ(TrackedKey::copies_, 0);
+		EXPECT_EQ(static_cast<size_t>(TrackedKey::live_), 2 * map.count());
+
+		// A throwing value constructor inserts nothing and leaks no key
+		EXPECT_THROW(map.tryEmplace(TrackedKey(5000), -1), std::invalid_argument);
+		EXPECT_FALSE(map.contains(5000));
+		EXPECT_EQ(static_cast<size_t>(TrackedKey::live_), 2 * map.count());
+
+		map.insertOrAssign(2999, TrackedKey(7));
+		EXPECT_EQ(map.find(2999)->value_, 7);
+		EXPECT_EQ(map.eraseIf([](const TrackedKey& key, const TrackedKey&) { return key.value_ % 2 == 0; }), 1000u);
+		EXPECT_EQ(static_cast<size_t>(TrackedKey::live_), 2 * map.count());
+
+		MapT moved(std::move(map));
+		EXPECT_EQ(map.count(), 0u);
+		EXPECT_EQ(moved.find(2999)->value_, 7);
+	}
+	EXPECT_EQ(TrackedKey::live_, 0);
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashMap, NonTrivialValues_DestroysEveryElement) {
+	testTrackedValues<hs::LPHashMap<TrackedKey, TrackedKey, hs::LPHashSetPolicy::Auto, TrackedHasher>>();
+	testTrackedValues<hs::LPHashMap<TrackedKey, TrackedKey, hs::LPHashSetPolicy::Auto, TrackedHasher, std::equal_to<>, hs::AlignedAllocator, true>>();
+	testTrackedValues<hs::LPHashMap<TrackedKey, TrackedKey, hs::LPHashSetPolicy::Grouped, TrackedHasher, std::equal_to<>, hs::AlignedAllocator, true>>();
+}
+
+//-----------------------------------------------------------------------------
+TEST(HashMap, ParallelRehash_MovesValues) {
+	IntMap<hs::LPHashSetPolicy::Auto, true> separate;
+	IntMap<hs::LPHashSetPolicy::Auto, false> inlined;
+	separate.setRehashThreadCount(4);
+	inlined.setRehashThreadCount(4);
+	for (int i = 0; i < 400000; ++i) {
+		separate[i * 3] = i;
+		inlined[i * 3] = i;
+	}
+	separate.reserve(2000000);
+	inlined.reserve(2000000);
+	for (int i = 0; i < 400000; ++i) {
+		ASSERT_NE(separate.find(i * 3), nullptr);
+		EXPECT_EQ(*separate.find(i * 3), i);
+		EXPECT_EQ(*inlined.find(i * 3), i);
+	}
+	EXPECT_FALSE(separate.contains(1));
+}